@@ -0,0 +1,78 @@
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include <chrono>
+#include <vector>
+
+//Wall-clock stopwatch for timing benchmark runs
+class Stopwatch {
+  public:
+    Stopwatch() { restart(); }
+
+    void restart() { begin = std::chrono::steady_clock::now(); }
+
+    double seconds() const
+    {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                           - begin).count();
+    }
+
+  private:
+    std::chrono::steady_clock::time_point begin;
+};
+
+//How many untimed and timed runs measure() makes; set from the command line
+struct BenchmarkSettings
+{
+  int warmup;
+  int repetitions;
+};
+
+const BenchmarkSettings& benchmarkSettings();
+
+//Keeps a result alive so the compiler can't drop the work behind it
+void consume(double value);
+
+//Records one benchmark from the times (s) of its runs. Each run processes
+//items of itemName and, if bytes is non-zero, that much data.
+void recordResult(const char* name, const std::vector<double>& seconds,
+                  double items, const char* itemName, double bytes);
+
+//Marks a benchmark whose output was wrong; nimblebench then fails
+void reportFailure(const char* name, const char* reason);
+
+/*******************************************************************************
+ Runs body benchmarkSettings().warmup times untimed, then repetitions times
+ timed, and records one sample per timed run. A run should take long enough
+ (a millisecond or more) for the clock not to matter.
+*******************************************************************************/
+template<class Body>
+void measure(const char* name, double items, const char* itemName,
+             double bytes, Body body)
+{
+  const BenchmarkSettings& settings = benchmarkSettings();
+  std::vector<double> seconds(size_t(settings.repetitions));
+
+  for(int i = 0; i < settings.warmup; i++)
+    body();
+
+  for(int i = 0; i < settings.repetitions; i++)
+  {
+    Stopwatch watch;
+    body();
+    seconds[size_t(i)] = watch.seconds();
+  }
+
+  recordResult(name, seconds, items, itemName, bytes);
+}
+
+//Individual benchmark groups
+void runImageBenchmarks();
+void runExportBenchmarks();
+void runServoBenchmarks();
+void runForceFieldBenchmarks();
+void runCallbackBenchmarks();
+void runCaptureBenchmarks();
+void runTextureBenchmarks();
+
+#endif
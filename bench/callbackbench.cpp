@@ -0,0 +1,471 @@
+/*******************************************************************************
+ The two servo callbacks, computeForceCB and DeviceStateCallback, run tick
+ after tick without OpenHaptics. A replay device moves the end effector
+ along a pen path, and a simulated effect state cache hands computeForceCB
+ the proxy and device positions the way hlCacheGetDoublev would. The
+ callback as it was before the effect kernels runs alongside for
+ comparison.
+*******************************************************************************/
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "capturefanout.h"
+#include "constants.h"
+#include "distancefield.h"
+#include "forcefield.h"
+#include "forceeffects.h"
+#include "hapticdevice.h"
+#include "servohandoff.h"
+#include "servoparams.h"
+#include "servoprofiler.h"
+#include "timestamp.h"
+
+using namespace std;
+
+namespace {
+  //Ticks per run: a tenth of a second of servo time would be too short to
+  //time, so each run is 100 s of ticks at 1 kHz
+  const size_t TickCount = 100000;
+  const double UpdateRate = 1000.0;
+
+  //The medium preset of the context menu, and an Omni's stiffness
+  const double Mass = 0.030;
+  const double Damping = 0.003;
+  const double SpringStiffness = 0.2;
+  const double MaxStiffness = 0.9;
+
+  //Pattern bitmap the guidance force is built from, and the world
+  //rectangle it is drawn on (4:3, as in the app)
+  const int PatternWidth = 640;
+  const int PatternHeight = 480;
+  const double HalfWidth = 4.0;
+  const double HalfHeight = 3.0;
+  const double WorldPerMm = 0.025;
+
+  const double Pi = 3.14159265358979323846;
+
+  //A pen circling the pattern with a tremor on top (mm), one entry per tick
+  vector<double> makePath()
+  {
+    vector<double> path(3 * TickCount);
+
+    for(size_t t = 0; t < TickCount; t++)
+    {
+      double s = double(t) / UpdateRate;
+
+      path[3 * t + 0] = 50.0 * cos(0.8 * s) + 0.3 * sin(2.0 * Pi * 8.0 * s);
+      path[3 * t + 1] = 40.0 * sin(0.8 * s) + 0.3 * cos(2.0 * Pi * 9.0 * s);
+      path[3 * t + 2] = 0.5 * sin(0.1 * s);
+    }
+
+    return path;
+  }
+
+  /*****************************************************************************
+   Plays makePath() back one tick at a time. Calls go through the
+   HapticDevice interface just as the callbacks' do.
+  *****************************************************************************/
+  class ReplayDevice : public HapticDevice {
+    public:
+      explicit ReplayDevice(const vector<double>& p) : path(p), tick(0) {}
+
+      void advance() { tick = tick + 1 < TickCount ? tick + 1 : 0; }
+
+      bool init() { return true; }
+      void shutdown() {}
+
+      void getPosition(double position[3])
+      {
+        for(int i = 0; i < 3; i++)
+          position[i] = path[3 * tick + i];
+      }
+
+      void setForce(const double[3]) {}
+      double getUpdateRate() { return UpdateRate; }
+      double getNominalUpdateRate() { return UpdateRate; }
+      double getMaxStiffness() { return MaxStiffness; }
+
+      ServoHandle schedule(ServoCallback, void *, unsigned short) { return 0; }
+      void unschedule(ServoHandle) {}
+
+      void startScheduler() {}
+      void stopScheduler() {}
+
+    private:
+      const vector<double>& path;
+      size_t tick;
+  };
+
+  /*****************************************************************************
+   Stands in for the HL effect state cache: values looked up by name behind
+   a call the compiler can't inline, as hlCacheGetDoublev is one into hl.dll.
+  *****************************************************************************/
+  enum CacheKey { CacheProxyPosition, CacheDevicePosition, CacheKeyCount };
+
+  struct SimulatedCache
+  {
+    double values[CacheKeyCount][4];
+  };
+
+  void cacheGet(const SimulatedCache* cache, int key, double* out)
+  {
+    for(int i = 0; i < 3; i++)
+      out[i] = cache->values[key][i];
+  }
+
+  void (*volatile cacheGetDoublev)(const SimulatedCache*, int, double*) = cacheGet;
+
+  struct LegacyPointMass
+  {
+    double position[3];
+    double velocity[3];
+    double mass;
+    double stiffness;
+    double damping;
+  };
+
+  //What computeForceCB reaches besides its arguments
+  struct ForceContext
+  {
+    HapticDevice* device;
+    ServoProbe* probe;
+    ServoHandoff<PatternGuidance> guidance;
+    ServoHandoff<AttractorField> anchors;
+    ServoParameters* effect;
+  };
+
+  /*****************************************************************************
+   computeForceCB as it stands.
+  *****************************************************************************/
+  void computeForce(double force[3], const SimulatedCache* cache,
+                    EffectState* state, ForceContext& context)
+  {
+    ServoTimer timer(*context.probe);
+    EffectInput in;
+
+    cacheGetDoublev(cache, CacheProxyPosition, in.proxy);
+    cacheGetDoublev(cache, CacheDevicePosition, in.device);
+
+    in.params = &context.effect->update(state->tickSeconds, in.paramsChanged);
+    in.guidance = context.guidance.acquire();
+    in.anchors = context.anchors.acquire();
+
+    double effectForce[3];
+
+    selectEffectKernel(in)(*state, in, effectForce);
+
+    context.guidance.release();
+    context.anchors.release();
+
+    for(int i = 0; i < 3; i++)
+      force[i] += effectForce[i];
+  }
+
+  /*****************************************************************************
+   computeForceCB before the effect kernels, on plain arrays where it had
+   hduVector3Dd: explicit Euler at the measured rate, with the device
+   position asked for separately and the settings read directly.
+  *****************************************************************************/
+  void legacyComputeForce(double force[3], const SimulatedCache* cache,
+                          LegacyPointMass* pm, ForceContext& context)
+  {
+    ServoTimer timer(*context.probe);
+
+    double deltaT = 1.0 / context.device->getUpdateRate();
+    double proxyPos[3];
+
+    cacheGetDoublev(cache, CacheProxyPosition, proxyPos);
+
+    double inertiaForce[3];
+
+    for(int i = 0; i < 3; i++)
+    {
+      double springForce = pm->stiffness * (proxyPos[i] - pm->position[i]);
+      double damperForce = -pm->damping * pm->velocity[i];
+
+      inertiaForce[i] = springForce + damperForce;
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+      double acceleration = inertiaForce[i] / pm->mass;
+
+      pm->velocity[i] += acceleration * deltaT;
+      pm->position[i] += pm->velocity[i] * deltaT;
+    }
+
+    double devicePosition[3], forceVector[3] = {0.0, 0.0, 0.0};
+
+    context.device->getPosition(devicePosition);
+
+    const float k = float(Damping);
+    const PatternGuidance* pGuidance = context.guidance.acquire();
+
+    if(pGuidance != NULL)
+      pGuidance->force(devicePosition, k, Constant::GuidanceMaxForce, forceVector);
+
+    context.guidance.release();
+
+    for(int i = 0; i < 3; i++)
+      force[i] += forceVector[i];
+
+    const AttractorField* pAnchors = context.anchors.acquire();
+
+    if(pAnchors != NULL)
+    {
+      pAnchors->force(devicePosition, forceVector);
+
+      for(int i = 0; i < 3; i++)
+        force[i] += forceVector[i];
+    }
+
+    context.anchors.release();
+
+    for(int i = 0; i < 3; i++)
+      force[i] += -inertiaForce[i];
+  }
+
+  //A ring stroke through the middle of the bitmap, as patterns are drawn
+  PatternGuidance* makeGuidance()
+  {
+    const size_t bytes = size_t(PatternWidth) * PatternHeight * 3;
+    Image image(new char[bytes], PatternWidth, PatternHeight);
+    char* pixels = image.pixels;
+
+    fill_n(pixels, bytes, char(255));
+
+    for(int y = 0; y < PatternHeight; y++)
+      for(int x = 0; x < PatternWidth; x++)
+      {
+        double r = hypot(x - 0.5 * PatternWidth, y - 0.5 * PatternHeight);
+
+        if(fabs(r - 0.35 * PatternHeight) < 4.0)
+          for(int c = 0; c < 3; c++)
+            pixels[3 * (size_t(y) * PatternWidth + x) + c] = 0;
+      }
+
+    shared_ptr<DistanceField> field(new DistanceField);
+    field->build(image, Constant::StrokeThreshold, 1);
+
+    double workspaceToWorld[16] = {
+      WorldPerMm, 0.0, 0.0, 0.0,
+      0.0, WorldPerMm, 0.0, 0.0,
+      0.0, 0.0, WorldPerMm, 0.0,
+      0.0, 0.0, 0.0, 1.0
+    };
+
+    PatternGuidance* guidance = new PatternGuidance;
+
+    guidance->field = field;
+    guidance->setMapping(workspaceToWorld, HalfWidth, HalfHeight);
+    return guidance;
+  }
+
+  //The two ratio points, on the path
+  AttractorField* makeAnchors()
+  {
+    vector<Attractor> points(2);
+
+    for(int a = 0; a < 2; a++)
+    {
+      points[a].position[0] = a == 0 ? 50.0 : -50.0;
+      points[a].position[1] = 0.0;
+      points[a].position[2] = 0.0;
+      points[a].radius = Constant::AnchorRadius;
+      points[a].stiffness = Constant::AnchorStiffness;
+    }
+
+    return new AttractorField(points);
+  }
+
+  //Ticks pushed between waits for the consumers; less than any ring holds
+  const size_t Burst = 256;
+
+  //Drains a ring on its own thread, as the recorder, trace and monitor do
+  class RingConsumer {
+    public:
+      RingConsumer(RingBuffer<DeviceState>& r) : ring(r), stopRequested(false)
+      {
+        worker = thread(&RingConsumer::run, this);
+      }
+
+      ~RingConsumer()
+      {
+        stopRequested.store(true);
+        worker.join();
+      }
+
+    private:
+      void run()
+      {
+        DeviceState batch[Burst];
+
+        while(!stopRequested.load())
+          if(ring.drain(batch, Burst) == 0)
+            this_thread::yield();
+      }
+
+      RingBuffer<DeviceState>& ring;
+      atomic<bool> stopRequested;
+      thread worker;
+  };
+}
+
+
+void runCallbackBenchmarks()
+{
+  vector<double> path = makePath();
+  ReplayDevice device(path);
+  ServoProbe probe("computeForceCB", 0.5);
+  ServoParameters effect(Constant::EffectRampSeconds);
+  ForceContext context;
+
+  probe.setUpdateRate(UpdateRate);
+  context.device = &device;
+  context.probe = &probe;
+  context.effect = &effect;
+
+  SimulatedCache cache = {};
+  EffectState state = {};
+  LegacyPointMass legacy = {};
+
+  state.tickSeconds = 1.0 / UpdateRate;
+  legacy.mass = Mass;
+  legacy.stiffness = MaxStiffness * SpringStiffness;
+  legacy.damping = 2 * sqrt(legacy.mass * legacy.stiffness);
+
+  // The medium preset, and No Effect, which the old callback divided by
+  // zero on.
+  const EffectParameters medium = {
+    legacy.mass, legacy.stiffness, legacy.damping, Damping
+  };
+  const EffectParameters none = {0.0, 0.0, 0.0, 0.0};
+  const char* names[2][3] = {
+    {"callback/legacy-inertia", "callback/force-inertia",
+     "callback/force-none"},
+    {"callback/legacy-guided", "callback/force-guided",
+     "callback/force-none-guided"}
+  };
+
+  // Bare point mass first, then with guidance and ratio points as in a
+  // session.
+  for(int withFields = 0; withFields < 2; withFields++)
+  {
+    if(withFields)
+    {
+      context.guidance.publish(makeGuidance());
+      context.anchors.publish(makeAnchors());
+    }
+
+    // The old callback, then the kernels on the two presets.
+    for(int kernel = 0; kernel < 3; kernel++)
+    {
+      double lastChecksum = 0.0;
+
+      effect.publish(kernel == 2 ? none : medium);
+
+      measure(names[withFields][kernel], double(TickCount), "tick", 0, [&] {
+        double checksum = 0.0;
+
+        for(size_t t = 0; t < TickCount; t++)
+        {
+          double force[3] = {0.0, 0.0, 0.0};
+
+          device.getPosition(cache.values[CacheProxyPosition]);
+          device.getPosition(cache.values[CacheDevicePosition]);
+
+          if(kernel == 0)
+            legacyComputeForce(force, &cache, &legacy, context);
+          else
+            computeForce(force, &cache, &state, context);
+
+          device.advance();
+          checksum += force[0];
+        }
+
+        lastChecksum = checksum;
+        consume(checksum);
+      });
+
+      if(!(fabs(lastChecksum) <= numeric_limits<double>::max()))
+        reportFailure(names[withFields][kernel], "force is not finite");
+    }
+  }
+}
+
+
+void runCaptureBenchmarks()
+{
+  vector<double> path = makePath();
+  ReplayDevice device(path);
+  ServoProbe probe("DeviceStateCallback", 0.1);
+
+  probe.setUpdateRate(UpdateRate);
+
+  // The recorder's ring, then the trace overlay's and the skill monitor's,
+  // each drained by a thread of its own. Unpaced, the callback would outrun
+  // the consumers and time the drop path, so every Burst ticks it waits for
+  // them: the figure is what the whole path sustains without a drop.
+  const size_t capacities[3] = {
+    size_t(UpdateRate) * Constant::RecordBufferSeconds,
+    size_t(UpdateRate) * Constant::TraceBufferSeconds,
+    size_t(UpdateRate) * Constant::TraceBufferSeconds
+  };
+  RingBuffer<DeviceState> rings[3];
+
+  for(int attached = 1; attached <= 3; attached += 2)
+  {
+    CaptureFanout fanout;
+    vector<unique_ptr<RingConsumer> > consumers;
+    size_t dropped = 0;
+
+    for(int r = 0; r < attached; r++)
+    {
+      rings[r].reset(capacities[r]);
+      fanout.attach(&rings[r]);
+      consumers.push_back(unique_ptr<RingConsumer>(new RingConsumer(rings[r])));
+    }
+
+    char name[64];
+
+    sprintf(name, "capture/fanout-%d", attached);
+    measure(name, double(TickCount), "tick", 0, [&] {
+      for(size_t t = 0; t < TickCount; t++)
+      {
+        {
+          // DeviceStateCallback's body
+          ServoTimer timer(probe);
+          DeviceState state;
+
+          state.time = timestampNow();
+          device.getPosition(state.position);
+          fanout.push(state);
+          device.advance();
+        }
+
+        if(t % Burst == Burst - 1)
+          for(int r = 0; r < attached; r++)
+            while(rings[r].size() > 0)
+              this_thread::yield();
+      }
+    });
+
+    consumers.clear();
+
+    for(int r = 0; r < attached; r++)
+    {
+      dropped += rings[r].droppedCount();
+      fanout.detach(&rings[r]);
+    }
+
+    if(dropped > 0)
+      reportFailure(name, "samples dropped");
+  }
+}
@@ -0,0 +1,133 @@
+/*******************************************************************************
+ Trajectory export: the iostream row loop writeDeviceStatesToFile used to
+ run against TrajectoryTextWriter, and the binary session writer, on the
+ same synthetic session.
+*******************************************************************************/
+#include <cstdio>
+#include <cmath>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+
+#include "benchmark.h"
+#include "trajectoryfile.h"
+#include "trajectorytext.h"
+
+using namespace std;
+
+namespace {
+  //Three and a half minutes at 1 kHz; an hour would be 3.6M rows
+  const size_t SampleCount = 200000;
+
+  //A smooth pen path with some noise, sampled every millisecond
+  vector<TrajectorySample> makeSession()
+  {
+    vector<TrajectorySample> samples(SampleCount);
+    unsigned int seed = 12345;
+
+    for(size_t i = 0; i < SampleCount; i++)
+    {
+      double t = double(i) * 1.0e-3;
+      seed = seed * 1103515245u + 12345u;
+      double noise = double((seed >> 16) & 0x7fff) / 32768.0 - 0.5;
+
+      samples[i].position[0] = 80.0 * sin(0.7 * t) + noise;
+      samples[i].position[1] = 60.0 * cos(0.3 * t) - noise;
+      samples[i].position[2] = -20.0 + 0.1 * noise;
+      samples[i].time = (long long)i * 1000000LL;
+    }
+
+    return samples;
+  }
+
+  //The row loop writeDeviceStatesToFile used before the text writer
+  void writeIostream(const char* path, const vector<TrajectorySample>& samples)
+  {
+    ofstream dsFile(path);
+
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+      double countTime = double(samples[i].time) * 1.0e-6;
+
+      dsFile << fixed << setprecision(4) << "- ["
+             << samples[i].position[0] << ", "
+             << samples[i].position[1] << ", "
+             << samples[i].position[2] << ", "
+             << setprecision(1) << countTime << "]" << endl;
+    }
+  }
+
+  void writeText(const char* path, const vector<TrajectorySample>& samples)
+  {
+    FILE* file = fopen(path, "w");
+    TrajectoryTextWriter writer;
+
+    writer.attach(file);
+    writer.writeSamples(&samples[0], samples.size());
+    writer.attach(NULL);
+    fclose(file);
+  }
+
+  void writeBinary(const char* path, const vector<TrajectorySample>& samples)
+  {
+    TrajectoryWriter writer;
+    SessionInfo info;
+
+    info.patientId = "bench";
+    writer.open(path, info);
+    writer.append(&samples[0], samples.size());
+    writer.close();
+  }
+
+  size_t fileSize(const char* path)
+  {
+    FILE* file = fopen(path, "rb");
+
+    if(file == NULL)
+      return 0;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+
+    return size > 0 ? size_t(size) : 0;
+  }
+
+  string readAll(const char* path)
+  {
+    ifstream in(path, ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  }
+}
+
+
+void runExportBenchmarks()
+{
+  const char* iostreamPath = "bench_export_iostream.txt";
+  const char* textPath = "bench_export_text.txt";
+  const char* binaryPath = "bench_export.nbt";
+  vector<TrajectorySample> samples = makeSession();
+  double rows = double(samples.size());
+
+  // One run of each first, to check the writers agree.
+  writeIostream(iostreamPath, samples);
+  writeText(textPath, samples);
+  writeBinary(binaryPath, samples);
+
+  if(readAll(iostreamPath) != readAll(textPath))
+    reportFailure("export/text-writer", "output differs from iostream");
+
+  measure("export/iostream", rows, "row", double(fileSize(iostreamPath)),
+          [&] { writeIostream(iostreamPath, samples); });
+  measure("export/text-writer", rows, "row", double(fileSize(textPath)),
+          [&] { writeText(textPath, samples); });
+  measure("export/binary", rows, "row", double(fileSize(binaryPath)),
+          [&] { writeBinary(binaryPath, samples); });
+
+  remove(iostreamPath);
+  remove(textPath);
+  remove(binaryPath);
+}
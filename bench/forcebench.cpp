@@ -0,0 +1,150 @@
+/*******************************************************************************
+ Attractor force lookups per servo tick: the grid-indexed AttractorField
+ against a scan of every attractor, as the number of attractors grows. The
+ radius shrinks as the count grows, as waypoints along a path do, so the
+ device is near about as many attractors in every run.
+*******************************************************************************/
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include "benchmark.h"
+#include "forcefield.h"
+
+using namespace std;
+
+namespace {
+  //Lookups per run; a few seconds of servo ticks at 1 kHz would be too few
+  const size_t LookupCount = 1000000;
+
+  //Roughly the Omni's usable workspace (mm)
+  const double Extent[3] = {160.0, 120.0, 70.0};
+
+  //Radius (mm) of 128 attractors; n of them get Radius * cbrt(128 / n)
+  const double Radius = 5.0;
+  const double Stiffness = 0.1;
+
+  //Attractor visits per scan run, to keep the large counts short
+  const double ScanVisits = 2.0e7;
+
+  //Uniform in [0, 1) from a small LCG, so runs are repeatable
+  double nextUniform(unsigned int& seed)
+  {
+    seed = seed * 1103515245u + 12345u;
+    return double((seed >> 8) & 0xffffff) / 16777216.0;
+  }
+
+  vector<Attractor> makeAttractors(size_t count)
+  {
+    vector<Attractor> attractors(count);
+    unsigned int seed = 2024;
+    double radius = Radius * pow(128.0 / double(count), 1.0 / 3.0);
+
+    for(size_t a = 0; a < count; a++)
+    {
+      for(int i = 0; i < 3; i++)
+        attractors[a].position[i] = (nextUniform(seed) - 0.5) * Extent[i];
+
+      attractors[a].radius = radius;
+      attractors[a].stiffness = Stiffness;
+    }
+
+    return attractors;
+  }
+
+  //A wandering device path through the same workspace
+  vector<double> makePath()
+  {
+    vector<double> path(3 * LookupCount);
+    double position[3] = {0.0, 0.0, 0.0};
+    unsigned int seed = 77;
+
+    for(size_t t = 0; t < LookupCount; t++)
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        position[i] += nextUniform(seed) - 0.5;
+
+        if(position[i] > 0.5 * Extent[i] || position[i] < -0.5 * Extent[i])
+          position[i] *= -0.9;
+
+        path[3 * t + i] = position[i];
+      }
+    }
+
+    return path;
+  }
+
+  //What computeForceCB would do with no index
+  void scanForce(const vector<Attractor>& attractors, const double position[3],
+                 double out[3])
+  {
+    out[0] = out[1] = out[2] = 0.0;
+
+    for(size_t a = 0; a < attractors.size(); a++)
+    {
+      const Attractor& attractor = attractors[a];
+      double toward[3], distance2 = 0.0;
+
+      for(int i = 0; i < 3; i++)
+      {
+        toward[i] = attractor.position[i] - position[i];
+        distance2 += toward[i] * toward[i];
+      }
+
+      if(distance2 < attractor.radius * attractor.radius)
+        for(int i = 0; i < 3; i++)
+          out[i] += attractor.stiffness * toward[i];
+    }
+  }
+}
+
+
+void runForceFieldBenchmarks()
+{
+  const size_t counts[] = {16, 128, 1024, 8192};
+  vector<double> path = makePath();
+
+  for(int c = 0; c < 4; c++)
+  {
+    vector<Attractor> attractors = makeAttractors(counts[c]);
+    AttractorField field(attractors);
+    size_t visited = 0;
+    char name[64];
+
+    sprintf(name, "forcefield/grid-%u", (unsigned int)counts[c]);
+    measure(name, double(LookupCount), "tick", 0, [&] {
+      double force[3], checksum = 0.0;
+
+      for(size_t t = 0; t < LookupCount; t++)
+      {
+        field.force(&path[3 * t], force);
+        checksum += force[0];
+      }
+
+      consume(checksum);
+    });
+
+    for(size_t t = 0; t < LookupCount; t += 64)
+      visited += field.candidates(&path[3 * t]);
+
+    printf("%-28s %10.1f candidates/tick\n", "",
+           double(visited) / double((LookupCount + 63) / 64));
+
+    size_t scanCount = min(LookupCount, size_t(ScanVisits / double(counts[c])));
+
+    sprintf(name, "forcefield/scan-%u", (unsigned int)counts[c]);
+    measure(name, double(scanCount), "tick", 0, [&] {
+      double force[3], checksum = 0.0;
+
+      for(size_t t = 0; t < scanCount; t++)
+      {
+        scanForce(attractors, &path[3 * t], force);
+        checksum += force[0];
+      }
+
+      consume(checksum);
+    });
+  }
+}
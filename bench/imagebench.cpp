@@ -0,0 +1,113 @@
+/*******************************************************************************
+ Pattern bitmap loading: loadBMP on a pattern-sized bitmap and on a large
+ one, written out once as 24-bit uncompressed BMPs like the shipped
+ patterns.
+*******************************************************************************/
+#include <cstdio>
+#include <vector>
+
+#include "benchmark.h"
+#include "byteorder.h"
+#include "imageloader.h"
+
+using namespace std;
+
+namespace {
+  struct BitmapSize
+  {
+    const char* name;
+    int width;
+    int height;
+    int loads; // per run, so a run takes a few milliseconds
+  };
+
+  //The large width isn't a multiple of four, so its rows carry padding
+  const BitmapSize Sizes[] = {
+    {"loadBMP/small-640x480", 640, 480, 32},
+    {"loadBMP/large-2050x1536", 2050, 1536, 4}
+  };
+
+  //Writes a BITMAPINFOHEADER bitmap of a dark stroke on white; returns the
+  //file size, or 0 if it couldn't be written
+  size_t writeBitmap(const char* path, int width, int height)
+  {
+    const unsigned int rowBytes = (unsigned int)(width * 3 + 3) & ~3u;
+    const unsigned int dataOffset = 14 + 40;
+    vector<unsigned char> file(dataOffset + size_t(rowBytes) * height, 0);
+    unsigned char* header = &file[0];
+
+    header[0] = 'B';
+    header[1] = 'M';
+    putU32(header + 2, (unsigned int)file.size());
+    putU32(header + 10, dataOffset);
+    putU32(header + 14, 40);
+    putU32(header + 18, (unsigned int)width);
+    putU32(header + 22, (unsigned int)height);
+    putU16(header + 26, 1);  // planes
+    putU16(header + 28, 24); // bits per pixel
+
+    for(int y = 0; y < height; y++)
+    {
+      unsigned char* row = &file[dataOffset + size_t(rowBytes) * y];
+
+      for(int x = 0; x < width; x++)
+      {
+        bool stroke = (x + y) % 97 < 6;
+
+        row[3 * x + 0] = stroke ? 40 : 255;
+        row[3 * x + 1] = stroke ? 20 : 255;
+        row[3 * x + 2] = stroke ? 10 : 255;
+      }
+    }
+
+    FILE* out = fopen(path, "wb");
+
+    if(out == NULL)
+      return 0;
+
+    bool written = fwrite(&file[0], 1, file.size(), out) == file.size();
+
+    return fclose(out) == 0 && written ? file.size() : 0;
+  }
+}
+
+
+void runImageBenchmarks()
+{
+  const char* path = "bench_pattern.bmp";
+
+  for(size_t s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); s++)
+  {
+    const BitmapSize& size = Sizes[s];
+    size_t bytes = writeBitmap(path, size.width, size.height);
+
+    if(bytes == 0)
+    {
+      reportFailure(size.name, "can't write the bitmap");
+      continue;
+    }
+
+    // The bitmap is stored BGR; loadBMP must hand back RGB.
+    Image* check = loadBMP(path);
+
+    if(check == NULL || check->width != size.width
+       || check->height != size.height || (unsigned char)check->pixels[0] != 10
+       || (unsigned char)check->pixels[2] != 40)
+      reportFailure(size.name, "pixels read back wrong");
+
+    delete check;
+
+    measure(size.name, double(size.loads) * size.width * size.height, "pixel",
+            double(size.loads) * double(bytes), [&] {
+      for(int i = 0; i < size.loads; i++)
+      {
+        Image* image = loadBMP(path);
+
+        consume(image != NULL ? image->pixels[0] : 0.0);
+        delete image;
+      }
+    });
+  }
+
+  remove(path);
+}
@@ -0,0 +1,397 @@
+/*******************************************************************************
+* Micro-benchmarks for the Nimble hot paths. Runs without a haptic device.
+*
+*   nimblebench [options] [group ...]
+*
+* With no groups every group runs. Groups: image, export, servo, forcefield,
+* callback, capture, texture
+*
+* Options:
+*   --warmup n        untimed runs before each benchmark (default 2)
+*   --repetitions n   timed runs of each benchmark (default 15)
+*   --csv file        also write the results as CSV
+*   --json file       also write the results as JSON
+*   --baseline file   compare against the CSV of an earlier run and fail on
+*                     any benchmark whose median time per item got slower
+*   --tolerance pct   slowdown allowed by --baseline (default 10)
+*
+* Every benchmark reports the median time of its runs with the median
+* absolute deviation, the 95th percentile and the extremes, which stay put
+* from run to run where a mean and standard deviation chase outliers. The
+* exit status is 1 if a benchmark produced wrong output or regressed.
+*******************************************************************************/
+#if defined(WIN32)
+#include <windows.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "timestamp.h"
+
+using namespace std;
+
+namespace {
+  struct Result
+  {
+    string name;
+    string itemName;
+    double items;
+    double bytes;
+    size_t runs;
+    double minimum, median, mad, p95, maximum, mean; // seconds per run
+  };
+
+  BenchmarkSettings settings = {2, 15};
+  vector<Result> results;
+  vector<string> failures;
+  volatile double sink;
+
+  //Value at or below which fraction q of the sorted values fall
+  double percentile(const vector<double>& sorted, double q)
+  {
+    size_t rank = size_t(ceil(q * double(sorted.size())));
+
+    return sorted[rank > 0 ? rank - 1 : 0];
+  }
+
+  double median(vector<double> values)
+  {
+    sort(values.begin(), values.end());
+    return percentile(values, 0.5);
+  }
+
+  void printResult(const Result& r)
+  {
+    double perItem = r.median / r.items;
+
+    printf("%-28s %10.3f ms +/- %6.2f%%  p95 %10.3f ms  %10.1f ns/%s",
+           r.name.c_str(), r.median * 1.0e3, 100.0 * r.mad / r.median,
+           r.p95 * 1.0e3, perItem * 1.0e9, r.itemName.c_str());
+
+    if(r.bytes > 0)
+      printf("  %8.1f MB/s", r.bytes / r.median / (1024.0 * 1024.0));
+
+    printf("\n");
+  }
+
+  const char* CsvHeader =
+    "name,runs,items,item,bytes,min_s,median_s,mad_s,p95_s,max_s,mean_s,"
+    "ns_per_item,items_per_s,mb_per_s";
+
+  bool writeCsv(const char* path)
+  {
+    FILE* file = fopen(path, "w");
+
+    if(file == NULL)
+      return false;
+
+    fprintf(file, "%s\n", CsvHeader);
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+      const Result& r = results[i];
+
+      fprintf(file, "%s,%u,%.0f,%s,%.0f,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,"
+              "%.6g,%.6g,%.6g\n", r.name.c_str(), unsigned(r.runs), r.items,
+              r.itemName.c_str(), r.bytes, r.minimum, r.median, r.mad, r.p95,
+              r.maximum, r.mean, r.median / r.items * 1.0e9,
+              r.items / r.median, r.bytes / r.median / (1024.0 * 1024.0));
+    }
+
+    return fclose(file) == 0;
+  }
+
+  bool writeJson(const char* path)
+  {
+    FILE* file = fopen(path, "w");
+
+    if(file == NULL)
+      return false;
+
+    fprintf(file, "{\n  \"warmup\": %d,\n  \"repetitions\": %d,\n"
+            "  \"results\": [", settings.warmup, settings.repetitions);
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+      const Result& r = results[i];
+
+      fprintf(file, "%s\n    {\"name\": \"%s\", \"runs\": %u, \"items\": %.0f, "
+              "\"item\": \"%s\", \"bytes\": %.0f,\n     \"min_s\": %.9g, "
+              "\"median_s\": %.9g, \"mad_s\": %.9g, \"p95_s\": %.9g, "
+              "\"max_s\": %.9g, \"mean_s\": %.9g,\n     \"ns_per_item\": %.6g, "
+              "\"items_per_s\": %.6g, \"mb_per_s\": %.6g}",
+              i > 0 ? "," : "", r.name.c_str(), unsigned(r.runs), r.items,
+              r.itemName.c_str(), r.bytes, r.minimum, r.median, r.mad, r.p95,
+              r.maximum, r.mean, r.median / r.items * 1.0e9,
+              r.items / r.median, r.bytes / r.median / (1024.0 * 1024.0));
+    }
+
+    fprintf(file, "\n  ],\n  \"failures\": [");
+
+    for(size_t i = 0; i < failures.size(); i++)
+      fprintf(file, "%s\"%s\"", i > 0 ? ", " : "", failures[i].c_str());
+
+    fprintf(file, "]\n}\n");
+    return fclose(file) == 0;
+  }
+
+  //Compares the median time per item against a CSV written by an earlier
+  //run, so a benchmark may change how much one run does. A benchmark
+  //regressed if it slowed by more than the tolerance and by more than three
+  //times the spread of the two runs. Returns the regressions.
+  int compareBaseline(const char* path, double tolerance)
+  {
+    FILE* file = fopen(path, "r");
+
+    if(file == NULL)
+    {
+      fprintf(stderr, "Can't read baseline %s\n", path);
+      return 1;
+    }
+
+    char line[512];
+    int regressions = 0, compared = 0;
+
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+      // name, items, median and MAD are the first, third, seventh and eighth
+      vector<string> fields;
+      const char* start = line;
+
+      for(const char* p = line; ; p++)
+      {
+        if(*p == ',' || *p == '\n' || *p == '\r' || *p == 0)
+        {
+          fields.push_back(string(start, p));
+          start = p + 1;
+
+          if(*p != ',')
+            break;
+        }
+      }
+
+      double baseItems = fields.size() >= 8 ? atof(fields[2].c_str()) : 0.0;
+
+      if(baseItems <= 0.0)
+        continue;
+
+      double baseMedian = atof(fields[6].c_str()) / baseItems;
+      double baseMad = atof(fields[7].c_str()) / baseItems;
+
+      for(size_t i = 0; i < results.size(); i++)
+      {
+        const Result& r = results[i];
+
+        if(r.name != fields[0])
+          continue;
+
+        double slower = (r.median - baseMedian * r.items) / r.items;
+        bool regressed = slower > tolerance * baseMedian
+                         && slower > 3.0 * (r.mad / r.items + baseMad);
+
+        compared++;
+
+        if(regressed)
+        {
+          printf("REGRESSION %-28s %10.1f ns/%s -> %10.1f ns/%s (%+.1f%%)\n",
+                 r.name.c_str(), baseMedian * 1.0e9, r.itemName.c_str(),
+                 r.median / r.items * 1.0e9, r.itemName.c_str(),
+                 100.0 * slower / baseMedian);
+          regressions++;
+        }
+      }
+    }
+
+    fclose(file);
+    printf("== baseline %s: %d compared, %d regressed\n", path, compared,
+           regressions);
+    return regressions;
+  }
+
+  struct Group
+  {
+    const char* name;
+    void (*run)();
+  };
+
+  const Group groups[] = {
+    {"image", runImageBenchmarks},
+    {"export", runExportBenchmarks},
+    {"servo", runServoBenchmarks},
+    {"forcefield", runForceFieldBenchmarks},
+    {"callback", runCallbackBenchmarks},
+    {"capture", runCaptureBenchmarks},
+    {"texture", runTextureBenchmarks}
+  };
+
+  const int groupCount = sizeof(groups) / sizeof(groups[0]);
+
+  void usage()
+  {
+    fprintf(stderr, "usage: nimblebench [--warmup n] [--repetitions n] "
+            "[--csv file] [--json file]\n"
+            "                   [--baseline file [--tolerance pct]] "
+            "[group ...]\ngroups:");
+
+    for(int g = 0; g < groupCount; g++)
+      fprintf(stderr, " %s", groups[g].name);
+
+    fprintf(stderr, "\n");
+  }
+}
+
+
+const BenchmarkSettings& benchmarkSettings()
+{
+  return settings;
+}
+
+
+void consume(double value)
+{
+  sink = sink + value;
+}
+
+
+void recordResult(const char* name, const vector<double>& seconds,
+                  double items, const char* itemName, double bytes)
+{
+  if(seconds.empty())
+    return;
+
+  Result r;
+  vector<double> sorted(seconds);
+
+  sort(sorted.begin(), sorted.end());
+
+  r.name = name;
+  r.itemName = itemName;
+  r.items = items;
+  r.bytes = bytes;
+  r.runs = sorted.size();
+  r.minimum = sorted.front();
+  r.maximum = sorted.back();
+  r.median = percentile(sorted, 0.5);
+  r.p95 = percentile(sorted, 0.95);
+  r.mean = 0.0;
+
+  vector<double> deviation(sorted.size());
+
+  for(size_t i = 0; i < sorted.size(); i++)
+  {
+    r.mean += sorted[i] / double(sorted.size());
+    deviation[i] = fabs(sorted[i] - r.median);
+  }
+
+  r.mad = median(deviation);
+
+  printResult(r);
+  results.push_back(r);
+}
+
+
+void reportFailure(const char* name, const char* reason)
+{
+  printf("FAILED %-28s %s\n", name, reason);
+  failures.push_back(string(name) + ": " + reason);
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char* csvPath = NULL;
+  const char* jsonPath = NULL;
+  const char* baselinePath = NULL;
+  double tolerance = 0.10;
+  vector<const char*> selected;
+
+  for(int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+
+    if(strcmp(argv[i], "--warmup") == 0 && hasValue)
+      settings.warmup = max(0, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--repetitions") == 0 && hasValue)
+      settings.repetitions = max(1, atoi(argv[++i]));
+    else if(strcmp(argv[i], "--csv") == 0 && hasValue)
+      csvPath = argv[++i];
+    else if(strcmp(argv[i], "--json") == 0 && hasValue)
+      jsonPath = argv[++i];
+    else if(strcmp(argv[i], "--baseline") == 0 && hasValue)
+      baselinePath = argv[++i];
+    else if(strcmp(argv[i], "--tolerance") == 0 && hasValue)
+      tolerance = atof(argv[++i]) / 100.0;
+    else if(argv[i][0] == '-')
+    {
+      usage();
+      return 2;
+    }
+    else
+      selected.push_back(argv[i]);
+  }
+
+  for(size_t i = 0; i < selected.size(); i++)
+  {
+    int g = 0;
+
+    while(g < groupCount && strcmp(selected[i], groups[g].name) != 0)
+      g++;
+
+    if(g == groupCount)
+    {
+      usage();
+      return 2;
+    }
+  }
+
+  // The servo probes in the callback benchmarks read timestampNow().
+  calibrateTimestamps();
+
+#if defined(WIN32)
+  // Keep background work from landing in the middle of a timed run.
+  SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
+#endif
+
+  for(int g = 0; g < groupCount; g++)
+  {
+    bool run = selected.empty();
+
+    for(size_t i = 0; i < selected.size(); i++)
+      if(strcmp(selected[i], groups[g].name) == 0)
+        run = true;
+
+    if(run)
+    {
+      printf("== %s\n", groups[g].name);
+      fflush(stdout);
+      groups[g].run();
+    }
+  }
+
+  int status = failures.empty() ? 0 : 1;
+
+  if(csvPath != NULL && !writeCsv(csvPath))
+  {
+    fprintf(stderr, "Can't write %s\n", csvPath);
+    status = 1;
+  }
+
+  if(jsonPath != NULL && !writeJson(jsonPath))
+  {
+    fprintf(stderr, "Can't write %s\n", jsonPath);
+    status = 1;
+  }
+
+  if(baselinePath != NULL && compareBaseline(baselinePath, tolerance) > 0)
+    status = 1;
+
+  return status;
+}
@@ -0,0 +1,400 @@
+/*******************************************************************************
+* Long-session soak test. Records a session from a simulated device through
+* the same capture path as the application, in accelerated time, and checks
+* it stays within its ceilings.
+*
+*   nimblesoak [options]
+*
+* Options:
+*   --minutes n          simulated session length (default 60)
+*   --speed x            simulated seconds per second (default 60)
+*   --rate hz            servo rate (default 1000)
+*   --model file         network for the skill monitor; without one it only
+*                        runs the kinematic features
+*   --output file        session file (default soak_session.txt), removed
+*                        afterwards unless --keep is given
+*   --json file          also write the report as JSON
+*   --max-rss-mb n       resident memory growth allowed (default 32)
+*   --max-export-ms n    time allowed to finish the files at the end of the
+*                        session (default 1000)
+*   --max-overrun-pct n  servo ticks allowed to start a real servo period
+*                        (1 ms at 1000 Hz) late (default 0.1)
+*
+* The servo thread samples the device into a capture fan-out feeding the
+* session recorder and the skill monitor, as in the application. Resident
+* memory is sampled throughout. When the session ends the recorder is
+* stopped and timed, and both files are read back and checked against the
+* samples captured. Dropped samples always fail. The exit status is 1 if
+* any ceiling was exceeded.
+*******************************************************************************/
+#if defined(WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "capturefanout.h"
+#include "constants.h"
+#include "recorder.h"
+#include "servoprofiler.h"
+#include "simdevice.h"
+#include "skillmonitor.h"
+#include "timestamp.h"
+#include "trajectoryfile.h"
+#include "trajectorytext.h"
+
+using namespace std;
+
+namespace {
+  //How often the main thread samples memory and progress (wall clock)
+  const int PollMillis = 100;
+
+  //Simulated time between progress lines (s)
+  const double ProgressSeconds = 600.0;
+
+  struct SoakSettings
+  {
+    double minutes;
+    double speed;
+    double rate;
+    const char* modelPath;
+    string outputPath;
+    const char* jsonPath;
+    bool keep;
+    double maxRssMb;
+    double maxExportMs;
+    double maxOverrunPct;
+  };
+
+  //Servo-thread state of the capture callback
+  struct SoakCapture
+  {
+    SimulatedDevice* device;
+    CaptureFanout* fanout;
+    ServoProbe* probe;
+    unsigned long long limit;
+    unsigned long long pushed;
+  };
+
+  //DeviceStateCallback, stamped with simulated time so the session file
+  //reads as if it had been recorded at the servo rate. Unschedules itself
+  //once the session is long enough.
+  bool captureTick(void *userData)
+  {
+    SoakCapture *capture = static_cast<SoakCapture *>(userData);
+
+    if(capture->pushed >= capture->limit)
+      return false;
+
+    ServoTimer timer(*capture->probe);
+    DeviceState state;
+
+    state.time = (long long)(capture->device->simulatedTime() * 1.0e9);
+    capture->device->getPosition(state.position);
+    capture->fanout->push(state);
+    capture->pushed++;
+
+    return true;
+  }
+
+  //Resident set size of this process in bytes, 0 where it can't be read
+  size_t residentBytes()
+  {
+#if defined(WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+      return counters.WorkingSetSize;
+
+    return 0;
+#elif defined(__linux__)
+    FILE* statm = fopen("/proc/self/statm", "r");
+    unsigned long pages = 0, resident = 0;
+
+    if(statm == NULL)
+      return 0;
+
+    if(fscanf(statm, "%lu %lu", &pages, &resident) != 2)
+      resident = 0;
+
+    fclose(statm);
+    return size_t(resident) * size_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+  }
+
+  double megabytes(size_t bytes)
+  {
+    return double(bytes) / (1024.0 * 1024.0);
+  }
+
+  //Rows in a YAML session file
+  size_t countTextSamples(const char* path)
+  {
+    TrajectoryTextReader reader;
+    vector<TrajectorySample> buffer(4096);
+    size_t total = 0, count;
+
+    if(!reader.open(path))
+      return 0;
+
+    while((count = reader.read(&buffer[0], buffer.size())) > 0)
+      total += count;
+
+    return total;
+  }
+
+  struct Check
+  {
+    const char* name;
+    double value;
+    double ceiling;
+    const char* unit;
+  };
+
+  int usage()
+  {
+    fprintf(stderr, "usage: nimblesoak [--minutes n] [--speed x] [--rate hz] "
+            "[--model file]\n"
+            "                  [--output file] [--keep] [--json file]\n"
+            "                  [--max-rss-mb n] [--max-export-ms n] "
+            "[--max-overrun-pct n]\n");
+    return 2;
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  SoakSettings settings;
+
+  settings.minutes = 60.0;
+  settings.speed = 60.0;
+  settings.rate = 1000.0;
+  settings.modelPath = NULL;
+  settings.outputPath = "soak_session.txt";
+  settings.jsonPath = NULL;
+  settings.keep = false;
+  settings.maxRssMb = 32.0;
+  settings.maxExportMs = 1000.0;
+  settings.maxOverrunPct = 0.1;
+
+  for(int i = 1; i < argc; i++)
+  {
+    bool hasValue = i + 1 < argc;
+
+    if(strcmp(argv[i], "--minutes") == 0 && hasValue)
+      settings.minutes = atof(argv[++i]);
+    else if(strcmp(argv[i], "--speed") == 0 && hasValue)
+      settings.speed = atof(argv[++i]);
+    else if(strcmp(argv[i], "--rate") == 0 && hasValue)
+      settings.rate = atof(argv[++i]);
+    else if(strcmp(argv[i], "--model") == 0 && hasValue)
+      settings.modelPath = argv[++i];
+    else if(strcmp(argv[i], "--output") == 0 && hasValue)
+      settings.outputPath = argv[++i];
+    else if(strcmp(argv[i], "--json") == 0 && hasValue)
+      settings.jsonPath = argv[++i];
+    else if(strcmp(argv[i], "--keep") == 0)
+      settings.keep = true;
+    else if(strcmp(argv[i], "--max-rss-mb") == 0 && hasValue)
+      settings.maxRssMb = atof(argv[++i]);
+    else if(strcmp(argv[i], "--max-export-ms") == 0 && hasValue)
+      settings.maxExportMs = atof(argv[++i]);
+    else if(strcmp(argv[i], "--max-overrun-pct") == 0 && hasValue)
+      settings.maxOverrunPct = atof(argv[++i]);
+    else
+      return usage();
+  }
+
+  if(!(settings.minutes > 0.0) || !(settings.speed > 0.0))
+    return usage();
+
+  calibrateTimestamps();
+
+  SimulatedDeviceConfig config;
+  config.updateRate = settings.rate;
+  config.timeScale = settings.speed;
+
+  SimulatedDevice device(config);
+  double rate = device.getNominalUpdateRate();
+  size_t startRss = residentBytes();
+
+  // The application's consumers with the application's ring sizes.
+  CaptureFanout fanout;
+  SessionRecorder recorder;
+  SkillMonitor skillMonitor;
+  ServoProbe probe("DeviceStateCallback", 0.1);
+  SessionInfo info;
+  string modelError;
+
+  info.patientId = "soak";
+  info.patternType = "complexity";
+  info.patternLevel = 1;
+
+  if(settings.modelPath != NULL
+     && !skillMonitor.loadModel(settings.modelPath, modelError))
+  {
+    fprintf(stderr, "Can't load %s: %s\n", settings.modelPath,
+            modelError.c_str());
+    return 2;
+  }
+
+  if(!recorder.start(settings.outputPath, info,
+                     size_t(rate) * Constant::RecordBufferSeconds))
+  {
+    fprintf(stderr, "Can't create %s\n", settings.outputPath.c_str());
+    return 2;
+  }
+
+  skillMonitor.start(size_t(rate) * Constant::TraceBufferSeconds);
+  fanout.attach(&recorder.samples());
+  fanout.attach(&skillMonitor.samples());
+  probe.setUpdateRate(rate * settings.speed);
+
+  SoakCapture capture = {&device, &fanout, &probe, 0, 0};
+  capture.limit = (unsigned long long)(settings.minutes * 60.0 * rate);
+
+  printf("soak: %.0f min at %.0f Hz, %.0fx speed, into %s\n", settings.minutes,
+         rate, settings.speed, settings.outputPath.c_str());
+
+  // Run the session, sampling memory as it goes.
+  size_t peakRss = startRss;
+  double nextProgress = ProgressSeconds;
+  Stopwatch wall;
+
+  device.init();
+  device.schedule(captureTick, &capture, ServoPriorityMax);
+  device.startScheduler();
+
+  for(;;)
+  {
+    this_thread::sleep_for(chrono::milliseconds(PollMillis));
+
+    size_t rss = residentBytes();
+    peakRss = max(peakRss, rss);
+
+    double simulated = double(device.tickCount()) / rate;
+
+    if(simulated >= nextProgress)
+    {
+      printf("  %5.0f min  rss %7.1f MB  overruns %llu\n", simulated / 60.0,
+             megabytes(rss), device.overrunCount());
+      fflush(stdout);
+      nextProgress += ProgressSeconds;
+    }
+
+    if(device.tickCount() >= capture.limit)
+      break;
+  }
+
+  device.stopScheduler();
+  double wallSeconds = wall.seconds();
+
+  // What a clinician waits for after pressing stop.
+  fanout.detach(&recorder.samples());
+  fanout.detach(&skillMonitor.samples());
+
+  Stopwatch exportWatch;
+  recorder.stop();
+  double exportMs = exportWatch.seconds() * 1.0e3;
+
+  skillMonitor.stop();
+  peakRss = max(peakRss, residentBytes());
+
+  // Both files must hold every captured sample.
+  size_t dropped = recorder.samples().droppedCount();
+  size_t expected = size_t(capture.pushed) - dropped;
+  TrajectoryReader binary;
+  size_t binarySamples = binary.open(binarySessionPath(settings.outputPath).c_str())
+                         ? binary.size() : 0;
+  binary.close();
+  size_t textSamples = countTextSamples(settings.outputPath.c_str());
+
+  double ticks = double(device.tickCount());
+  double overrunPct = ticks > 0 ? 100.0 * double(device.overrunCount()) / ticks
+                                : 0.0;
+  double growthMb = megabytes(peakRss > startRss ? peakRss - startRss : 0);
+
+  const Check checks[] = {
+    {"rss_growth_mb", growthMb, settings.maxRssMb, "MB"},
+    {"export_ms", exportMs, settings.maxExportMs, "ms"},
+    {"overrun_pct", overrunPct, settings.maxOverrunPct, "%"},
+    {"dropped_samples", double(dropped), 0.0, "samples"},
+    {"missing_binary_samples", double(expected - min(expected, binarySamples)),
+     0.0, "samples"},
+    {"missing_text_samples", double(expected - min(expected, textSamples)),
+     0.0, "samples"}
+  };
+  const int checkCount = sizeof(checks) / sizeof(checks[0]);
+  int failed = 0;
+
+  printf("captured  %llu samples (%.1f min simulated) in %.1f s\n",
+         capture.pushed, double(capture.pushed) / rate / 60.0, wallSeconds);
+  printf("memory    %.1f MB at start, %.1f MB peak\n", megabytes(startRss),
+         megabytes(peakRss));
+  printf("callback  p99 %lld ns, max %lld ns\n",
+         probe.durations().percentile(0.99), probe.durations().max());
+
+  for(int c = 0; c < checkCount; c++)
+  {
+    bool ok = checks[c].value <= checks[c].ceiling;
+
+    printf("%-4s %-24s %12.3f %-8s (ceiling %g)\n", ok ? "ok" : "FAIL",
+           checks[c].name, checks[c].value, checks[c].unit, checks[c].ceiling);
+
+    if(!ok)
+      failed++;
+  }
+
+  if(settings.jsonPath != NULL)
+  {
+    FILE* json = fopen(settings.jsonPath, "w");
+
+    if(json != NULL)
+    {
+      fprintf(json, "{\n  \"minutes\": %g,\n  \"speed\": %g,\n  \"rate\": %g,\n"
+              "  \"samples\": %llu,\n  \"wall_s\": %.3f,\n"
+              "  \"start_rss_mb\": %.3f,\n  \"peak_rss_mb\": %.3f,\n"
+              "  \"callback_p99_ns\": %lld,\n  \"checks\": [",
+              settings.minutes, settings.speed, rate, capture.pushed,
+              wallSeconds, megabytes(startRss), megabytes(peakRss),
+              probe.durations().percentile(0.99));
+
+      for(int c = 0; c < checkCount; c++)
+        fprintf(json, "%s\n    {\"name\": \"%s\", \"value\": %.6g, "
+                "\"ceiling\": %g, \"ok\": %s}", c > 0 ? "," : "",
+                checks[c].name, checks[c].value, checks[c].ceiling,
+                checks[c].value <= checks[c].ceiling ? "true" : "false");
+
+      fprintf(json, "\n  ]\n}\n");
+      fclose(json);
+    }
+    else
+    {
+      fprintf(stderr, "Can't write %s\n", settings.jsonPath);
+      failed++;
+    }
+  }
+
+  if(!settings.keep)
+  {
+    remove(settings.outputPath.c_str());
+    remove(binarySessionPath(settings.outputPath).c_str());
+  }
+
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ Servo loop timing of the simulated device at the supported rates, so the
+ servo-side benchmarks can be read against what the loop itself achieves.
+*******************************************************************************/
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "simdevice.h"
+
+using namespace std;
+
+namespace {
+  //Collects inter-tick intervals from inside the servo loop, into room
+  //reserved up front so the loop never allocates
+  struct TickStats
+  {
+    chrono::steady_clock::time_point last;
+    bool started;
+    vector<double> intervals;
+  };
+
+  bool recordTick(void *userData)
+  {
+    TickStats *stats = static_cast<TickStats *>(userData);
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    if(stats->started && stats->intervals.size() < stats->intervals.capacity())
+      stats->intervals.push_back(chrono::duration<double>(now - stats->last).count());
+
+    stats->last = now;
+    stats->started = true;
+    return true;
+  }
+}
+
+
+void runServoBenchmarks()
+{
+  const double rates[] = {1000.0, 4000.0, 10000.0};
+
+  for(int r = 0; r < 3; r++)
+  {
+    SimulatedDeviceConfig config;
+    config.updateRate = rates[r];
+
+    SimulatedDevice simulated(config);
+    TickStats stats;
+
+    stats.started = false;
+    stats.intervals.reserve(size_t(rates[r] * 2.0));
+
+    simulated.init();
+    simulated.schedule(recordTick, &stats, ServoPriorityMax);
+    simulated.startScheduler();
+    this_thread::sleep_for(chrono::seconds(1));
+    simulated.stopScheduler();
+
+    // Each interval is one sample: the median should sit on the period and
+    // the p95 and maximum show how late ticks run.
+    char name[64];
+
+    sprintf(name, "servo/sim-%.0fHz", rates[r]);
+    recordResult(name, stats.intervals, 1.0, "tick", 0);
+    printf("%-28s %10llu overruns\n", "", simulated.overrunCount());
+  }
+}
@@ -0,0 +1,102 @@
+/*******************************************************************************
+ Pattern texture upload: loadTexture with the full mip chain, uncompressed
+ and, where the driver samples S3TC, as DXT1. Needs a GL context, so it is
+ only built with NIMBLE_BENCH_GL; the context belongs to a hidden GLUT
+ window and nothing is drawn.
+*******************************************************************************/
+#include <cstdio>
+
+#include "benchmark.h"
+
+#if defined(NIMBLE_BENCH_GL)
+
+#include <algorithm>
+
+#include "glfunctions.h"
+#include "renderer.h"
+#include "texturebuilder.h"
+
+using namespace std;
+
+namespace {
+  //A 4:3 pattern, as the bitmaps are
+  const int PatternWidth = 1024;
+  const int PatternHeight = 768;
+
+  size_t textureBytes(const TextureImage& texture)
+  {
+    size_t bytes = 0;
+
+    for(size_t i = 0; i < texture.levels.size(); i++)
+      bytes += texture.levels[i].data.size();
+
+    return bytes;
+  }
+
+  //Uploads and frees texture once per run. glFinish makes the driver's
+  //copy part of the run instead of the next one's.
+  void measureUpload(const char* name, const TextureImage& texture)
+  {
+    GLuint id = loadTexture(texture);
+
+    glFinish();
+    glDeleteTextures(1, &id);
+
+    if(glGetError() != GL_NO_ERROR)
+    {
+      reportFailure(name, "OpenGL error on upload");
+      return;
+    }
+
+    measure(name, double(PatternWidth) * PatternHeight, "pixel",
+            double(textureBytes(texture)), [&] {
+      GLuint uploaded = loadTexture(texture);
+
+      glFinish();
+      glDeleteTextures(1, &uploaded);
+    });
+  }
+}
+
+
+void runTextureBenchmarks()
+{
+  int argc = 1;
+  char program[] = "nimblebench";
+  char* argv[] = {program, NULL};
+
+  glutInit(&argc, argv);
+  glutInitDisplayMode(GLUT_RGB);
+  glutInitWindowSize(64, 64);
+  glutCreateWindow("nimblebench");
+  glutHideWindow();
+  loadGLFunctions();
+
+  const size_t bytes = size_t(PatternWidth) * PatternHeight * 3;
+  Image image(new char[bytes], PatternWidth, PatternHeight);
+
+  for(size_t i = 0; i < bytes; i++)
+    image.pixels[i] = char((i / 3) % 251 < 8 ? 0 : 255);
+
+  TextureImage texture;
+
+  buildMipChain(image, texture);
+  measureUpload("texture/upload-rgb8", texture);
+
+  if(GLExt::textureCompressionS3tc && GLExt::compressedTexImage2D != NULL)
+  {
+    compressDxt1(texture);
+    measureUpload("texture/upload-dxt1", texture);
+  }
+  else
+    printf("%-28s no S3TC support\n", "texture/upload-dxt1");
+}
+
+#else
+
+void runTextureBenchmarks()
+{
+  printf("%-28s skipped, built without NIMBLE_BENCH_GL\n", "texture");
+}
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef AFFINE_H_INCLUDED
+#define AFFINE_H_INCLUDED
+
+//Inverts an affine transform given as a column-major 4x4 matrix, as GL and
+//HL store them. Returns false, leaving out alone, if it is singular.
+bool invertAffine(const double m[16], double out[16]);
+
+#endif
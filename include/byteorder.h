@@ -0,0 +1,41 @@
+#ifndef BYTE_ORDER_H_INCLUDED
+#define BYTE_ORDER_H_INCLUDED
+
+//Little-endian encoding of fixed-size fields in the binary file formats
+
+inline void putU16(unsigned char* p, unsigned short v)
+{
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+}
+
+inline void putU32(unsigned char* p, unsigned int v)
+{
+  for(int i = 0; i < 4; i++)
+    p[i] = (unsigned char)(v >> (8 * i));
+}
+
+inline void putU64(unsigned char* p, unsigned long long v)
+{
+  for(int i = 0; i < 8; i++)
+    p[i] = (unsigned char)(v >> (8 * i));
+}
+
+inline unsigned short getU16(const unsigned char* p)
+{
+  return (unsigned short)(p[0] | (p[1] << 8));
+}
+
+inline unsigned int getU32(const unsigned char* p)
+{
+  return (unsigned int)p[0] | ((unsigned int)p[1] << 8) |
+         ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+inline unsigned long long getU64(const unsigned char* p)
+{
+  return (unsigned long long)getU32(p) |
+         ((unsigned long long)getU32(p + 4) << 32);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef CAPTURE_FANOUT_H_INCLUDED
+#define CAPTURE_FANOUT_H_INCLUDED
+
+#include <atomic>
+#include <thread>
+
+#include "devicestate.h"
+#include "ringbuffer.h"
+
+/*******************************************************************************
+ Hands each servo sample to every attached consumer ring.
+
+ The servo thread calls push() once per tick; consumers attach and detach
+ their rings from other threads while it runs. push() neither locks nor
+ allocates. detach() waits out a push in progress, so once it returns the
+ servo thread no longer touches the ring and its owner may reset or free it.
+*******************************************************************************/
+class CaptureFanout {
+  public:
+    enum { MaxRings = 4 };
+
+    CaptureFanout() : pushing(false)
+    {
+      for(int i = 0; i < MaxRings; i++)
+        rings[i].store(NULL);
+    }
+
+    //Returns false when every slot is taken.
+    bool attach(RingBuffer<DeviceState>* ring)
+    {
+      for(int i = 0; i < MaxRings; i++)
+      {
+        RingBuffer<DeviceState>* empty = NULL;
+
+        if(rings[i].compare_exchange_strong(empty, ring))
+          return true;
+      }
+
+      return false;
+    }
+
+    void detach(RingBuffer<DeviceState>* ring)
+    {
+      for(int i = 0; i < MaxRings; i++)
+      {
+        RingBuffer<DeviceState>* expected = ring;
+        rings[i].compare_exchange_strong(expected, NULL);
+      }
+
+      while(pushing.load())
+        std::this_thread::yield();
+    }
+
+    //Servo thread: a full ring counts the drop and the others still get it.
+    void push(const DeviceState& state)
+    {
+      pushing.store(true);
+
+      for(int i = 0; i < MaxRings; i++)
+      {
+        RingBuffer<DeviceState>* ring = rings[i].load();
+
+        if(ring != NULL)
+          ring->push(state);
+      }
+
+      pushing.store(false, std::memory_order_release);
+    }
+
+  private:
+    CaptureFanout(const CaptureFanout&);
+    void operator=(const CaptureFanout&);
+
+    std::atomic<RingBuffer<DeviceState>*> rings[MaxRings];
+    std::atomic<bool> pushing;
+};
+
+#endif
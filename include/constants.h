@@ -1,3 +1,6 @@
+#ifndef CONSTANTS_H_INCLUDED
+#define CONSTANTS_H_INCLUDED
+
 namespace Constant{
 	//static const int Pattern_NoSelect= 0;
 	static const int Pattern_Maze= 1;
@@ -8,5 +11,23 @@ namespace Constant{
 	static const int BasePoint1= 99999991;
 	static const int BasePoint2= 99999992;
 	static const int Time= 99999999;
+	static const int RecordBufferSeconds= 4; // samples that may wait for the recorder
+	static const int TraceBufferSeconds= 1; // samples that may wait for the trace overlay
+	static const double TraceTolerance= 0.1; // mm a simplified trace may stray from the path
+	static const int StrokeThreshold= 128; // pattern pixels darker than this are stroke
+	static const double GuidanceMaxForce= 0.8; // N, the Omni's continuous force
+	static const double AnchorRadius= 10.0; // mm from a ratio point at which it starts to pull
+	static const double AnchorStiffness= 0.05; // N/mm
+	static const double ScoreReach= 1.5; // mm from the centreline that counts as tracing it
+	static const double FeatureRate= 100.0; // Hz, frames of kinematic features
+	static const int TremorWindow= 64; // feature frames per tremor estimate
+	static const double TremorBandLow= 4.0; // Hz, physiological tremor band
+	static const double TremorBandHigh= 12.0; // Hz
+	static const double EffectRampSeconds= 0.005; // effect settings ease to new values over this
+	static const int EffectSubsteps= 4; // fixed integration steps per servo tick
+	static const double GraphicsRate= 60.0; // Hz, frames drawn unless --fps says otherwise
+	static const double HapticFrameRate= 100.0; // Hz, HL frames updating the shapes and proxy
 	static const char InfoEnd[]= "###";
-}
\ No newline at end of file
+}
+
+#endif
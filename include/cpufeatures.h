@@ -0,0 +1,24 @@
+#ifndef CPU_FEATURES_H_INCLUDED
+#define CPU_FEATURES_H_INCLUDED
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define NIMBLE_X86
+#endif
+
+//Marks a function that may use instructions beyond the build baseline.
+//Only call it after checking the matching cpuHas...() flag.
+#if defined(NIMBLE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define NIMBLE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define NIMBLE_TARGET(isa)
+#endif
+
+//Instruction set extensions of the CPU we are running on. All false on
+//non-x86 builds.
+bool cpuHasSse2();
+bool cpuHasSsse3();
+
+//True when the TSC ticks at a constant rate across P- and C-states
+bool cpuHasInvariantTsc();
+
+#endif
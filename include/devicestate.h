@@ -0,0 +1,13 @@
+#ifndef DEVICE_STATE_H_INCLUDED
+#define DEVICE_STATE_H_INCLUDED
+
+/*******************************************************************************
+ ANN: Spatio-temporal device state for artificial neural network analysis
+*******************************************************************************/
+struct DeviceState
+{
+  double position[3];
+  long long time; // timestampNow(), ns
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef DISTANCE_FIELD_H_INCLUDED
+#define DISTANCE_FIELD_H_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "imageloader.h"
+
+//Marks the pixels darker than threshold (0-255) as stroke and returns how
+//many there are
+size_t strokeMask(const Image& image, int threshold, std::vector<char>& stroke);
+
+//Exact squared Euclidean distance from every pixel to the nearest one set
+//in feature (width by height, rows from the bottom), 1e20 where there is
+//none. If nearest isn't NULL it gets the index of that pixel, or -1. Linear
+//in the pixel count; rows and columns are split over threads.
+void distanceTransform(const std::vector<char>& feature, int width, int height,
+                       unsigned int threads, std::vector<float>& distance2,
+                       std::vector<int>* nearest);
+
+//Distance from every pixel to the edge of the stroke, negative inside it
+void signedDistance(const std::vector<char>& stroke, int width, int height,
+                    unsigned int threads, std::vector<float>& distance);
+
+//Millimetres per pixel of a workspace-to-pixel transform, as a geometric
+//mean of its two axes
+double pixelSpacing(const double toPixel[2][4]);
+
+/*******************************************************************************
+ Signed distance from every pixel of a pattern to its stroke, with the
+ gradient of that distance, so the servo loop can find the way back to the
+ stroke with one bilinear lookup instead of a search.
+
+ Dark pixels are the stroke. Distances are exact Euclidean ones in pixels,
+ positive outside the stroke and negative inside, measured to the pixel
+ edge. The transform is Felzenszwalb and Huttenlocher's, linear in the
+ pixel count, with rows and columns split over threads.
+*******************************************************************************/
+class DistanceField {
+  public:
+    DistanceField();
+
+    //Builds the field of an image whose pixels darker than threshold
+    //(0-255) form the stroke. Returns false if there is no stroke or
+    //nothing but stroke.
+    bool build(const Image& image, int threshold, unsigned int threads);
+
+    //The same from a stroke mask of width by height pixels
+    bool build(const std::vector<char>& stroke, int width, int height,
+               unsigned int threads);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    //Bilinear lookup at pixel coordinates, pixel centres on the integers,
+    //clamped to the image. Distance is in pixels, the gradient per pixel.
+    void sample(double x, double y, double& distance, double gradient[2]) const;
+
+  private:
+    struct Texel
+    {
+      float distance;
+      float gradient[2];
+    };
+
+    int width;
+    int height;
+    std::vector<Texel> texels; // rows from the bottom, as in Image
+};
+
+/*******************************************************************************
+ What the servo loop needs to pull the device toward the pattern's stroke:
+ the field and where the pattern lies in the device workspace. Built on the
+ GL thread whenever either changes and handed over whole.
+*******************************************************************************/
+struct PatternGuidance
+{
+  std::shared_ptr<const DistanceField> field;
+  double toPixel[2][4]; // workspace (mm) to pixel x and y, affine
+  double mmPerPixel;
+
+  PatternGuidance();
+
+  //Maps the workspace onto the field through the workspace-to-world
+  //transform (column-major) and the world rectangle centred on the origin
+  //in z=0 that the pattern is drawn on. Needs field.
+  void setMapping(const double workspaceToWorld[16], double halfWidth,
+                  double halfHeight);
+
+  //Spring force (N) pulling position (mm) toward the nearest stroke,
+  //parallel to the pattern and zero on the stroke, capped at maxForce.
+  //stiffness is in N/mm.
+  void force(const double position[3], double stiffness, double maxForce,
+             double out[3]) const;
+};
+
+#endif
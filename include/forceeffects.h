@@ -0,0 +1,213 @@
+#ifndef FORCE_EFFECTS_H_INCLUDED
+#define FORCE_EFFECTS_H_INCLUDED
+
+#include <cstring>
+
+#include "constants.h"
+#include "distancefield.h"
+#include "forcefield.h"
+#include "servoparams.h"
+
+//What the force effect reads in one servo tick, all in workspace coordinates
+struct EffectInput
+{
+  double proxy[3];  // mm
+  double device[3]; // mm
+  const EffectParameters* params;
+  bool paramsChanged;              // since the last tick
+  const PatternGuidance* guidance; // NULL without a pattern
+  const AttractorField* anchors;   // NULL without ratio points
+};
+
+//The point mass dragged behind the proxy. Only the servo thread touches it.
+struct EffectState
+{
+  double position[3]; // mm
+  double velocity[3]; // mm/s
+  double tickSeconds; // fixed step of the servo loop
+
+  // The point mass's step over a tick, kept while the settings hold still
+  bool mapCurrent;
+  double mapKey[4];   // mass, stiffness, damping and tick it was built for
+  double map[2][2];
+};
+
+//Puts the point mass at rest on the proxy
+void startEffect(EffectState& state, const double proxy[3]);
+
+/*******************************************************************************
+ Force effect policies, composed into one kernel per configuration at
+ compile time.
+
+ A kernel is a body, which is the point mass or nothing, and two fields
+ acting on the device. Each policy has a static addForce() that adds its
+ share of the force (N) on the device, and the compiler inlines them into
+ one straight-line function. A policy that is left out costs nothing.
+*******************************************************************************/
+namespace Effect {
+  //Leaves a field slot empty, and a point mass undamped
+  struct None
+  {
+    static double coefficient(const EffectParameters&) { return 0.0; }
+    static void addForce(EffectState&, const EffectInput&, double[3]) {}
+  };
+
+  //Damps the point mass's velocity, N/(mm/s)
+  struct Damping
+  {
+    static double coefficient(const EffectParameters& params)
+    {
+      return params.damping;
+    }
+  };
+
+  //No mass to drag: it rides on the proxy and pushes back with nothing
+  struct NoInertia
+  {
+    static void addForce(EffectState& state, const EffectInput& in, double[3])
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        state.position[i] = in.proxy[i];
+        state.velocity[i] = 0.0;
+      }
+    }
+  };
+
+  /*****************************************************************************
+   A point mass pulled along by a spring from the proxy, with the device
+   feeling the spring's reaction.
+
+   The tick is split into EffectSubsteps fixed steps. Each is semi-implicit:
+   the spring and damper act on the mass's state at the end of the step,
+   with the proxy held where it is this tick. That is stable at any mass,
+   stiffness and step, down to no mass at all, where the mass simply keeps
+   up with the proxy and no force is left over. Needs stiffness above zero.
+
+   With the proxy held, a step is the same linear map of the mass's
+   velocity and its offset from the proxy on every axis, so the substeps
+   are multiplied into one map and each axis takes one step. The map only
+   depends on the mass, spring, damper and tick, so it is kept in the state
+   and only built again when the settings have moved to new values.
+  *****************************************************************************/
+  template<class Damper>
+  struct Inertia
+  {
+    static void addForce(EffectState& state, const EffectInput& in,
+                         double force[3])
+    {
+      const EffectParameters& params = *in.params;
+      const double k = params.stiffness;
+      const double b = Damper::coefficient(params);
+
+      if(in.paramsChanged || !state.mapCurrent)
+      {
+        const double key[4] = {params.mass, k, b, state.tickSeconds};
+
+        if(!state.mapCurrent || memcmp(key, state.mapKey, sizeof(key)) != 0)
+        {
+          memcpy(state.mapKey, key, sizeof(key));
+          buildMap(key, state.map);
+          state.mapCurrent = true;
+        }
+      }
+
+      const double (&map)[2][2] = state.map;
+
+      for(int i = 0; i < 3; i++)
+      {
+        double e = state.position[i] - in.proxy[i];
+        double v = state.velocity[i];
+        double nextV = map[0][0] * v + map[0][1] * e;
+        double nextE = map[1][0] * v + map[1][1] * e;
+
+        // The device holds the other end of the spring.
+        force[i] += k * nextE + b * nextV;
+        state.position[i] = in.proxy[i] + nextE;
+        state.velocity[i] = nextV;
+      }
+    }
+
+    //The tick's map for key = {mass, stiffness, damping, tick}
+    static void buildMap(const double key[4], double map[2][2])
+    {
+      const double m = key[0], k = key[1], b = key[2];
+      const double h = key[3] / Constant::EffectSubsteps;
+      const double inverse = 1.0 / (m + h * b + h * h * k);
+
+      // One substep: v' = keep v - pull e, e' = e + h v', for offset e
+      const double keep = m * inverse;
+      const double pull = h * k * inverse;
+      const double step[2][2] = {
+        {keep, -pull},
+        {h * keep, 1.0 - h * pull}
+      };
+
+      map[0][0] = step[0][0];
+      map[0][1] = step[0][1];
+      map[1][0] = step[1][0];
+      map[1][1] = step[1][1];
+
+      for(int s = 1; s < Constant::EffectSubsteps; s++)
+      {
+        double v0 = step[0][0] * map[0][0] + step[0][1] * map[1][0];
+        double v1 = step[0][0] * map[0][1] + step[0][1] * map[1][1];
+        double e0 = step[1][0] * map[0][0] + step[1][1] * map[1][0];
+        double e1 = step[1][0] * map[0][1] + step[1][1] * map[1][1];
+
+        map[0][0] = v0;
+        map[0][1] = v1;
+        map[1][0] = e0;
+        map[1][1] = e1;
+      }
+    }
+  };
+
+  //The ratio points' attractors
+  struct GravityWell
+  {
+    static void addForce(EffectState&, const EffectInput& in, double force[3])
+    {
+      double pull[3];
+
+      in.anchors->force(in.device, pull);
+
+      for(int i = 0; i < 3; i++)
+        force[i] += pull[i];
+    }
+  };
+
+  //The pull toward the pattern's stroke
+  struct Guidance
+  {
+    static void addForce(EffectState&, const EffectInput& in, double force[3])
+    {
+      double pull[3];
+
+      in.guidance->force(in.device, in.params->guidanceStiffness,
+                         Constant::GuidanceMaxForce, pull);
+
+      for(int i = 0; i < 3; i++)
+        force[i] += pull[i];
+    }
+  };
+}
+
+//One configuration's force (N) on the device for this tick
+typedef void (*EffectKernel)(EffectState& state, const EffectInput& in,
+                             double force[3]);
+
+template<class Body, class Well, class Pull>
+void effectKernel(EffectState& state, const EffectInput& in, double force[3])
+{
+  force[0] = force[1] = force[2] = 0.0;
+
+  Body::addForce(state, in, force);
+  Well::addForce(state, in, force);
+  Pull::addForce(state, in, force);
+}
+
+//The kernel for this tick's settings and for the fields present in it
+EffectKernel selectEffectKernel(const EffectInput& in);
+
+#endif
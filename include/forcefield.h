@@ -0,0 +1,58 @@
+#ifndef FORCE_FIELD_H_INCLUDED
+#define FORCE_FIELD_H_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+//A point the device is pulled toward once it comes within radius (mm), by
+//a spring of the given stiffness (N/mm)
+struct Attractor
+{
+  double position[3];
+  double radius;
+  double stiffness;
+};
+
+/*******************************************************************************
+ A set of attractors indexed by a uniform grid over the device workspace, so
+ the servo loop only looks at the ones near the device.
+
+ Cells are twice the largest radius across, and each attractor is listed in
+ every cell its sphere reaches, at most eight. A lookup then reads the one
+ cell holding the device: a few contiguous entries, however many attractors
+ there are elsewhere. The cell lists are packed one after another (CSR) so a
+ cell's entries share cache lines. A built field is never changed; swap in
+ a new one to change the set.
+*******************************************************************************/
+class AttractorField {
+  public:
+    AttractorField();
+    explicit AttractorField(const std::vector<Attractor>& attractors);
+
+    size_t size() const { return count; }
+
+    //Sum of the pulls (N) of the attractors reaching position (mm)
+    void force(const double position[3], double out[3]) const;
+
+    //Attractors force() would look at for position, near or not
+    size_t candidates(const double position[3]) const;
+
+  private:
+    struct Entry
+    {
+      float position[3];
+      float radius2;
+      float stiffness;
+    };
+
+    bool cellOf(const double position[3], size_t& cell) const;
+
+    size_t count;
+    double origin[3];
+    double cellSize;
+    int cells[3];
+    std::vector<unsigned int> cellStart; // per cell, plus one past the last
+    std::vector<Entry> entries;          // grouped by cell
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef FRAME_SCHEDULER_H_INCLUDED
+#define FRAME_SCHEDULER_H_INCLUDED
+
+/*******************************************************************************
+ Paces the GUI thread's two loops: graphics frames at the display rate and
+ HLAPI haptic frames, which hand the servo loop new shapes and bring back
+ the proxy, at a rate of their own.
+
+ wait() sleeps until one of them falls due and says which. Each keeps a
+ fixed cadence: its next deadline is a period after the last one, not after
+ the work, and a loop that falls more than a period behind skips ahead
+ rather than rushing to catch up. Sleeping is std::this_thread::sleep_for cut
+ short by how late the OS usually wakes the thread, with the last stretch
+ yielded away, so frames land close to their deadlines without
+ spinning on a core.
+
+ A graphics frame is only due once the last one has been drawn, which
+ frameDrawn() reports after the buffer swap. A minimised or hidden window
+ that never redraws leaves the haptic frames running and nothing else.
+
+ With a graphics rate of 0 the graphics loop follows vsync instead: a frame
+ is due as soon as the last one is drawn and the blocking buffer swap does
+ the waiting, so haptic frames run at most once a refresh. While a frame is
+ waiting to be drawn, the loop sleeps until the next haptic frame or a
+ refresh later, whichever comes first.
+*******************************************************************************/
+class FrameScheduler {
+  public:
+    enum { Haptics = 1, Graphics = 2 };
+
+    FrameScheduler();
+    ~FrameScheduler();
+
+    //Rates in frames per second
+    void start(double graphicsRate, double hapticRate);
+
+    //Sleeps until a frame falls due; returns which are, Haptics | Graphics
+    int wait();
+
+    //The graphics frame wait() last asked for has been drawn and swapped
+    void frameDrawn();
+
+  private:
+    FrameScheduler(const FrameScheduler&);
+    void operator=(const FrameScheduler&);
+
+    void sleepUntil(long long deadline);
+
+    bool started;
+    long long graphicsPeriod; // ns; 0 to follow vsync
+    long long hapticPeriod;   // ns
+    long long nextGraphics;   // timestampNow() deadlines
+    long long nextHaptics;
+    bool framePending;        // Graphics returned, frameDrawn() not yet called
+    long long oversleep;      // ns sleep_for usually wakes past its time
+};
+
+#endif
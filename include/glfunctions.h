@@ -0,0 +1,77 @@
+#ifndef GL_FUNCTIONS_H_INCLUDED
+#define GL_FUNCTIONS_H_INCLUDED
+
+#if defined(WIN32)
+#include <windows.h>
+#endif
+
+#if defined(WIN32) || defined(linux)
+#include <GL/glut.h>
+#elif defined(__APPLE__)
+#include <GLUT/glut.h>
+#endif
+
+#include <cstddef>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+//Tokens newer than the OpenGL 1.1 headers Windows ships with
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+
+/*******************************************************************************
+ Entry points past OpenGL 1.1, looked up at runtime because opengl32.dll
+ doesn't export them. Call loadGLFunctions() once a context is current;
+ a pointer stays NULL when the driver lacks the function.
+*******************************************************************************/
+namespace GLExt {
+  typedef void (APIENTRY *CompressedTexImage2DProc)(GLenum target, GLint level,
+                 GLenum internalFormat, GLsizei width, GLsizei height,
+                 GLint border, GLsizei imageSize, const GLvoid* data);
+
+  typedef void (APIENTRY *GenBuffersProc)(GLsizei n, GLuint* buffers);
+  typedef void (APIENTRY *DeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+  typedef void (APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+  typedef void (APIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size,
+                 const GLvoid* data, GLenum usage);
+  typedef void (APIENTRY *BufferSubDataProc)(GLenum target, ptrdiff_t offset,
+                 ptrdiff_t size, const GLvoid* data);
+
+  extern CompressedTexImage2DProc compressedTexImage2D;
+
+  extern GenBuffersProc genBuffers;
+  extern DeleteBuffersProc deleteBuffers;
+  extern BindBufferProc bindBuffer;
+  extern BufferDataProc bufferData;
+  extern BufferSubDataProc bufferSubData;
+
+  //Vertex buffer objects (GL 1.5 or ARB_vertex_buffer_object) are available
+  extern bool vertexBufferObjects;
+
+  //GL_EXT_texture_compression_s3tc is available
+  extern bool textureCompressionS3tc;
+}
+
+void loadGLFunctions();
+
+//True when the current context lists the extension
+bool hasGLExtension(const char* name);
+
+//Buffer swaps wait for this many vertical refreshes, 0 for none. Returns
+//false if the driver offers no control over it.
+bool setSwapInterval(int interval);
+
+#endif
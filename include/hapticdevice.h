@@ -0,0 +1,55 @@
+#ifndef HAPTIC_DEVICE_H_INCLUDED
+#define HAPTIC_DEVICE_H_INCLUDED
+
+//Servo thread callback. Return true to stay scheduled, false to be removed.
+typedef bool (*ServoCallback)(void *userData);
+
+//Identifies a scheduled callback; 0 is never a valid handle.
+typedef unsigned int ServoHandle;
+
+//Callback priorities, highest runs first within a tick
+static const unsigned short ServoPriorityMin = 0;
+static const unsigned short ServoPriorityDefault = 0x7fff;
+static const unsigned short ServoPriorityMax = 0xffff;
+
+/*******************************************************************************
+ The servo-side view of a haptic device.
+
+ Everything the servo and recording paths need goes through this interface,
+ so they can run against a PHANToM through HDAPI or against a simulated
+ device on machines without one. getPosition(), getUpdateRate() and
+ setForce() are only meaningful from inside a scheduled callback.
+*******************************************************************************/
+class HapticDevice {
+  public:
+    virtual ~HapticDevice() {}
+
+    //Opens the device and enables force output. Returns false on failure.
+    virtual bool init() = 0;
+    virtual void shutdown() = 0;
+
+    //Position of the end effector in workspace coordinates (mm)
+    virtual void getPosition(double position[3]) = 0;
+
+    //Force (N) to send to the device at the end of this tick
+    virtual void setForce(const double force[3]) = 0;
+
+    //Measured rate of the current tick, and the rate the loop aims for (Hz)
+    virtual double getUpdateRate() = 0;
+    virtual double getNominalUpdateRate() = 0;
+
+    //Stiffness the device can render stably (N/mm)
+    virtual double getMaxStiffness() = 0;
+
+    virtual ServoHandle schedule(ServoCallback callback, void *userData,
+                                 unsigned short priority) = 0;
+    virtual void unschedule(ServoHandle handle) = 0;
+
+    virtual void startScheduler() = 0;
+    virtual void stopScheduler() = 0;
+};
+
+//A device driven by OpenHaptics HDAPI (hddevice.cpp)
+HapticDevice* createHDDevice();
+
+#endif
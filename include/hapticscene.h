@@ -0,0 +1,71 @@
+#ifndef HAPTIC_SCENE_H_INCLUDED
+#define HAPTIC_SCENE_H_INCLUDED
+
+#include <vector>
+
+#include <HL/hl.h>
+
+#include "glfunctions.h"
+
+//Surface material of a haptic shape
+struct HapticMaterial
+{
+  float stiffness;
+  float damping;
+  float staticFriction;
+  float dynamicFriction;
+};
+
+/*******************************************************************************
+ The touchable geometry of the scene, kept on the CPU between haptic frames.
+
+ Each shape is a feedback-buffer shape fed from its own vertex array, so
+ defining it costs a few vertices through GL feedback rather than a depth
+ buffer read-back. HLAPI drops a shape that isn't defined in a frame, so
+ render() still submits everything each frame; what it saves is telling HL
+ the surface moved. A shape is dirty after its geometry is set or the scene
+ is invalidated, and only then is it sent with HL_SHAPE_DYNAMIC_SURFACE_CHANGE,
+ for one frame.
+
+ Shapes are drawn in the modelview current when render() is called; call
+ invalidate() whenever that or the workspace mapping changes.
+*******************************************************************************/
+class HapticScene {
+  public:
+    HapticScene();
+
+    //Reserves an HL shape id; needs the HL context to be current
+    int addShape(const HapticMaterial& material);
+
+    //Replaces the geometry of a shape and marks it dirty
+    void setGeometry(int shape, const float* positions, size_t vertexCount,
+                     GLenum mode);
+
+    void setMaterial(int shape, const HapticMaterial& material);
+
+    //Marks every shape dirty, e.g. after the workspace or view changed
+    void invalidate();
+
+    //Defines every shape; call between hlBeginFrame() and hlEndFrame()
+    void render();
+
+    //Frees the shape ids; needs the HL context they were made in
+    void release();
+
+  private:
+    HapticScene(const HapticScene&);
+    void operator=(const HapticScene&);
+
+    struct Shape
+    {
+      HLuint id;
+      HapticMaterial material;
+      std::vector<float> positions; // x, y, z per vertex
+      GLenum mode;
+      bool dirty;
+    };
+
+    std::vector<Shape> shapes;
+};
+
+#endif
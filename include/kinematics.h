@@ -0,0 +1,156 @@
+#ifndef KINEMATICS_H_INCLUDED
+#define KINEMATICS_H_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+#include "devicestate.h"
+#include "ringbuffer.h"
+#include "trajectoryfile.h"
+
+//Feature channels, one array each in KinematicFeatures. Positions are in mm,
+//their derivatives in mm/s, mm/s^2 and mm/s^3, curvature in 1/mm and the
+//tremor band as the RMS velocity (mm/s) it holds.
+enum KinematicChannel {
+  KinematicPositionX, KinematicPositionY, KinematicPositionZ,
+  KinematicVelocityX, KinematicVelocityY, KinematicVelocityZ,
+  KinematicAccelerationX, KinematicAccelerationY, KinematicAccelerationZ,
+  KinematicJerkX, KinematicJerkY, KinematicJerkZ,
+  KinematicSpeed,
+  KinematicCurvature,
+  KinematicTremor,
+  KinematicChannelCount
+};
+
+//Short column names for the channels ("x", "vx", ..., "tremor")
+extern const char* const KinematicChannelNames[KinematicChannelCount];
+
+//Frames of features sampled at a fixed rate, struct-of-arrays
+struct KinematicFeatures
+{
+  KinematicFeatures() : rate(0.0), startTime(0) {}
+
+  size_t size() const { return channel[0].size(); }
+
+  void clear();
+
+  //Drops the oldest frames, keeping the last keep
+  void keepLast(size_t keep);
+
+  double rate;         // frames per second
+  long long startTime; // ns, time of frame 0
+  std::vector<float> channel[KinematicChannelCount];
+};
+
+/*******************************************************************************
+ Turns a stream of device samples into kinematic features.
+
+ Samples are resampled onto a uniform grid of rate frames per second by
+ linear interpolation. Derivatives are central differences over five frames,
+ so a frame's features come out two frames after it arrives; finish() pads
+ the end with the last position to flush them. The tremor channel runs a
+ Hann-windowed Goertzel filter over the last tremorWindow frames of velocity
+ at every DFT bin in the band. The kernels are SSE2 over four frames (or, for
+ the tremor, four bins) at a time, with a scalar fallback.
+
+ Only the last tremorWindow frames are kept, so feeding a whole session and
+ feeding the live stream a few samples at a time use the same memory and
+ give the same features.
+*******************************************************************************/
+class KinematicPipeline {
+  public:
+    KinematicPipeline(double rate, int tremorWindow, double bandLow,
+                      double bandHigh);
+
+    //Forgets everything fed so far
+    void reset();
+
+    //Feeds samples in time order and appends the frames they complete to out
+    void push(const TrajectorySample* samples, size_t count,
+              KinematicFeatures& out);
+    void push(const DeviceState* samples, size_t count, KinematicFeatures& out);
+
+    //Appends the frames still waiting for later samples
+    void finish(KinematicFeatures& out);
+
+    double getRate() const { return rate; }
+
+  private:
+    void add(const double position[3], long long time, KinematicFeatures& out);
+    void addFrame(const float position[3]);
+    void emit(KinematicFeatures& out);
+    void compact();
+
+    double rate;
+    int window;
+
+    // Goertzel coefficients per bin in the band, padded to a multiple of
+    // four, the Hann window, and the scale from bin power to mean square
+    std::vector<float> coefficients;
+    std::vector<float> hann;
+    size_t bandBins;
+    float bandScale;
+    bool sse2;
+
+    // Resampling
+    bool started;
+    long long startTime;
+    long long nextFrame; // index of the next frame to interpolate
+    double previous[3];
+    long long previousTime;
+
+    // Recent frames; features exist for [0, done)
+    std::vector<float> position[3];
+    std::vector<float> velocity[3];
+    size_t done;
+
+    std::vector<float> power; // Goertzel output per bin
+};
+
+//Runs a whole recorded session through a pipeline with the default settings
+void extractKinematics(const TrajectorySample* samples, size_t count,
+                       KinematicFeatures& out);
+
+/*******************************************************************************
+ Features of the live stream. The servo thread feeds samples() through the
+ capture fan-out; update() on the consuming thread drains them into the
+ pipeline and keeps the newest historyFrames frames in features().
+*******************************************************************************/
+class LiveKinematics {
+  public:
+    LiveKinematics();
+
+    //Allocates the sample ring; call before it is attached
+    void init(size_t ringCapacity, size_t historyFrames);
+
+    RingBuffer<DeviceState>& samples() { return ring; }
+
+    //Returns the number of samples drained
+    size_t update();
+
+    //Starts over, as at the beginning of a session
+    void clear();
+
+    const KinematicFeatures& features() const { return history; }
+
+    //Frames computed since the last clear(), including ones dropped from
+    //the history
+    long long frameCount() const { return frames; }
+
+    //timestampNow() of the newest sample drained, or 0 if there is none
+    long long latestSampleTime() const { return latestTime; }
+
+  private:
+    LiveKinematics(const LiveKinematics&);
+    void operator=(const LiveKinematics&);
+
+    RingBuffer<DeviceState> ring;
+    std::vector<DeviceState> batch;
+    KinematicPipeline pipeline;
+    KinematicFeatures history;
+    size_t historyFrames;
+    long long frames;
+    long long latestTime;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_H_INCLUDED
+#define MAPPED_FILE_H_INCLUDED
+
+#include <cstddef>
+
+//A read-only view of a whole file mapped into memory
+class MappedFile {
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    //Maps the file, replacing any previous mapping. Returns false if the
+    //file cannot be opened or mapped.
+    bool open(const char* filename);
+    void close();
+
+    bool isOpen() const { return view != NULL; }
+    const unsigned char* data() const { return view; }
+    size_t size() const { return length; }
+
+  private:
+    MappedFile(const MappedFile&);
+    void operator=(const MappedFile&);
+
+    const unsigned char* view;
+    size_t length;
+
+#if defined(WIN32)
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+};
+
+#endif
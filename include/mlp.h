@@ -0,0 +1,73 @@
+#ifndef MLP_H_INCLUDED
+#define MLP_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+//y = W x + bias for a matrix of rows stored stride floats apart. stride is
+//a multiple of four; columns past the real ones must be zero in W or in x.
+//Runs SSE2 if sse2 is set.
+void gemv(const float* w, int rows, int stride, const float* x,
+          const float* bias, float* y, bool sse2);
+
+//Applied to the output of each dense layer
+enum MlpActivation { MlpLinear, MlpRelu, MlpTanh, MlpSigmoid };
+
+/*******************************************************************************
+ A small fully connected network, evaluated one input vector at a time.
+
+ Networks are read from a text file of whitespace-separated tokens; '#'
+ starts a comment that runs to the end of the line:
+
+   nimble-mlp 1
+   inputs <n>
+   normalize <groups>            the inputs split into equal runs, one
+   <offset> <scale> ...          pair per run: x' = (x - offset) * scale
+   dense <outputs> <relu|tanh|sigmoid|linear>
+   <weights of output 0> <bias 0>
+   ...                           one row per output, the previous layer's
+                                 size of weights then the bias
+   dense ...                     more layers in order
+   labels <name> ...             one per output of the last layer
+
+ normalize and labels are optional. Rows are padded with zeros to a multiple
+ of four floats when loaded, so every layer is one gemv() over whole groups
+ of four columns.
+*******************************************************************************/
+class Mlp {
+  public:
+    Mlp();
+
+    //Replaces the network with the one in filename. On failure returns
+    //false, leaves the network empty and puts the reason in error.
+    bool load(const char* filename, std::string& error);
+
+    bool isLoaded() const { return !layers.empty(); }
+    int inputSize() const { return inputs; }
+    int outputSize() const;
+
+    const std::vector<std::string>& getLabels() const { return labels; }
+
+    //Runs input (inputSize() values) through the network into output
+    //(outputSize() values). Not reentrant: the layers share scratch space.
+    void evaluate(const float* input, float* output);
+
+  private:
+    struct Layer
+    {
+      int inputs, outputs;
+      int stride; // inputs rounded up to a multiple of four
+      MlpActivation activation;
+      std::vector<float> weights;
+      std::vector<float> bias;
+    };
+
+    int inputs;
+    std::vector<float> offset, scale; // per input
+    std::vector<Layer> layers;
+    std::vector<std::string> labels;
+    std::vector<float> scratch[2];
+    bool sse2;
+};
+
+#endif
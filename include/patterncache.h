@@ -0,0 +1,88 @@
+#ifndef PATTERN_CACHE_H_INCLUDED
+#define PATTERN_CACHE_H_INCLUDED
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "distancefield.h"
+#include "texturebuilder.h"
+#include "trajectoryscore.h"
+
+//Patterns are numbered 1 to PatternCount as in the selection menu
+static const int PatternCount = 9;
+
+//File name of a pattern ("comp1.bmp") and its menu label ("Complexity 1")
+const char* patternFile(int selection);
+const char* patternLabel(int selection);
+
+//Selection of the pattern in a file name, 0 if it isn't one of them
+int patternSelection(const std::string& file);
+
+/*******************************************************************************
+ Builds every pattern texture on worker threads so that switching patterns
+ never waits on the disk. Each worker loads the pattern's texture cache, or
+ decodes the bitmap and builds its mip chain. The cache owns the results
+ until take() hands one over, typically to be uploaded on the GL thread.
+ Once the texture is out, the worker builds the distance field the guidance
+ force follows and the scorer sessions are scored with from the same bitmap,
+ so neither selecting a pattern nor scoring a session has to build them.
+*******************************************************************************/
+class PatternCache {
+  public:
+    PatternCache();
+    ~PatternCache();
+
+    //Starts building all patterns found in directory in the given format
+    void preload(const std::string& directory, TextureFormat format);
+
+    //Hands over the texture of a pattern. Without wait it returns NULL
+    //while the pattern is still being built; with wait it blocks until
+    //then. Also NULL when the file is missing or unreadable, or once the
+    //texture has been taken.
+    TextureImage* take(int selection, bool wait);
+
+    //Gets the distance field of a pattern. Without wait it returns false
+    //while the field is still being built; with wait it blocks until then.
+    //The field is empty when the bitmap is missing or has no stroke.
+    bool getField(int selection, bool wait,
+                  std::shared_ptr<const DistanceField>& field);
+
+    //Gets the scorer of a pattern, built along with its field. Empty when
+    //the bitmap is missing or has no stroke.
+    bool getScorer(int selection, bool wait,
+                   std::shared_ptr<const PatternScorer>& scorer);
+
+    //Waits for the workers and frees any textures nobody took
+    void clear();
+
+  private:
+    PatternCache(const PatternCache&);
+    void operator=(const PatternCache&);
+
+    enum SlotState { Pending, Ready, Failed, Taken };
+
+    struct Slot
+    {
+      SlotState state;
+      TextureImage* texture;
+      bool fieldBuilt; // field and scorer
+      std::shared_ptr<const DistanceField> field;
+      std::shared_ptr<const PatternScorer> scorer;
+    };
+
+    void decodeLoop();
+
+    std::string directory;
+    TextureFormat format;
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable settled;
+    Slot slots[PatternCount + 1];
+    int nextPattern;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef RECORDER_H_INCLUDED
+#define RECORDER_H_INCLUDED
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include "devicestate.h"
+#include "ringbuffer.h"
+#include "trajectoryfile.h"
+#include "trajectorytext.h"
+
+//The binary file sits next to the YAML one with an .nbt extension
+std::string binarySessionPath(const std::string& path);
+
+/*******************************************************************************
+ Streams a recording session to disk while it runs.
+
+ The servo thread pushes samples into samples(); a dedicated writer thread
+ drains them in batches and appends them to the session file, so memory use
+ is bounded by the ring capacity no matter how long the session lasts. The
+ same samples also go to a binary .nbt file next to the YAML one.
+ stop() writes the remaining samples, fills in the total time and flushes the
+ files through to the disk.
+*******************************************************************************/
+class SessionRecorder {
+  public:
+    SessionRecorder();
+    ~SessionRecorder();
+
+    //Creates the files, writes the headers and starts the writer thread.
+    //ringCapacity is the number of samples that may be pending at once.
+    bool start(const std::string& path, const SessionInfo& info,
+               size_t ringCapacity);
+
+    //Stops the writer once every pending sample has been written. The
+    //producer must have stopped pushing before this is called.
+    void stop();
+
+    bool isRecording() const { return file != NULL; }
+
+    RingBuffer<DeviceState>& samples() { return ring; }
+
+  private:
+    SessionRecorder(const SessionRecorder&);
+    void operator=(const SessionRecorder&);
+
+    void writerLoop();
+    size_t writeBatch();
+
+    RingBuffer<DeviceState> ring;
+    std::vector<DeviceState> batch;
+    std::vector<TrajectorySample> converted;
+    std::thread writer;
+    std::atomic<bool> stopRequested;
+
+    FILE* file;
+    long totalTimeOffset;
+    TrajectoryTextWriter text;
+    TrajectoryWriter binaryFile;
+    long long timeEpoch;
+    long long timeLast;
+    bool haveEpoch;
+};
+
+#endif
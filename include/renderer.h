@@ -0,0 +1,79 @@
+#ifndef RENDERER_H_INCLUDED
+#define RENDERER_H_INCLUDED
+
+#include <vector>
+
+#include "glfunctions.h"
+#include "texturebuilder.h"
+
+//Vertex of the pattern plane
+struct TexturedVertex
+{
+  float position[3];
+  float texCoord[2];
+};
+
+//Vertex of lit, per-vertex coloured geometry such as the cursor
+struct LitVertex
+{
+  float position[3];
+  float normal[3];
+  unsigned char color[4];
+};
+
+/*******************************************************************************
+ Geometry uploaded once and drawn with a single call. It lives in a vertex
+ buffer object when the driver has them and in a client-side vertex array
+ otherwise, which GL 1.1 already supports.
+*******************************************************************************/
+class StaticMesh {
+  public:
+    StaticMesh();
+
+    void upload(const TexturedVertex* vertices, size_t count, GLenum mode);
+    void upload(const LitVertex* vertices, size_t count, GLenum mode);
+
+    void draw() const;
+
+    //Frees the buffer; needs the context the mesh was uploaded in
+    void release();
+
+  private:
+    enum Layout { Textured, Lit };
+
+    void store(const void* vertices, size_t bytes, Layout layout,
+               size_t count, GLenum mode);
+
+    GLuint buffer;
+    std::vector<unsigned char> clientCopy;
+    Layout layout;
+    GLenum mode;
+    GLsizei count;
+};
+
+/*******************************************************************************
+ The scene's static geometry: the pattern plane and the 3D cursor, built once
+ when the context is ready and drawn with no per-frame vertex submission.
+*******************************************************************************/
+class SceneRenderer {
+  public:
+    //Builds and uploads the meshes; call once a context is current
+    void init();
+    void release();
+
+    //Draws the plane centred on the origin in z=0, textured unless texture
+    //is 0
+    void drawPatternPlane(GLuint texture, float halfWidth, float halfHeight) const;
+
+    //Draws the cursor at the origin in the current modelview transform
+    void drawCursor() const;
+
+  private:
+    StaticMesh patternPlane;
+    StaticMesh cursor;
+};
+
+//Makes the mip chain into a texture, and returns the id of the texture
+GLuint loadTexture(const TextureImage& texture);
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef RING_BUFFER_H_INCLUDED
+#define RING_BUFFER_H_INCLUDED
+
+#include <cstddef>
+#include <atomic>
+
+/*******************************************************************************
+ Wait-free single-producer/single-consumer ring of fixed capacity.
+
+ The producer (the servo thread) only calls push(); the consumer only calls
+ size(), peek() and drain(). Storage is allocated by reset(), which must be
+ called while neither side is running, so push() never touches the heap.
+*******************************************************************************/
+template<class T>
+class RingBuffer {
+  public:
+    RingBuffer() : buffer(NULL), mask(0), head(0), cachedTail(0),
+                   dropped(0), tail(0), cachedHead(0) {}
+
+    ~RingBuffer() { delete[] buffer; }
+
+    //Discards any contents and reallocates room for at least minCapacity
+    //items. The capacity is rounded up to a power of two.
+    void reset(size_t minCapacity)
+    {
+      size_t capacity = 1;
+
+      while(capacity < minCapacity)
+        capacity <<= 1;
+
+      if(capacity != mask + 1 || buffer == NULL)
+      {
+        delete[] buffer;
+        buffer = new T[capacity];
+        mask = capacity - 1;
+      }
+
+      head.store(0, std::memory_order_relaxed);
+      tail.store(0, std::memory_order_relaxed);
+      dropped.store(0, std::memory_order_relaxed);
+      cachedHead = cachedTail = 0;
+    }
+
+    //Producer: appends a copy of item. Returns false (and counts the drop)
+    //when the ring is full.
+    bool push(const T& item)
+    {
+      const size_t h = head.load(std::memory_order_relaxed);
+
+      if(h - cachedTail > mask)
+      {
+        cachedTail = tail.load(std::memory_order_acquire);
+
+        if(h - cachedTail > mask)
+        {
+          dropped.store(dropped.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+          return false;
+        }
+      }
+
+      buffer[h & mask] = item;
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    //Consumer: number of items ready to be drained.
+    size_t size() const
+    {
+      return head.load(std::memory_order_acquire)
+             - tail.load(std::memory_order_relaxed);
+    }
+
+    //Consumer: the i-th pending item, oldest first. i must be below size().
+    const T& peek(size_t i) const
+    {
+      return buffer[(tail.load(std::memory_order_relaxed) + i) & mask];
+    }
+
+    //Consumer: moves up to maxCount pending items into out, oldest first,
+    //and returns how many were copied.
+    size_t drain(T* out, size_t maxCount)
+    {
+      const size_t t = tail.load(std::memory_order_relaxed);
+
+      if(cachedHead - t < maxCount)
+        cachedHead = head.load(std::memory_order_acquire);
+
+      size_t count = cachedHead - t;
+
+      if(count > maxCount)
+        count = maxCount;
+
+      for(size_t i = 0; i < count; i++)
+        out[i] = buffer[(t + i) & mask];
+
+      tail.store(t + count, std::memory_order_release);
+      return count;
+    }
+
+    size_t capacity() const { return buffer ? mask + 1 : 0; }
+
+    //Number of items rejected by push() since the last reset().
+    size_t droppedCount() const
+    {
+      return dropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    RingBuffer(const RingBuffer&);
+    void operator=(const RingBuffer&);
+
+    T* buffer;
+    size_t mask;
+
+    // Producer-owned indices, kept off the consumer's cache line.
+    char padProducer[64];
+    std::atomic<size_t> head;
+    size_t cachedTail;
+    std::atomic<size_t> dropped;
+
+    // Consumer-owned indices.
+    char padConsumer[64];
+    std::atomic<size_t> tail;
+    size_t cachedHead;
+    char padEnd[64];
+};
+
+#endif
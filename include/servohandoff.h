@@ -0,0 +1,52 @@
+#ifndef SERVO_HANDOFF_H_INCLUDED
+#define SERVO_HANDOFF_H_INCLUDED
+
+#include <atomic>
+#include <thread>
+
+/*******************************************************************************
+ Hands immutable data built on another thread to the servo loop.
+
+ The servo thread brackets its use of the current object with acquire() and
+ release(); it never waits and never frees anything. publish() swaps in a new
+ object and, once the servo thread has let go of the one it replaced, deletes
+ that one on the publishing thread. There is one reader, the servo thread.
+*******************************************************************************/
+template<class T>
+class ServoHandoff {
+  public:
+    ServoHandoff() : current(NULL), reading(false) {}
+    ~ServoHandoff() { delete current.load(); }
+
+    //Takes ownership of next, which may be NULL
+    void publish(T* next)
+    {
+      T* previous = current.exchange(next);
+
+      while(reading.load())
+        std::this_thread::yield();
+
+      delete previous;
+    }
+
+    //Servo thread: the object stays valid until release(); may be NULL
+    const T* acquire()
+    {
+      reading.store(true);
+      return current.load();
+    }
+
+    void release()
+    {
+      reading.store(false, std::memory_order_release);
+    }
+
+  private:
+    ServoHandoff(const ServoHandoff&);
+    void operator=(const ServoHandoff&);
+
+    std::atomic<T*> current;
+    std::atomic<bool> reading;
+};
+
+#endif
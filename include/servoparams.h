@@ -0,0 +1,60 @@
+#ifndef SERVO_PARAMS_H_INCLUDED
+#define SERVO_PARAMS_H_INCLUDED
+
+#include "servohandoff.h"
+
+//Settings of the point-mass effect, as chosen from the context menu
+struct EffectParameters
+{
+  double mass;              // kg
+  double stiffness;         // N/mm, of the spring dragging the mass
+  double damping;           // N/(mm/s), on the mass's velocity
+  double guidanceStiffness; // N/mm, of the pull toward the pattern stroke
+};
+
+/*******************************************************************************
+ Effect settings handed from the GUI thread to the servo loop.
+
+ publish() hands a complete snapshot over through a ServoHandoff, so the
+ servo thread never sees half an update. The servo thread calls update()
+ once at the top of each tick; it notices a new snapshot by its version and
+ eases its working values from where they are to the new ones over the ramp
+ time, so the force never steps when the settings change. update() never
+ waits and never allocates. The first snapshot is taken as it is. It also
+ says whether the values moved since the last tick, so whatever the servo
+ thread works out from them can be kept until they do.
+*******************************************************************************/
+class ServoParameters {
+  public:
+    explicit ServoParameters(double rampSeconds);
+
+    //GUI thread
+    void publish(const EffectParameters& target);
+
+    //Servo thread: the values for a tick deltaT seconds after the last one;
+    //all zero until the first publish(). changed is set when they differ
+    //from the last tick's.
+    const EffectParameters& update(double deltaT, bool& changed);
+
+  private:
+    ServoParameters(const ServoParameters&);
+    void operator=(const ServoParameters&);
+
+    struct Snapshot
+    {
+      EffectParameters target;
+      unsigned long long version;
+    };
+
+    ServoHandoff<Snapshot> handoff;
+    unsigned long long publishedVersion; // GUI thread
+
+    // Servo thread
+    double rampSeconds;
+    unsigned long long seenVersion;
+    bool started;
+    double progress; // along the ramp from 0 to 1; 1 once settled
+    EffectParameters from, to, value;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef SERVO_PROFILER_H_INCLUDED
+#define SERVO_PROFILER_H_INCLUDED
+
+#include <cstdio>
+#include <atomic>
+
+#include "timestamp.h"
+
+/*******************************************************************************
+ HDR-style histogram of nanosecond values.
+
+ Values below 64 ns get a bucket each; above that every power of two is split
+ into 32 buckets, so any recorded value is known to within about 3% up to
+ roughly a minute. Only one thread may record into a histogram; any thread
+ may read it while that happens.
+*******************************************************************************/
+class LatencyHistogram {
+  public:
+    LatencyHistogram();
+
+    void record(long long nanos);
+    void reset();
+
+    unsigned long long count() const;
+    long long min() const;
+    long long max() const;
+
+    //Value at or below which fraction q of the recordings fall
+    long long percentile(double q) const;
+
+  private:
+    enum { SubBucketBits = 6,
+           SubBucketCount = 1 << SubBucketBits,
+           HalfCount = SubBucketCount / 2,
+           LevelCount = 31,
+           BucketCount = SubBucketCount + LevelCount * HalfCount };
+
+    static int bucketIndex(unsigned long long value);
+    static long long bucketValue(int index);
+
+    std::atomic<unsigned long long> buckets[BucketCount];
+    std::atomic<unsigned long long> total;
+    std::atomic<long long> lowest;
+    std::atomic<long long> highest;
+};
+
+/*******************************************************************************
+ Timing of one servo callback: how long each call takes, the interval between
+ calls and how often it missed its deadline. A probe belongs to the thread
+ that runs its callback.
+*******************************************************************************/
+class ServoProbe {
+  public:
+    //budgetFraction is the share of a tick the callback may use.
+    ServoProbe(const char* name, double budgetFraction);
+
+    //Sets the servo period the deadlines are measured against.
+    void setUpdateRate(double rate);
+
+    //Call at the top and the bottom of the callback.
+    long long begin();
+    void end(long long start);
+
+    void reset();
+    void print(FILE* out) const;
+
+    const char* name() const { return probeName; }
+    const LatencyHistogram& durations() const { return duration; }
+    const LatencyHistogram& intervals() const { return interval; }
+    unsigned long long lateTicks() const { return late.load(); }
+    unsigned long long overBudget() const { return overrun.load(); }
+
+  private:
+    const char* probeName;
+    double budget;
+    std::atomic<long long> periodNanos;
+    std::atomic<long long> budgetNanos;
+    long long lastStart;
+
+    LatencyHistogram duration;
+    LatencyHistogram interval;
+    std::atomic<unsigned long long> late;
+    std::atomic<unsigned long long> overrun;
+};
+
+//Times the enclosing scope against a probe
+class ServoTimer {
+  public:
+    explicit ServoTimer(ServoProbe& p) : probe(p), start(p.begin()) {}
+    ~ServoTimer() { probe.end(start); }
+
+  private:
+    ServoTimer(const ServoTimer&);
+    void operator=(const ServoTimer&);
+
+    ServoProbe& probe;
+    long long start;
+};
+
+//Prints every probe's histograms
+void dumpServoProfile(FILE* out);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SIM_DEVICE_H_INCLUDED
+#define SIM_DEVICE_H_INCLUDED
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+#include "hapticdevice.h"
+#include "trajectoryfile.h"
+
+//Settings for a SimulatedDevice
+struct SimulatedDeviceConfig
+{
+  SimulatedDeviceConfig() : updateRate(1000.0), timeScale(1.0),
+                            jitterMicros(0.0), maxStiffness(1.0), replay(NULL),
+                            loopReplay(true) {}
+
+  //Servo loop rate in Hz, 1 kHz to 10 kHz
+  double updateRate;
+
+  //Simulated seconds per wall-clock second. Above 1 the ticks come that
+  //much more often while the trajectory, getUpdateRate() and
+  //simulatedTime() keep to simulated time, so long sessions run in minutes.
+  double timeScale;
+
+  //Random lateness added to each tick, as a real servo thread sees
+  double jitterMicros;
+
+  double maxStiffness;
+
+  //Recorded trajectory to play back. When NULL the device follows a
+  //scripted figure-of-eight across the workspace instead.
+  const std::vector<TrajectorySample>* replay;
+  bool loopReplay;
+};
+
+/*******************************************************************************
+ A haptic device without hardware. A dedicated thread ticks at the configured
+ rate, moves the end effector along a scripted or replayed trajectory and
+ runs the scheduled callbacks, sleeping until each deadline and spinning out
+ the last stretch so ticks land where a real servo loop would put them.
+*******************************************************************************/
+class SimulatedDevice : public HapticDevice {
+  public:
+    explicit SimulatedDevice(const SimulatedDeviceConfig& config);
+    ~SimulatedDevice();
+
+    bool init();
+    void shutdown();
+
+    void getPosition(double position[3]);
+    void setForce(const double force[3]);
+    double getUpdateRate();
+    double getNominalUpdateRate();
+    double getMaxStiffness();
+
+    ServoHandle schedule(ServoCallback callback, void *userData,
+                         unsigned short priority);
+    void unschedule(ServoHandle handle);
+
+    void startScheduler();
+    void stopScheduler();
+
+    //Ticks run so far, and how many started a whole period of the
+    //unaccelerated rate late
+    unsigned long long tickCount() const { return ticks.load(); }
+    unsigned long long overrunCount() const { return overruns.load(); }
+
+    //Last force sent by a callback. Read it from a callback or once the
+    //scheduler has stopped.
+    void getLastForce(double force[3]) const;
+
+    //Seconds of simulated time at the current tick; read it from a callback
+    double simulatedTime() const { return tickTime; }
+
+  private:
+    struct Scheduled
+    {
+      ServoHandle id;
+      ServoCallback callback;
+      void *userData;
+      unsigned short priority;
+    };
+
+    void servoLoop();
+    void updatePosition(double time);
+
+    SimulatedDeviceConfig config;
+
+    std::thread servoThread;
+    std::atomic<bool> running;
+    std::atomic<unsigned long long> ticks;
+    std::atomic<unsigned long long> overruns;
+
+    std::mutex scheduleLock;
+    std::vector<Scheduled> callbacks;
+    ServoHandle nextId;
+
+    // Servo thread state for the current tick
+    double position[3];
+    double force[3];
+    double instantaneousRate;
+    double tickTime;
+    size_t replayCursor;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef SKILL_MONITOR_H_INCLUDED
+#define SKILL_MONITOR_H_INCLUDED
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "kinematics.h"
+#include "mlp.h"
+
+//The network's latest verdict, as the GUI shows it
+struct SkillEstimate
+{
+  enum { MaxOutputs = 4 };
+
+  int count;             // outputs held; 0 until the first evaluation
+  float value[MaxOutputs];
+  long long sampleTime;  // timestampNow() of the newest sample behind it
+  long long publishTime; // timestampNow() when it was published
+};
+
+/*******************************************************************************
+ Scores the exercise while it runs.
+
+ The servo thread feeds samples() through the capture fan-out. An analysis
+ thread of its own drains them into the kinematic pipeline and, whenever a
+ new feature frame is ready, runs the last window of frames through the
+ network and publishes the outputs. The servo thread only ever pushes into
+ the ring, so a slow evaluation drops nothing but stale estimates.
+
+ The network's inputs are the window laid out channel by channel: all the
+ frames of KinematicPositionX, then of KinematicPositionY and so on, so its
+ input count fixes the window at inputs / KinematicChannelCount frames.
+*******************************************************************************/
+class SkillMonitor {
+  public:
+    SkillMonitor();
+    ~SkillMonitor();
+
+    //Loads the network; call before start(). On failure error says why.
+    bool loadModel(const char* filename, std::string& error);
+
+    const std::vector<std::string>& labels() const { return model.getLabels(); }
+
+    //Allocates the sample ring and starts the analysis thread; the ring can
+    //then be attached
+    void start(size_t ringCapacity);
+
+    //Stops the thread; detach the ring first
+    void stop();
+
+    RingBuffer<DeviceState>& samples() { return kinematics.samples(); }
+
+    //Starts the features over, as at the beginning of a session
+    void clear();
+
+    //GUI thread: the latest estimate
+    SkillEstimate latest() const;
+
+  private:
+    SkillMonitor(const SkillMonitor&);
+    void operator=(const SkillMonitor&);
+
+    void run();
+    void evaluate();
+
+    LiveKinematics kinematics;
+    Mlp model;
+    int windowFrames;
+    std::vector<float> input;
+    long long evaluatedFrames;
+
+    std::thread worker;
+    std::atomic<bool> stopRequested;
+    std::atomic<bool> clearRequested;
+
+    mutable std::mutex estimateLock;
+    SkillEstimate estimate;
+};
+
+#endif
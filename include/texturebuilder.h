@@ -0,0 +1,89 @@
+#ifndef TEXTURE_BUILDER_H_INCLUDED
+#define TEXTURE_BUILDER_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "imageloader.h"
+
+//Pixel layout of every level of a TextureImage
+enum TextureFormat
+{
+  TextureRGB8 = 0, // 3 bytes per pixel, rows tightly packed
+  TextureDXT1 = 1  // S3TC, 8 bytes per 4x4 block
+};
+
+//One mip level, ready to hand to OpenGL
+struct TextureLevel
+{
+  int width;
+  int height;
+  std::vector<unsigned char> data;
+};
+
+//A texture with its full mip chain, level 0 first and 1x1 last
+struct TextureImage
+{
+  TextureImage() : format(TextureRGB8) {}
+
+  TextureFormat format;
+  std::vector<TextureLevel> levels;
+};
+
+/*******************************************************************************
+ Texture cache file (.ntx), all fields little-endian.
+
+ Written next to the bitmap it was built from. The header records the size
+ and modification time of that bitmap, so an edited pattern is rebuilt
+ rather than served stale. The levels follow the header in order; their
+ sizes follow from the format and the level 0 dimensions.
+*******************************************************************************/
+namespace TextureCacheFormat {
+  static const char Magic[4] = {'N', 'T', 'E', 'X'};
+  static const unsigned short Version = 1;
+  static const unsigned int HeaderSize = 40;
+
+  //Field offsets within the header
+  enum {
+    MagicOffset = 0,
+    VersionOffset = 4,
+    HeaderSizeOffset = 6,
+    FormatOffset = 8,
+    WidthOffset = 12,
+    HeightOffset = 16,
+    LevelCountOffset = 20,
+    SourceSizeOffset = 24,
+    SourceTimeOffset = 32
+  };
+}
+
+//Fills texture with image and its box-filtered mip chain, in TextureRGB8
+void buildMipChain(const Image& image, TextureImage& texture);
+
+//Compresses every level of an RGB8 texture to DXT1
+void compressDxt1(TextureImage& texture);
+
+//Bytes one level takes in a format
+size_t textureLevelSize(TextureFormat format, int width, int height);
+
+//The cache file that belongs to a bitmap
+std::string textureCachePath(const std::string& bitmapPath);
+
+//Loads the cache for bitmapPath if it is current and in the given format
+bool readTextureCache(const std::string& bitmapPath, TextureFormat format,
+                      TextureImage& texture);
+bool writeTextureCache(const std::string& bitmapPath,
+                       const TextureImage& texture);
+
+//Loads the texture from its cache, or decodes the bitmap, builds the mip
+//chain and refreshes the cache. Returns false if the bitmap can't be read.
+bool buildTexture(const std::string& bitmapPath, TextureFormat format,
+                  TextureImage& texture);
+
+//The same for a caller that needs the bitmap's pixels as well: the bitmap
+//is always decoded, once, and handed back in image for the caller to
+//delete. image is NULL when it returns false.
+bool buildTexture(const std::string& bitmapPath, TextureFormat format,
+                  TextureImage& texture, Image*& image);
+
+#endif
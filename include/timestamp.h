@@ -0,0 +1,64 @@
+#ifndef TIMESTAMP_H_INCLUDED
+#define TIMESTAMP_H_INCLUDED
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define NIMBLE_HAVE_TSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#include <x86intrin.h>
+#define NIMBLE_HAVE_TSC
+#endif
+
+/*******************************************************************************
+ Monotonic timestamps in integer nanoseconds.
+
+ On x86 machines with an invariant TSC a timestamp is one rdtsc plus a
+ fixed-point scale, calibrated once against the OS clock. Elsewhere it falls
+ back to CLOCK_MONOTONIC_RAW, or QueryPerformanceCounter on Windows. Both
+ paths count from the same epoch as the OS clock, so timestamps taken before
+ and after calibration can be compared.
+
+ Call calibrateTimestamps() once at startup, before any other thread reads
+ the clock.
+*******************************************************************************/
+struct TimestampScale
+{
+  bool useTsc;
+  unsigned long long tscBase;  // TSC reading at calibration
+  long long nanosBase;         // OS clock at the same moment
+  unsigned long long mult;     // ns per tick, scaled by 2^shift
+  int shift;
+};
+
+extern TimestampScale timestampScale;
+
+//Measures the TSC rate; takes a few tens of milliseconds.
+void calibrateTimestamps();
+
+//Name of the source in use, for logs
+const char* timestampSource();
+
+//OS clock in nanoseconds; what the TSC is calibrated against
+long long systemTimestamp();
+
+inline long long timestampNow()
+{
+#if defined(NIMBLE_HAVE_TSC)
+  if(timestampScale.useTsc)
+  {
+    unsigned long long ticks = __rdtsc() - timestampScale.tscBase;
+
+    // ticks*mult >> shift without a 128-bit product; mult fits in 32 bits.
+    unsigned long long high = (ticks >> 32) * timestampScale.mult;
+    unsigned long long low = ((ticks & 0xffffffffULL) * timestampScale.mult)
+                             >> timestampScale.shift;
+
+    return timestampScale.nanosBase
+           + (long long)((high << (32 - timestampScale.shift)) + low);
+  }
+#endif
+
+  return systemTimestamp();
+}
+
+#endif
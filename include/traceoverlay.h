@@ -0,0 +1,104 @@
+#ifndef TRACE_OVERLAY_H_INCLUDED
+#define TRACE_OVERLAY_H_INCLUDED
+
+#include <utility>
+#include <vector>
+
+#include "glfunctions.h"
+#include "devicestate.h"
+#include "ringbuffer.h"
+
+/*******************************************************************************
+ Live trace of the device path, drawn over the pattern.
+
+ The servo thread feeds samples() through the capture fan-out. Each frame
+ update() moves the new samples onto the end of a vertex buffer, so the cost
+ of a frame follows the samples that arrived since the last one rather than
+ the length of the session. Once the raw tail holds ChunkSize samples it is
+ sealed: Douglas-Peucker drops the points that lie within the tolerance of
+ the line through their neighbours and the chunk is rewritten in place.
+ The whole trace is drawn with one call.
+
+ Simplifying chunk by chunk still leaves a path retraced for half an hour
+ with vertices in proportion to its length. Once the sealed chunks hold
+ more than VertexBudget vertices, the tolerance is doubled and all of them
+ are simplified again together, until they fit in half the budget; later
+ chunks are sealed at the coarser tolerance. A trace never draws more than
+ VertexBudget vertices plus a chunk, however long the session, and only
+ loses detail once it is too dense to make out anyway.
+
+ Vertices stay in device workspace coordinates (mm) and are mapped into the
+ world by the matrix from setWorkspaceTransform(), flattened onto z=0 as the
+ cursor is.
+*******************************************************************************/
+class TraceOverlay {
+  public:
+    //Raw samples per sealed chunk, and most vertices the sealed chunks
+    //may hold
+    enum { ChunkSize = 1024, VertexBudget = 16 * ChunkSize };
+
+    TraceOverlay();
+
+    //Allocates the sample ring; call before the ring is attached to the
+    //capture fan-out. tolerance is in mm.
+    void init(size_t ringCapacity, double tolerance);
+
+    RingBuffer<DeviceState>& samples() { return ring; }
+
+    //GL thread: appends what arrived since the last call
+    void update();
+
+    //Forgets the trace drawn so far
+    void clear();
+
+    //Takes the world-to-workspace transform HL uses (column-major)
+    void setWorkspaceTransform(const double worldToWorkspace[16]);
+
+    void draw() const;
+
+    //Frees the GL buffer; needs the context it was made in
+    void release();
+
+    //Vertices currently in the trace, and raw samples they stand for
+    size_t vertexCount() const { return vertices.size(); }
+    size_t sampleCount() const { return samplesSeen; }
+
+    //Tolerance (mm) chunks are sealed at now, raised as the trace grows
+    double sealTolerance() const { return currentTolerance; }
+
+  private:
+    TraceOverlay(const TraceOverlay&);
+    void operator=(const TraceOverlay&);
+
+    struct Point
+    {
+      float position[3];
+    };
+
+    void sealChunk();
+    void simplify(size_t first, double within);
+    void upload(size_t first);
+
+    RingBuffer<DeviceState> ring;
+    std::vector<DeviceState> batch;
+
+    // CPU mirror of the buffer contents: sealed chunks, then the raw tail
+    std::vector<Point> vertices;
+    size_t tailStart;
+    size_t samplesSeen;
+    double tolerance;
+    double currentTolerance;
+
+    // Scratch for sealing a chunk
+    std::vector<Point> simplified;
+    std::vector<char> keep;
+    std::vector<std::pair<size_t, size_t> > spans;
+
+    GLuint buffer;
+    size_t bufferCapacity; // in vertices
+    size_t uploaded;       // vertices already in the buffer
+
+    double deviceToWorld[16];
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef TRAJECTORY_FILE_H_INCLUDED
+#define TRAJECTORY_FILE_H_INCLUDED
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+//Descriptive fields written into the session file header.
+struct SessionInfo
+{
+  SessionInfo() : patternLevel(0), date(0), coordinateSpace("world"),
+                  hasPatternTransform(false)
+  {
+    for(int i = 0; i < 4; i++)
+      patternTransform[0][i] = patternTransform[1][i] = 0.0;
+  }
+
+  std::string patientId;
+  std::string location;
+  std::string patternType;
+  int patternLevel;
+  std::string workspace;
+  time_t date;
+  std::string coordinateSpace;
+
+  //Bitmap the session was drawn over ("wid1.bmp"), and the affine map from
+  //device positions to its pixels (centres on the integers, rows from the
+  //bottom) if it was known when recording
+  std::string patternFile;
+  bool hasPatternTransform;
+  double patternTransform[2][4];
+};
+
+//One recorded sample. time is in nanoseconds since the first sample.
+struct TrajectorySample
+{
+  double position[3];
+  long long time;
+};
+
+/*******************************************************************************
+ Binary session format (.nbt), all fields little-endian.
+
+ A fixed header block of HeaderSize bytes holds the session metadata,
+ followed by sampleCount records of RecordSize bytes:
+ x, y, z as IEEE doubles and the time as a signed 64-bit nanosecond offset.
+ Records are sorted by time, so a reader can map the file and binary search
+ it. Readers take the header and record sizes from the file itself, so fields
+ can be appended to either without bumping the version.
+*******************************************************************************/
+namespace TrajectoryFormat {
+  static const char Magic[4] = {'N', 'M', 'B', 'T'};
+  static const unsigned short Version = 1;
+  static const unsigned int HeaderSize = 352;
+  static const unsigned int RecordSize = 32;
+
+  //Header size of the first files; later fields are read only if present
+  static const unsigned int MinHeaderSize = 256;
+
+  //Bits of the flags field
+  enum {
+    HasPatternTransform = 1
+  };
+
+  //Field offsets within the header block
+  enum {
+    MagicOffset = 0,
+    VersionOffset = 4,
+    HeaderSizeOffset = 6,
+    RecordSizeOffset = 8,
+    FlagsOffset = 12,
+    SampleCountOffset = 16,
+    DateOffset = 24,
+    DurationOffset = 32,
+    PatternLevelOffset = 40,
+    PatientIdOffset = 48,     PatientIdLength = 64,
+    LocationOffset = 112,     LocationLength = 64,
+    PatternTypeOffset = 176,  PatternTypeLength = 32,
+    WorkspaceOffset = 208,    WorkspaceLength = 32,
+    CoordSpaceOffset = 240,   CoordSpaceLength = 16,
+    PatternFileOffset = 256,  PatternFileLength = 32,
+    PatternTransformOffset = 288 // 8 doubles, row by row
+  };
+}
+
+//Appends samples to a binary session file as they arrive.
+class TrajectoryWriter {
+  public:
+    TrajectoryWriter();
+    ~TrajectoryWriter();
+
+    bool open(const char* filename, const SessionInfo& info);
+    void append(const TrajectorySample* samples, size_t count);
+
+    //Fills in the sample count and duration, syncs and closes the file.
+    void close();
+
+    bool isOpen() const { return file != NULL; }
+
+  private:
+    TrajectoryWriter(const TrajectoryWriter&);
+    void operator=(const TrajectoryWriter&);
+
+    FILE* file;
+    unsigned long long sampleCount;
+    long long lastTime;
+};
+
+//Random access to a memory-mapped binary session file.
+class TrajectoryReader {
+  public:
+    TrajectoryReader();
+
+    bool open(const char* filename);
+    void close();
+
+    const SessionInfo& info() const { return sessionInfo; }
+    size_t size() const { return sampleCount; }
+    long long duration() const { return durationNanos; }
+
+    TrajectorySample sample(size_t i) const;
+
+    //Index of the first sample at or after time (nanoseconds), or size()
+    //if there is none.
+    size_t seek(long long time) const;
+
+  private:
+    long long sampleTime(size_t i) const;
+
+    MappedFile mapping;
+    SessionInfo sessionInfo;
+    const unsigned char* records;
+    size_t recordSize;
+    size_t sampleCount;
+    long long durationNanos;
+};
+
+//Writes the YAML header. The total time is left as a fixed-width
+//placeholder whose file offset is stored in totalTimeOffset.
+void writeYamlHeader(FILE* file, const SessionInfo& info, long* totalTimeOffset);
+
+//Fills in the field reserved by writeYamlHeader (milliseconds).
+void writeYamlTotalTime(FILE* file, long totalTimeOffset, double totalTime);
+
+//Appends samples as '- [x, y, z, time]' rows. Callers writing many batches
+//should keep a TrajectoryTextWriter instead.
+void writeYamlSamples(FILE* file, const TrajectorySample* samples, size_t count);
+
+//Applies one line of a YAML header to info. Returns true for the 'data:' line
+//that ends the header.
+bool parseYamlHeaderLine(const char* line, SessionInfo& info);
+
+//Reads a whole YAML session file. Returns false if it cannot be opened.
+bool readYamlTrajectory(const char* filename, SessionInfo& info,
+                        std::vector<TrajectorySample>& samples);
+
+//Writes a whole YAML session file.
+bool writeYamlTrajectory(const char* filename, const SessionInfo& info,
+                         const std::vector<TrajectorySample>& samples);
+
+//Forces everything written to file out to the disk.
+void syncFile(FILE* file);
+
+#endif
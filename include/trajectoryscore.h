@@ -0,0 +1,77 @@
+#ifndef TRAJECTORY_SCORE_H_INCLUDED
+#define TRAJECTORY_SCORE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#include "imageloader.h"
+#include "trajectoryfile.h"
+
+//How closely a session followed its pattern
+struct TrajectoryScore
+{
+  size_t samples;
+  double rmsDeviation;  // mm from the centreline
+  double maxDeviation;  // mm
+  double timeOffPath;   // ms spent outside the stroke
+  double totalTime;     // ms
+  double completion;    // share of the centreline the device came within
+                        // reach of, 0 to 1
+};
+
+//Prints a score as a few labelled lines
+void printTrajectoryScore(FILE* out, const TrajectoryScore& score);
+
+//Thins a stroke mask (width by height) to a one pixel wide skeleton with
+//Zhang and Suen's algorithm. Returns the number of skeleton pixels.
+size_t skeletonize(const std::vector<char>& stroke, int width, int height,
+                   std::vector<char>& skeleton);
+
+/*******************************************************************************
+ Scores recorded sessions against one pattern.
+
+ load() does everything that depends on the pattern alone: the stroke's
+ signed distance field, its skeleton (the centreline a clinician scores
+ against) and, for every pixel, the distance to the nearest centreline
+ pixel and which one that is. score() is then a constant-time lookup per
+ sample, so a full-rate session scores in milliseconds, and one scorer can
+ score any number of sessions over the same pattern.
+*******************************************************************************/
+class PatternScorer {
+  public:
+    PatternScorer();
+
+    //Returns false if the pattern has no stroke
+    bool load(const Image& pattern, int threshold, unsigned int threads);
+
+    bool isLoaded() const { return !centreline.empty(); }
+
+    //Scores samples whose positions map to pattern pixels through toPixel
+    //(as SessionInfo::patternTransform). A centreline pixel counts as
+    //completed once the device was within reach (mm) of it and nearer to
+    //it than to any other.
+    TrajectoryScore score(const TrajectorySample* samples, size_t count,
+                          const double toPixel[2][4], double reach) const;
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    size_t centrelineLength() const { return centreline.size(); }
+
+  private:
+    //Everything score() reads about one pixel, so a lookup touches four
+    //of these and nothing else
+    struct Cell
+    {
+      float centreDistance; // pixels to the nearest centreline pixel
+      float edgeDistance;   // signed pixels to the stroke's edge
+      int nearestCentre;    // that centreline pixel, as an index into centreline
+    };
+
+    int width;
+    int height;
+    std::vector<Cell> cells;
+    std::vector<int> centreline; // pixel index of every skeleton pixel
+};
+
+#endif
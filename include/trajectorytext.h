@@ -0,0 +1,85 @@
+#ifndef TRAJECTORY_TEXT_H_INCLUDED
+#define TRAJECTORY_TEXT_H_INCLUDED
+
+#include <cstdio>
+#include <vector>
+
+#include "trajectoryfile.h"
+
+//Most digits formatFixed() writes after the decimal point, and the longest
+//text it produces for any double: sign, 309 digits, point and fraction
+static const int MaxFixedPrecision = 17;
+static const size_t MaxFixedLength = 330;
+
+//Writes value with precision digits after the decimal point, exactly as
+//printf("%.*f") does, and returns the number of characters written.
+//precision is clamped to 0..MaxFixedPrecision. out needs room for
+//MaxFixedLength characters; no terminator is added.
+size_t formatFixed(char* out, double value, int precision);
+
+//Writes nanoseconds as milliseconds with one decimal, rounding half up,
+//using integer arithmetic only. Same room and return value as formatFixed().
+size_t formatMillis(char* out, long long nanos);
+
+/*******************************************************************************
+ Formats '- [x, y, z, time]' rows into one reusable buffer and hands it to the
+ file in large chunks. The output is byte-identical to the iostream form
+ (fixed, setprecision(4) for positions and 1 for the time in milliseconds),
+ but nothing is allocated or flushed per row. Times round half up on the exact
+ nanosecond count, where the iostream form rounded the nearest double.
+*******************************************************************************/
+class TrajectoryTextWriter {
+  public:
+    explicit TrajectoryTextWriter(size_t bufferSize = 1 << 16);
+    ~TrajectoryTextWriter();
+
+    //Sets the destination. Pending text goes to the previous file first.
+    void attach(FILE* file);
+
+    void writeSamples(const TrajectorySample* samples, size_t count);
+
+    //Passes the buffered text on to the file.
+    void flush();
+
+  private:
+    TrajectoryTextWriter(const TrajectoryTextWriter&);
+    void operator=(const TrajectoryTextWriter&);
+
+    FILE* file;
+    std::vector<char> buffer;
+    size_t used;
+};
+
+/*******************************************************************************
+ Streams the samples of a YAML session file from a read-only mapping of it.
+ open() reads the header; read() then parses rows straight out of the mapping
+ into the caller's buffer, so a file of any length is read without a copy or
+ a per-row allocation. Rows in the fixed-point form the writers produce are
+ converted without the C library, exactly as strtod would.
+*******************************************************************************/
+class TrajectoryTextReader {
+  public:
+    TrajectoryTextReader();
+
+    //Returns false if the file cannot be opened. An empty file opens as a
+    //session without samples.
+    bool open(const char* filename);
+    void close();
+
+    const SessionInfo& info() const { return sessionInfo; }
+
+    //Parses up to max more samples into out and returns how many; 0 at the
+    //end. Lines that aren't sample rows are skipped.
+    size_t read(TrajectorySample* out, size_t max);
+
+  private:
+    TrajectoryTextReader(const TrajectoryTextReader&);
+    void operator=(const TrajectoryTextReader&);
+
+    MappedFile mapping;
+    SessionInfo sessionInfo;
+    const char* cursor;
+    const char* end;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef WORK_POOL_H_INCLUDED
+#define WORK_POOL_H_INCLUDED
+
+#include <cstddef>
+#include <functional>
+
+/*******************************************************************************
+ Runs independent tasks over all cores with work stealing.
+
+ run() splits the task indices into one contiguous range per worker. Each
+ worker takes indices from the front of its own range; one that runs dry
+ takes the back half of the largest range left, so a few slow tasks (long
+ sessions, big bitmaps) don't leave the other cores idle. The calling thread
+ is one of the workers, and run() returns once every task has finished.
+*******************************************************************************/
+class WorkPool {
+  public:
+    //threads of 0 means one per core
+    explicit WorkPool(unsigned int threads = 0);
+
+    unsigned int size() const { return threadCount; }
+
+    //Calls task(worker, index) once for every index in [0, count). worker is
+    //in [0, size()) and no two calls with the same worker overlap, so it can
+    //pick out per-worker state without locking.
+    void run(size_t count,
+             const std::function<void(unsigned int, size_t)>& task) const;
+
+  private:
+    unsigned int threadCount;
+};
+
+#endif
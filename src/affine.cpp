@@ -0,0 +1,42 @@
+#include <cstring>
+
+#include "affine.h"
+
+using namespace std;
+
+bool invertAffine(const double m[16], double out[16])
+{
+  // Column-major: element (row, col) is m[col*4 + row].
+  double a = m[0], b = m[4], c = m[8];
+  double d = m[1], e = m[5], f = m[9];
+  double g = m[2], h = m[6], k = m[10];
+
+  double det = a * (e * k - f * h) - b * (d * k - f * g) + c * (d * h - e * g);
+
+  if(det == 0.0)
+    return false;
+
+  double inv[9] = {
+    (e * k - f * h) / det, (c * h - b * k) / det, (b * f - c * e) / det,
+    (f * g - d * k) / det, (a * k - c * g) / det, (c * d - a * f) / det,
+    (d * h - e * g) / det, (b * g - a * h) / det, (a * e - b * d) / det
+  };
+
+  double result[16];
+
+  memset(result, 0, sizeof(result));
+
+  for(int row = 0; row < 3; row++)
+  {
+    for(int col = 0; col < 3; col++)
+      result[col * 4 + row] = inv[row * 3 + col];
+
+    result[12 + row] = -(inv[row * 3] * m[12] + inv[row * 3 + 1] * m[13]
+                         + inv[row * 3 + 2] * m[14]);
+  }
+
+  result[15] = 1.0;
+
+  memcpy(out, result, sizeof(result));
+  return true;
+}
@@ -0,0 +1,64 @@
+#include "cpufeatures.h"
+
+#if defined(NIMBLE_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+  struct CpuidResult
+  {
+    unsigned int eax, ebx, ecx, edx;
+  };
+
+  //Runs cpuid for leaf/subleaf; all zero when the leaf doesn't exist
+  CpuidResult cpuid(unsigned int leaf, unsigned int subleaf)
+  {
+    CpuidResult r = {0, 0, 0, 0};
+
+#if defined(NIMBLE_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, int(leaf & 0x80000000u));
+
+    if((unsigned int)info[0] < leaf)
+      return r;
+
+    __cpuidex(info, int(leaf), int(subleaf));
+    r.eax = (unsigned int)info[0];
+    r.ebx = (unsigned int)info[1];
+    r.ecx = (unsigned int)info[2];
+    r.edx = (unsigned int)info[3];
+#elif defined(NIMBLE_X86)
+    if(__get_cpuid_max(leaf & 0x80000000u, 0) < leaf)
+      return r;
+
+    __cpuid_count(leaf, subleaf, r.eax, r.ebx, r.ecx, r.edx);
+#else
+    (void)leaf;
+    (void)subleaf;
+#endif
+
+    return r;
+  }
+}
+
+
+bool cpuHasSse2()
+{
+  return (cpuid(1, 0).edx & (1u << 26)) != 0;
+}
+
+
+bool cpuHasSsse3()
+{
+  return (cpuid(1, 0).ecx & (1u << 9)) != 0;
+}
+
+
+bool cpuHasInvariantTsc()
+{
+  return (cpuid(0x80000007u, 0).edx & (1u << 8)) != 0;
+}
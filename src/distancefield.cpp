@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "distancefield.h"
+
+using namespace std;
+
+namespace {
+  //Squared distance standing for "no feature on this line"
+  const float Unreached = 1e20f;
+
+  //Runs body(first, last) over [0, count) split into one band per thread
+  template<class F>
+  void parallelBands(int count, unsigned int threads, F body)
+  {
+    if(threads < 1)
+      threads = 1;
+
+    int band = (count + int(threads) - 1) / int(threads);
+    vector<thread> workers;
+
+    for(int first = band; first < count; first += band)
+      workers.push_back(thread(body, first, min(count, first + band)));
+
+    body(0, min(count, band));
+
+    for(size_t i = 0; i < workers.size(); i++)
+      workers[i].join();
+  }
+
+  /*****************************************************************************
+   One-dimensional squared distance transform of the sampled function f:
+   d[q] = min over p of (q - p)^2 + f[p], as the lower envelope of the
+   parabolas rooted at the finite samples. v and z need n and n + 1 entries.
+   If nearest isn't NULL it gets the minimising p, or -1 if there is none.
+  *****************************************************************************/
+  void transformLine(const float* f, int n, float* d, int* v, float* z,
+                     int* nearest)
+  {
+    int k = -1;
+
+    for(int q = 0; q < n; q++)
+    {
+      if(f[q] >= Unreached)
+        continue;
+
+      // In double: q^2 outgrows a float's mantissa on wide patterns.
+      double s = -Unreached;
+
+      while(k >= 0)
+      {
+        int p = v[k];
+        s = ((f[q] + double(q) * q) - (f[p] + double(p) * p)) / (2.0 * (q - p));
+
+        if(s > z[k])
+          break;
+
+        k--;
+      }
+
+      if(k < 0)
+        s = -Unreached;
+
+      k++;
+      v[k] = q;
+      z[k] = float(s);
+      z[k + 1] = Unreached;
+    }
+
+    if(k < 0)
+    {
+      fill(d, d + n, Unreached);
+
+      if(nearest != NULL)
+        fill(nearest, nearest + n, -1);
+
+      return;
+    }
+
+    k = 0;
+
+    for(int q = 0; q < n; q++)
+    {
+      while(z[k + 1] < q)
+        k++;
+
+      float offset = float(q - v[k]);
+      d[q] = offset * offset + f[v[k]];
+
+      if(nearest != NULL)
+        nearest[q] = v[k];
+    }
+  }
+}
+
+
+size_t strokeMask(const Image& image, int threshold, vector<char>& stroke)
+{
+  const size_t n = size_t(max(image.width, 0)) * max(image.height, 0);
+  size_t strokePixels = 0;
+
+  stroke.resize(n);
+
+  for(size_t i = 0; i < n; i++)
+  {
+    const unsigned char* rgb = (const unsigned char*)image.pixels + 3 * i;
+    int luminance = (rgb[0] * 77 + rgb[1] * 150 + rgb[2] * 29) >> 8;
+
+    stroke[i] = luminance < threshold;
+    strokePixels += stroke[i];
+  }
+
+  return strokePixels;
+}
+
+
+void distanceTransform(const vector<char>& feature, int w, int h,
+                       unsigned int threads, vector<float>& distance2,
+                       vector<int>* nearest)
+{
+  const size_t n = size_t(w) * h;
+
+  // First down the columns only. Features are binary, so a sweep each way
+  // does it, a row at a time; columns are split in bands.
+  vector<float> column(n);
+  vector<int> columnRow(nearest != NULL ? n : 0);
+
+  parallelBands(w, threads, [&](int first, int last)
+  {
+    vector<int> run(last - first);
+
+    for(int pass = 0; pass < 2; pass++)
+    {
+      fill(run.begin(), run.end(), -1);
+
+      for(int step = 0; step < h; step++)
+      {
+        int y = pass == 0 ? step : h - 1 - step;
+        size_t row = size_t(y) * w;
+
+        for(int x = first; x < last; x++)
+        {
+          int& seen = run[x - first]; // row of the last feature passed
+
+          if(feature[row + x])
+            seen = y;
+
+          float d = seen < 0 ? Unreached : float(y > seen ? y - seen : seen - y);
+
+          if(pass == 0 || d < column[row + x])
+          {
+            column[row + x] = d;
+
+            if(nearest != NULL)
+              columnRow[row + x] = seen;
+          }
+        }
+      }
+    }
+  });
+
+  for(size_t i = 0; i < n; i++)
+    if(column[i] < Unreached)
+      column[i] *= column[i];
+
+  // Then along the rows, each independent of the others.
+  distance2.resize(n);
+
+  if(nearest != NULL)
+    nearest->resize(n);
+
+  parallelBands(h, threads, [&](int first, int last)
+  {
+    vector<int> v(w), along(nearest != NULL ? w : 0);
+    vector<float> z(w + 1);
+
+    for(int y = first; y < last; y++)
+    {
+      size_t row = size_t(y) * w;
+
+      transformLine(&column[row], w, &distance2[row], &v[0], &z[0],
+                    nearest != NULL ? &along[0] : NULL);
+
+      if(nearest != NULL)
+        for(int x = 0; x < w; x++)
+          (*nearest)[row + x] = along[x] < 0 ? -1
+                                : columnRow[row + along[x]] * w + along[x];
+    }
+  });
+}
+
+
+void signedDistance(const vector<char>& stroke, int w, int h,
+                    unsigned int threads, vector<float>& distance)
+{
+  const size_t n = size_t(w) * h;
+
+  // Squared distance to the stroke (outside) and to the background (inside).
+  vector<char> background(n);
+  vector<float> outside, inside;
+
+  for(size_t i = 0; i < n; i++)
+    background[i] = !stroke[i];
+
+  distanceTransform(stroke, w, h, threads, outside, NULL);
+  distanceTransform(background, w, h, threads, inside, NULL);
+
+  // Half a pixel moves the zero crossing onto the stroke's edge.
+  distance.resize(n);
+
+  for(size_t i = 0; i < n; i++)
+    distance[i] = stroke[i] ? 0.5f - sqrt(inside[i]) : sqrt(outside[i]) - 0.5f;
+}
+
+
+DistanceField::DistanceField() : width(0), height(0)
+{
+}
+
+
+bool DistanceField::build(const Image& image, int threshold,
+                          unsigned int threads)
+{
+  vector<char> stroke;
+
+  strokeMask(image, threshold, stroke);
+  return build(stroke, image.width, image.height, threads);
+}
+
+
+bool DistanceField::build(const vector<char>& stroke, int w, int h,
+                          unsigned int threads)
+{
+  const size_t n = size_t(w) * h;
+
+  if(w <= 0 || h <= 0 || stroke.size() < n)
+    return false;
+
+  size_t strokePixels = 0;
+
+  for(size_t i = 0; i < n; i++)
+    strokePixels += stroke[i] != 0;
+
+  if(strokePixels == 0 || strokePixels == n)
+    return false;
+
+  vector<float> distance;
+
+  signedDistance(stroke, w, h, threads, distance);
+
+  // Central differences, one-sided at the border.
+  width = w;
+  height = h;
+  texels.resize(n);
+
+  parallelBands(h, threads, [&](int first, int last)
+  {
+    for(int y = first; y < last; y++)
+    {
+      int below = max(y - 1, 0), above = min(y + 1, h - 1);
+
+      for(int x = 0; x < w; x++)
+      {
+        int left = max(x - 1, 0), right = min(x + 1, w - 1);
+        Texel& t = texels[size_t(y) * w + x];
+
+        t.distance = distance[size_t(y) * w + x];
+        t.gradient[0] = (distance[size_t(y) * w + right]
+                         - distance[size_t(y) * w + left]) / float(right - left);
+        t.gradient[1] = (distance[size_t(above) * w + x]
+                         - distance[size_t(below) * w + x]) / float(above - below);
+      }
+    }
+  });
+
+  return true;
+}
+
+
+void DistanceField::sample(double x, double y, double& distance,
+                           double gradient[2]) const
+{
+  x = min(max(x, 0.0), double(width - 1));
+  y = min(max(y, 0.0), double(height - 1));
+
+  int x0 = int(x), y0 = int(y);
+  int x1 = min(x0 + 1, width - 1), y1 = min(y0 + 1, height - 1);
+  double fx = x - x0, fy = y - y0;
+
+  const Texel& a = texels[size_t(y0) * width + x0];
+  const Texel& b = texels[size_t(y0) * width + x1];
+  const Texel& c = texels[size_t(y1) * width + x0];
+  const Texel& d = texels[size_t(y1) * width + x1];
+
+  double wa = (1 - fx) * (1 - fy), wb = fx * (1 - fy);
+  double wc = (1 - fx) * fy, wd = fx * fy;
+
+  distance = wa * a.distance + wb * b.distance + wc * c.distance + wd * d.distance;
+
+  for(int i = 0; i < 2; i++)
+    gradient[i] = wa * a.gradient[i] + wb * b.gradient[i]
+                  + wc * c.gradient[i] + wd * d.gradient[i];
+}
+
+
+double pixelSpacing(const double toPixel[2][4])
+{
+  double length[2];
+
+  for(int row = 0; row < 2; row++)
+    length[row] = sqrt(toPixel[row][0] * toPixel[row][0]
+                       + toPixel[row][1] * toPixel[row][1]
+                       + toPixel[row][2] * toPixel[row][2]);
+
+  return length[0] * length[1] > 0.0 ? 1.0 / sqrt(length[0] * length[1]) : 0.0;
+}
+
+
+/*******************************************************************************
+ PatternGuidance
+*******************************************************************************/
+PatternGuidance::PatternGuidance() : mmPerPixel(0.0)
+{
+  for(int i = 0; i < 4; i++)
+    toPixel[0][i] = toPixel[1][i] = 0.0;
+}
+
+
+void PatternGuidance::setMapping(const double m[16], double halfWidth,
+                                 double halfHeight)
+{
+  // World x, y to pixel coordinates with pixel centres on the integers.
+  double scale[2] = {
+    field->getWidth() / (2.0 * halfWidth),
+    field->getHeight() / (2.0 * halfHeight)
+  };
+  double half[2] = {halfWidth, halfHeight};
+
+  for(int row = 0; row < 2; row++)
+  {
+    // Column-major: element (row, col) is m[col*4 + row].
+    for(int col = 0; col < 3; col++)
+      toPixel[row][col] = scale[row] * m[col * 4 + row];
+
+    toPixel[row][3] = scale[row] * (m[12 + row] + half[row]) - 0.5;
+  }
+
+  mmPerPixel = pixelSpacing(toPixel);
+}
+
+
+void PatternGuidance::force(const double position[3], double stiffness,
+                            double maxForce, double out[3]) const
+{
+  out[0] = out[1] = out[2] = 0.0;
+
+  if(!field)
+    return;
+
+  double pixel[2];
+
+  for(int row = 0; row < 2; row++)
+    pixel[row] = toPixel[row][0] * position[0] + toPixel[row][1] * position[1]
+                 + toPixel[row][2] * position[2] + toPixel[row][3];
+
+  double distance, gradient[2];
+
+  field->sample(pixel[0], pixel[1], distance, gradient);
+
+  if(distance <= 0.0)
+    return;
+
+  // Back through the mapping: the gradient of the distance in mm per mm.
+  double magnitude2 = 0.0;
+
+  for(int i = 0; i < 3; i++)
+  {
+    double slope = (toPixel[0][i] * gradient[0] + toPixel[1][i] * gradient[1])
+                   * mmPerPixel;
+
+    out[i] = -stiffness * distance * mmPerPixel * slope;
+    magnitude2 += out[i] * out[i];
+  }
+
+  if(magnitude2 > maxForce * maxForce)
+  {
+    double scale = maxForce / sqrt(magnitude2);
+
+    for(int i = 0; i < 3; i++)
+      out[i] *= scale;
+  }
+}
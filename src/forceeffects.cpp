@@ -0,0 +1,46 @@
+#include "forceeffects.h"
+
+using namespace Effect;
+
+namespace {
+  //By body (none, undamped, damped), then with ratio points, then with a
+  //pattern
+  const EffectKernel Kernels[3][2][2] = {
+    {{effectKernel<NoInertia, None, None>,
+      effectKernel<NoInertia, None, Guidance>},
+     {effectKernel<NoInertia, GravityWell, None>,
+      effectKernel<NoInertia, GravityWell, Guidance>}},
+    {{effectKernel<Inertia<None>, None, None>,
+      effectKernel<Inertia<None>, None, Guidance>},
+     {effectKernel<Inertia<None>, GravityWell, None>,
+      effectKernel<Inertia<None>, GravityWell, Guidance>}},
+    {{effectKernel<Inertia<Damping>, None, None>,
+      effectKernel<Inertia<Damping>, None, Guidance>},
+     {effectKernel<Inertia<Damping>, GravityWell, None>,
+      effectKernel<Inertia<Damping>, GravityWell, Guidance>}}
+  };
+}
+
+
+void startEffect(EffectState& state, const double proxy[3])
+{
+  for(int i = 0; i < 3; i++)
+  {
+    state.position[i] = proxy[i];
+    state.velocity[i] = 0.0;
+  }
+
+  state.mapCurrent = false;
+}
+
+
+EffectKernel selectEffectKernel(const EffectInput& in)
+{
+  // Without a spring nothing drags the mass, whatever it weighs. Settings
+  // ramping down to none keep the spring until they get there, and the mass
+  // rides on the proxy from then on, so switching bodies never jolts.
+  const EffectParameters& params = *in.params;
+  int body = params.stiffness <= 0.0 ? 0 : params.damping > 0.0 ? 2 : 1;
+
+  return Kernels[body][in.anchors != NULL][in.guidance != NULL];
+}
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cmath>
+
+#include "forcefield.h"
+
+using namespace std;
+
+namespace {
+  //Bounds the grid when the attractors are far apart for their size
+  const size_t MaxCells = 1 << 18;
+}
+
+
+AttractorField::AttractorField() : count(0), cellSize(1.0)
+{
+  for(int i = 0; i < 3; i++)
+  {
+    origin[i] = 0.0;
+    cells[i] = 0;
+  }
+}
+
+
+AttractorField::AttractorField(const vector<Attractor>& attractors)
+  : count(attractors.size()), cellSize(1.0)
+{
+  for(int i = 0; i < 3; i++)
+  {
+    origin[i] = 0.0;
+    cells[i] = 0;
+  }
+
+  if(attractors.empty())
+    return;
+
+  // Bounds of every sphere, and the largest radius.
+  double lower[3], upper[3], largest = 0.0;
+
+  for(int i = 0; i < 3; i++)
+  {
+    lower[i] = attractors[0].position[i];
+    upper[i] = attractors[0].position[i];
+  }
+
+  for(size_t a = 0; a < attractors.size(); a++)
+  {
+    const Attractor& attractor = attractors[a];
+
+    for(int i = 0; i < 3; i++)
+    {
+      lower[i] = min(lower[i], attractor.position[i] - attractor.radius);
+      upper[i] = max(upper[i], attractor.position[i] + attractor.radius);
+    }
+
+    largest = max(largest, attractor.radius);
+  }
+
+  // A sphere then spans at most two cells a side; grow the cells if the
+  // grid would get too big.
+  cellSize = max(2.0 * largest, 1e-3);
+
+  for(;;)
+  {
+    size_t total = 1;
+
+    for(int i = 0; i < 3; i++)
+    {
+      cells[i] = int((upper[i] - lower[i]) / cellSize) + 1;
+      total *= size_t(cells[i]);
+    }
+
+    if(total <= MaxCells)
+      break;
+
+    cellSize *= 2.0;
+  }
+
+  for(int i = 0; i < 3; i++)
+    origin[i] = lower[i];
+
+  // Two passes: count the entries per cell, then place them.
+  size_t cellCount = size_t(cells[0]) * cells[1] * cells[2];
+  vector<int> range(6 * attractors.size());
+
+  cellStart.assign(cellCount + 1, 0);
+
+  for(size_t a = 0; a < attractors.size(); a++)
+  {
+    const Attractor& attractor = attractors[a];
+    int* r = &range[6 * a];
+
+    for(int i = 0; i < 3; i++)
+    {
+      r[2 * i] = max(0, int((attractor.position[i] - attractor.radius - origin[i])
+                            / cellSize));
+      r[2 * i + 1] = min(cells[i] - 1,
+                         int((attractor.position[i] + attractor.radius - origin[i])
+                             / cellSize));
+    }
+
+    for(int z = r[4]; z <= r[5]; z++)
+      for(int y = r[2]; y <= r[3]; y++)
+        for(int x = r[0]; x <= r[1]; x++)
+          cellStart[(size_t(z) * cells[1] + y) * cells[0] + x + 1]++;
+  }
+
+  for(size_t c = 0; c < cellCount; c++)
+    cellStart[c + 1] += cellStart[c];
+
+  vector<unsigned int> next(cellStart.begin(), cellStart.end() - 1);
+
+  entries.resize(cellStart[cellCount]);
+
+  for(size_t a = 0; a < attractors.size(); a++)
+  {
+    const Attractor& attractor = attractors[a];
+    const int* r = &range[6 * a];
+    Entry entry;
+
+    for(int i = 0; i < 3; i++)
+      entry.position[i] = float(attractor.position[i]);
+
+    entry.radius2 = float(attractor.radius * attractor.radius);
+    entry.stiffness = float(attractor.stiffness);
+
+    for(int z = r[4]; z <= r[5]; z++)
+      for(int y = r[2]; y <= r[3]; y++)
+        for(int x = r[0]; x <= r[1]; x++)
+          entries[next[(size_t(z) * cells[1] + y) * cells[0] + x]++] = entry;
+  }
+}
+
+
+bool AttractorField::cellOf(const double position[3], size_t& cell) const
+{
+  int index[3];
+
+  for(int i = 0; i < 3; i++)
+  {
+    double offset = (position[i] - origin[i]) / cellSize;
+
+    if(!(offset >= 0.0 && offset < double(cells[i])))
+      return false;
+
+    index[i] = int(offset);
+  }
+
+  cell = (size_t(index[2]) * cells[1] + index[1]) * cells[0] + index[0];
+  return true;
+}
+
+
+void AttractorField::force(const double position[3], double out[3]) const
+{
+  out[0] = out[1] = out[2] = 0.0;
+
+  size_t cell;
+
+  if(!cellOf(position, cell))
+    return;
+
+  const Entry* entry = entries.empty() ? NULL : &entries[0];
+  const Entry* end = entry + cellStart[cell + 1];
+
+  for(entry += cellStart[cell]; entry < end; entry++)
+  {
+    double toward[3] = {
+      entry->position[0] - position[0],
+      entry->position[1] - position[1],
+      entry->position[2] - position[2]
+    };
+    double distance2 = toward[0] * toward[0] + toward[1] * toward[1]
+                       + toward[2] * toward[2];
+
+    if(distance2 < entry->radius2)
+    {
+      out[0] += entry->stiffness * toward[0];
+      out[1] += entry->stiffness * toward[1];
+      out[2] += entry->stiffness * toward[2];
+    }
+  }
+}
+
+
+size_t AttractorField::candidates(const double position[3]) const
+{
+  size_t cell;
+
+  if(!cellOf(position, cell))
+    return 0;
+
+  return cellStart[cell + 1] - cellStart[cell];
+}
@@ -0,0 +1,142 @@
+#if defined(WIN32)
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "framescheduler.h"
+#include "timestamp.h"
+
+using namespace std;
+
+namespace {
+  //Left to yield away after sleeping, on top of the expected oversleep
+  const long long YieldNanos = 100000;
+
+  //Starting guess at how late a sleep wakes: a tick of the 1 ms timer. A
+  //stall past the cap is a hiccup, not the timer, and isn't yielded out.
+  const long long InitialOversleep = 1000000;
+  const long long MaxOversleep = 2000000;
+
+  //How far one wake moves the oversleep estimate
+  const long long OversleepStep = 20000;
+
+  //Refresh period assumed when following vsync, to wake for while a frame
+  //waits to be drawn
+  const long long RefreshPeriod = 1000000000LL / 60;
+
+  long long periodOf(double rate)
+  {
+    return rate > 0.0 ? (long long)(1.0e9 / rate) : 0;
+  }
+
+  //Moves a deadline that has passed on by a period; false if it hasn't
+  bool take(long long& next, long long period, long long now)
+  {
+    if(now < next)
+      return false;
+
+    next += period;
+
+    // More than a period behind: drop the missed frames.
+    if(next <= now)
+      next = now + period;
+
+    return true;
+  }
+}
+
+
+FrameScheduler::FrameScheduler()
+  : started(false), graphicsPeriod(0), hapticPeriod(0), nextGraphics(0),
+    nextHaptics(0), framePending(false), oversleep(InitialOversleep)
+{
+}
+
+
+FrameScheduler::~FrameScheduler()
+{
+#if defined(WIN32)
+  if(started)
+    timeEndPeriod(1);
+#endif
+}
+
+
+void FrameScheduler::start(double graphicsRate, double hapticRate)
+{
+#if defined(WIN32)
+  // Sleep(1) only sleeps a millisecond with the timer at its finest.
+  if(!started)
+    timeBeginPeriod(1);
+#endif
+
+  started = true;
+  graphicsPeriod = periodOf(graphicsRate);
+  hapticPeriod = periodOf(hapticRate);
+  nextGraphics = nextHaptics = timestampNow();
+  framePending = false;
+}
+
+
+int FrameScheduler::wait()
+{
+  bool vsync = graphicsPeriod == 0;
+
+  // Following vsync, the swap paces the loop only while frames get drawn.
+  if(!vsync || framePending)
+    sleepUntil(min(nextGraphics, nextHaptics));
+
+  long long now = timestampNow();
+  int due = 0;
+
+  if(vsync && !framePending)
+  {
+    nextGraphics = now + RefreshPeriod;
+    due |= Graphics;
+  }
+  else if(take(nextGraphics, vsync ? RefreshPeriod : graphicsPeriod, now)
+          && !framePending)
+    due |= Graphics;
+
+  if(due & Graphics)
+    framePending = true;
+
+  if(take(nextHaptics, hapticPeriod, now))
+    due |= Haptics;
+
+  return due;
+}
+
+
+void FrameScheduler::frameDrawn()
+{
+  framePending = false;
+}
+
+
+void FrameScheduler::sleepUntil(long long deadline)
+{
+  long long now = timestampNow();
+  long long sleep = deadline - now - oversleep - YieldNanos;
+
+  if(sleep > 0)
+  {
+    this_thread::sleep_for(chrono::nanoseconds(sleep));
+
+    // Three steps up for a wake later than the estimate and one down for
+    // an earlier one settle it where a quarter of wakes are later still:
+    // those few frames come in a little late, and the rest are yielded in
+    // on time without yielding through every outlier.
+    long long late = timestampNow() - now - sleep;
+
+    oversleep += late > oversleep ? 3 * OversleepStep : -OversleepStep;
+    oversleep = min(max(oversleep, 0LL), MaxOversleep);
+  }
+
+  while(timestampNow() < deadline)
+    this_thread::yield();
+}
@@ -0,0 +1,106 @@
+#include <cstring>
+#include <string>
+
+#if !defined(WIN32)
+#include <dlfcn.h>
+#endif
+
+#include "glfunctions.h"
+
+namespace GLExt {
+  CompressedTexImage2DProc compressedTexImage2D = NULL;
+  bool textureCompressionS3tc = false;
+
+  GenBuffersProc genBuffers = NULL;
+  DeleteBuffersProc deleteBuffers = NULL;
+  BindBufferProc bindBuffer = NULL;
+  BufferDataProc bufferData = NULL;
+  BufferSubDataProc bufferSubData = NULL;
+  bool vertexBufferObjects = false;
+}
+
+namespace {
+  void* getProcAddress(const char* name)
+  {
+#if defined(WIN32)
+    return (void*)wglGetProcAddress(name);
+#else
+    return dlsym(RTLD_DEFAULT, name);
+#endif
+  }
+
+  //Looks up a core entry point, falling back to its ARB name
+  void* getCoreOrArb(const char* name)
+  {
+    void* proc = getProcAddress(name);
+
+    if(proc == NULL)
+      proc = getProcAddress((std::string(name) + "ARB").c_str());
+
+    return proc;
+  }
+}
+
+
+bool hasGLExtension(const char* name)
+{
+  const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+  size_t length = strlen(name);
+
+  if(extensions == NULL)
+    return false;
+
+  // Match whole names only; one extension's name can prefix another's.
+  for(const char* p = strstr(extensions, name); p != NULL; p = strstr(p + 1, name))
+  {
+    if((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+      return true;
+  }
+
+  return false;
+}
+
+
+void loadGLFunctions()
+{
+  using namespace GLExt;
+
+  compressedTexImage2D = (CompressedTexImage2DProc)
+                         getCoreOrArb("glCompressedTexImage2D");
+
+  textureCompressionS3tc = compressedTexImage2D != NULL
+                           && hasGLExtension("GL_EXT_texture_compression_s3tc");
+
+  genBuffers = (GenBuffersProc)getCoreOrArb("glGenBuffers");
+  deleteBuffers = (DeleteBuffersProc)getCoreOrArb("glDeleteBuffers");
+  bindBuffer = (BindBufferProc)getCoreOrArb("glBindBuffer");
+  bufferData = (BufferDataProc)getCoreOrArb("glBufferData");
+  bufferSubData = (BufferSubDataProc)getCoreOrArb("glBufferSubData");
+
+  vertexBufferObjects = genBuffers != NULL && deleteBuffers != NULL &&
+                        bindBuffer != NULL && bufferData != NULL &&
+                        bufferSubData != NULL;
+}
+
+
+bool setSwapInterval(int interval)
+{
+#if defined(WIN32)
+  typedef BOOL (APIENTRY *SwapIntervalProc)(int interval);
+
+  SwapIntervalProc swapInterval = (SwapIntervalProc)
+                                  getProcAddress("wglSwapIntervalEXT");
+
+  return swapInterval != NULL && swapInterval(interval) != FALSE;
+#elif defined(__APPLE__)
+  return false;
+#else
+  // GLX_SGI_swap_control, which takes no 0.
+  typedef int (*SwapIntervalProc)(int interval);
+
+  SwapIntervalProc swapInterval = (SwapIntervalProc)
+                                  getProcAddress("glXSwapIntervalSGI");
+
+  return interval > 0 && swapInterval != NULL && swapInterval(interval) == 0;
+#endif
+}
@@ -0,0 +1,91 @@
+#include "hapticscene.h"
+
+using namespace std;
+
+HapticScene::HapticScene()
+{
+}
+
+
+int HapticScene::addShape(const HapticMaterial& material)
+{
+  Shape shape;
+
+  shape.id = hlGenShapes(1);
+  shape.material = material;
+  shape.mode = GL_TRIANGLES;
+  shape.dirty = true;
+
+  shapes.push_back(shape);
+  return int(shapes.size()) - 1;
+}
+
+
+void HapticScene::setGeometry(int shape, const float* positions,
+                              size_t vertexCount, GLenum mode)
+{
+  Shape& s = shapes[shape];
+
+  s.positions.assign(positions, positions + 3 * vertexCount);
+  s.mode = mode;
+  s.dirty = true;
+}
+
+
+void HapticScene::setMaterial(int shape, const HapticMaterial& material)
+{
+  shapes[shape].material = material;
+}
+
+
+void HapticScene::invalidate()
+{
+  for(size_t i = 0; i < shapes.size(); i++)
+    shapes[i].dirty = true;
+}
+
+
+void HapticScene::render()
+{
+  glEnableClientState(GL_VERTEX_ARRAY);
+
+  for(size_t i = 0; i < shapes.size(); i++)
+  {
+    Shape& s = shapes[i];
+    GLsizei vertexCount = GLsizei(s.positions.size() / 3);
+
+    if(vertexCount == 0)
+      continue;
+
+    // Material is frame state in HL, so it goes with every definition.
+    hlMaterialf(HL_FRONT_AND_BACK, HL_STIFFNESS, s.material.stiffness);
+    hlMaterialf(HL_FRONT_AND_BACK, HL_DAMPING, s.material.damping);
+    hlMaterialf(HL_FRONT_AND_BACK, HL_STATIC_FRICTION, s.material.staticFriction);
+    hlMaterialf(HL_FRONT_AND_BACK, HL_DYNAMIC_FRICTION, s.material.dynamicFriction);
+
+    // A surface HL knows to be still needs no proxy correction for motion.
+    hlHintb(HL_SHAPE_DYNAMIC_SURFACE_CHANGE, s.dirty ? HL_TRUE : HL_FALSE);
+
+    // Sizes the feedback buffer to the shape instead of HL's default.
+    hlHinti(HL_SHAPE_FEEDBACK_BUFFER_VERTICES, vertexCount);
+
+    hlBeginShape(HL_SHAPE_FEEDBACK_BUFFER, s.id);
+    glVertexPointer(3, GL_FLOAT, 0, &s.positions[0]);
+    glDrawArrays(s.mode, 0, vertexCount);
+    hlEndShape();
+
+    s.dirty = false;
+  }
+
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+
+void HapticScene::release()
+{
+  for(size_t i = 0; i < shapes.size(); i++)
+    hlDeleteShapes(shapes[i].id, 1);
+
+  shapes.clear();
+}
+
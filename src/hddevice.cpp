@@ -0,0 +1,155 @@
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+#include <HD/hd.h>
+#include <HDU/hduError.h>
+
+#include "hapticdevice.h"
+
+using namespace std;
+
+namespace {
+  //A scheduled callback as HDAPI sees it
+  struct ScheduledCallback
+  {
+    ServoHandle id;
+    ServoCallback callback;
+    void *userData;
+    HDSchedulerHandle hdHandle;
+    std::atomic<bool> finished; // HDAPI has retired it; don't unschedule
+  };
+
+  HDCallbackCode HDCALLBACK servoTrampoline(void *pUserData)
+  {
+    ScheduledCallback *scheduled = static_cast<ScheduledCallback *>(pUserData);
+
+    if(scheduled->callback(scheduled->userData))
+      return HD_CALLBACK_CONTINUE;
+
+    scheduled->finished.store(true);
+    return HD_CALLBACK_DONE;
+  }
+
+  //Takes a callback off the scheduler unless it already took itself off
+  void retire(ScheduledCallback *scheduled)
+  {
+    if(!scheduled->finished.load())
+      hdUnschedule(scheduled->hdHandle);
+
+    delete scheduled;
+  }
+}
+
+
+/*******************************************************************************
+ HDAPI backend. Owns the device handle; HLAPI finds it through
+ hdGetCurrentDevice().
+*******************************************************************************/
+class HDDevice : public HapticDevice {
+  public:
+    HDDevice() : hHD(HD_INVALID_HANDLE), nextId(1) {}
+    ~HDDevice() { shutdown(); }
+
+    bool init()
+    {
+      HDErrorInfo error;
+
+      hHD = hdInitDevice(HD_DEFAULT_DEVICE);
+
+      if(HD_DEVICE_ERROR(error = hdGetError()))
+      {
+        hduPrintError(stderr, &error, "Failed to initialize haptic device");
+        hHD = HD_INVALID_HANDLE;
+        return false;
+      }
+
+      return true;
+    }
+
+    void shutdown()
+    {
+      for(size_t i = 0; i < scheduled.size(); i++)
+        retire(scheduled[i]);
+
+      scheduled.clear();
+
+      if(hHD != HD_INVALID_HANDLE)
+        hdDisableDevice(hHD);
+
+      hHD = HD_INVALID_HANDLE;
+    }
+
+    void getPosition(double position[3])
+    {
+      hdGetDoublev(HD_CURRENT_POSITION, position);
+    }
+
+    void setForce(const double force[3])
+    {
+      hdSetDoublev(HD_CURRENT_FORCE, force);
+    }
+
+    double getUpdateRate()
+    {
+      HDdouble rate;
+      hdGetDoublev(HD_INSTANTANEOUS_UPDATE_RATE, &rate);
+      return rate;
+    }
+
+    double getNominalUpdateRate()
+    {
+      HDint rate = 1000;
+      hdGetIntegerv(HD_UPDATE_RATE, &rate);
+      return double(rate);
+    }
+
+    double getMaxStiffness()
+    {
+      HDdouble stiffness;
+      hdGetDoublev(HD_NOMINAL_MAX_STIFFNESS, &stiffness);
+      return stiffness;
+    }
+
+    ServoHandle schedule(ServoCallback callback, void *userData,
+                         unsigned short priority)
+    {
+      ScheduledCallback *entry = new ScheduledCallback;
+
+      entry->id = nextId++;
+      entry->callback = callback;
+      entry->userData = userData;
+      entry->finished.store(false);
+      entry->hdHandle = hdScheduleAsynchronous(servoTrampoline, entry, priority);
+      scheduled.push_back(entry);
+
+      return entry->id;
+    }
+
+    void unschedule(ServoHandle handle)
+    {
+      for(size_t i = 0; i < scheduled.size(); i++)
+      {
+        if(scheduled[i]->id == handle)
+        {
+          retire(scheduled[i]);
+          scheduled.erase(scheduled.begin() + i);
+          return;
+        }
+      }
+    }
+
+    void startScheduler() { hdStartScheduler(); }
+    void stopScheduler() { hdStopScheduler(); }
+
+  private:
+    HHD hHD;
+    ServoHandle nextId;
+    vector<ScheduledCallback *> scheduled;
+};
+
+
+HapticDevice* createHDDevice()
+{
+  return new HDDevice();
+}
@@ -1,7 +1,14 @@
 #include <assert.h>
-#include <fstream>
+#include <stddef.h>
+#include <string.h>
 
 #include "imageloader.h"
+#include "mappedfile.h"
+#include "cpufeatures.h"
+
+#if defined(NIMBLE_X86)
+#include <tmmintrin.h>
+#endif
 
 using namespace std;
 
@@ -15,163 +22,151 @@ Image::~Image() {
 
 namespace {
 	//Converts a four-character array to an integer, using little-endian form
-	int toInt(const char* bytes) {
-		return (int)(((unsigned char)bytes[3] << 24) |
-					 ((unsigned char)bytes[2] << 16) |
-					 ((unsigned char)bytes[1] << 8) |
-					 (unsigned char)bytes[0]);
+	int toInt(const unsigned char* bytes) {
+		return (int)(((unsigned int)bytes[3] << 24) |
+					 ((unsigned int)bytes[2] << 16) |
+					 ((unsigned int)bytes[1] << 8) |
+					 (unsigned int)bytes[0]);
 	}
 	
 	//Converts a two-character array to a short, using little-endian form
-	short toShort(const char* bytes) {
-		return (short)(((unsigned char)bytes[1] << 8) |
-					   (unsigned char)bytes[0]);
+	short toShort(const unsigned char* bytes) {
+		return (short)((bytes[1] << 8) | bytes[0]);
 	}
-	
-	//Reads the next four bytes as an integer, using little-endian form
-	int readInt(ifstream &input) {
-		char buffer[4];
-		input.read(buffer, 4);
-		return toInt(buffer);
+
+	//Converts one row of BGR pixels to RGB
+	typedef void (*SwizzleRow)(char* out, const unsigned char* in, int width);
+
+	void swizzleRowScalar(char* out, const unsigned char* in, int width) {
+		for(int col = 0; col < width; col++) {
+			out[0] = (char)in[2];
+			out[1] = (char)in[1];
+			out[2] = (char)in[0];
+			out += 3;
+			in += 3;
+		}
 	}
-	
-	//Reads the next two bytes as a short, using little-endian form
-	short readShort(ifstream &input) {
-		char buffer[2];
-		input.read(buffer, 2);
-		return toShort(buffer);
+
+#if defined(NIMBLE_X86)
+	//Five pixels per shuffle. Each step reads and writes 16 bytes but only
+	//advances 15, so the stray last byte is overwritten by the next step;
+	//the loop stops while a whole 16 bytes still fit in the row.
+	NIMBLE_TARGET("ssse3")
+	void swizzleRowSsse3(char* out, const unsigned char* in, int width) {
+		const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6,
+		                                   11, 10, 9, 14, 13, 12, 15);
+		int col = 0;
+
+		for(; col + 6 <= width; col += 5) {
+			__m128i bgr = _mm_loadu_si128((const __m128i*)(in + 3 * col));
+			_mm_storeu_si128((__m128i*)(out + 3 * col), _mm_shuffle_epi8(bgr, mask));
+		}
+
+		swizzleRowScalar(out + 3 * col, in + 3 * col, width - col);
+	}
+#endif
+
+	SwizzleRow pickSwizzle() {
+#if defined(NIMBLE_X86)
+		if(cpuHasSsse3())
+			return swizzleRowSsse3;
+#endif
+		return swizzleRowScalar;
 	}
-	
-	//Just like auto_ptr, but for arrays
-	template<class T>
-	class auto_array {
-  private:
-		T* array;
-		mutable bool isReleased;
-
-  public:
-		explicit auto_array(T* array_ = NULL): array(array_), isReleased(false) {}
-			
-			auto_array(const auto_array<T> &aarray) {
-				array = aarray.array;
-				isReleased = aarray.isReleased;
-				aarray.isReleased = true;
-			}
-			
-			~auto_array() {
-				if (!isReleased && array != NULL) {
-					delete[] array;
-				}
-			}
-			
-			T* get() const {return array;}
-			
-			T* release() {
-				isReleased = true;
-				return array;
-			}
-			
-			void reset(T* array_ = NULL) {
-				if (!isReleased && array != NULL) {
-					delete[] array;
-				}
-				array = array_;
-			}
-			
-			T& operator*() const {return *array;}
-			T* operator->() const {return array;}
-			T* operator+(int i) {return array + i;}
-			T& operator[](int i) {return array[i];}
-
-      void operator=(const auto_array<T> &aarray) {
-				if (!isReleased && array != NULL) {
-					delete[] array;
-				}
-				array = aarray.array;
-				isReleased = aarray.isReleased;
-				aarray.isReleased = true;
-			}
-  };
 }
 
 
 Image* loadBMP(const char* filename)
 {
-	ifstream input;
-	input.open(filename, ifstream::binary);
-	assert(!input.fail() || !"Could not find file");
-	char buffer[2];
-	input.read(buffer, 2);
-	assert(buffer[0] == 'B' && buffer[1] == 'M' || !"Not a bitmap file");
-	input.ignore(8);
-	int dataOffset = readInt(input);
+	MappedFile file;
+	bool opened = file.open(filename);
+	assert(opened || !"Could not find file");
+
+	const unsigned char* data = file.data();
+	size_t length = file.size();
+
+	if(!opened || length < 26)
+		return NULL;
+
+	assert((data[0] == 'B' && data[1] == 'M') || !"Not a bitmap file");
+
+	if(data[0] != 'B' || data[1] != 'M')
+		return NULL;
+
+	int dataOffset = toInt(data + 10);
 	
-	int headerSize = readInt(input),
+	int headerSize = toInt(data + 14),
 	    width = 0,
-	    height = 0;
+	    height = 0,
+	    bitsPerPixel = 0,
+	    compression = 0;
 
 	//Read the header
 	switch(headerSize)
   {
 		case 12://OS/2 V1
-			width = readShort(input);
-			height = readShort(input);
-			input.ignore(2);//skip "Planes"
-			assert(readShort(input) == 24 || !"Image is not 24 bits per pixel");
+			width = toShort(data + 18);
+			height = toShort(data + 20);
+			bitsPerPixel = toShort(data + 24);//after "Planes"
 			break;
 
 		case 40://V3
-			width = readInt(input);
-			height = readInt(input);
-			input.ignore(2);//skip "Planes"
-			assert(readShort(input) == 24 || !"Image is not 24 bits per pixel");
-			assert(readShort(input) == 0  || !"Image is compressed");
+			if(length < 54)
+				return NULL;
+			width = toInt(data + 18);
+			height = toInt(data + 22);
+			bitsPerPixel = toShort(data + 28);//after "Planes"
+			compression = toInt(data + 30);
+			assert(compression == 0 || !"Image is compressed");
 			break;
 
 		case 64://OS/2 V2
 			assert(!"Can't load OS/2 V2 bitmaps");
-			break;
+			return NULL;
 
 		case 108://Windows V4
 			assert(!"Can't load Windows V4 bitmaps");
-			break;
+			return NULL;
 
 		case 124://Windows V5
 			assert(!"Can't load Windows V5 bitmaps");
-			break;
+			return NULL;
 
 		default:
 			assert(!"Unknown bitmap format");
+			return NULL;
 	}
 
-	int bytesPerRow = ((3 * width + 3) / 4) * 4;
-	int size = bytesPerRow * height;
-	
-  //Read the data
-	auto_array<char> pixelStorage(new char[size]);
-	input.seekg(dataOffset, ios_base::beg);
-	input.read(pixelStorage.get(), size);
-	
-	//Get the data into the right format
-	auto_array<char> pixels(new char[width * height * 3]);
-  for(int row = 0; row < height; row++)
-  for(int col = 0; col < width; col++)
-  for(int c = 0; c < 3; c++)
-  {
-    pixels[3 * (width * row + col) + c] =
-    pixelStorage[bytesPerRow * row + 3 * col + (2 - c)];
-	}
-	
-	input.close();
-  pixelStorage.release();
-	return new Image(pixels.release(), width, height);
-}
-
-
-
+	assert(bitsPerPixel == 24 || !"Image is not 24 bits per pixel");
 
+	if(bitsPerPixel != 24 || compression != 0)
+		return NULL;
 
+	//A negative height means the rows are stored top to bottom
+	bool topDown = height < 0;
+	if(topDown)
+		height = -height;
 
+	size_t bytesPerRow = ((3 * (size_t)width + 3) / 4) * 4;
+	size_t size = bytesPerRow * (size_t)height;
 
+	assert((width > 0 && dataOffset > 0 && dataOffset + size <= length)
+	       || !"Bitmap is truncated");
 
+	if(width <= 0 || dataOffset <= 0 || (size_t)dataOffset + size > length)
+		return NULL;
+	
+	//Convert the rows straight out of the mapping into the final buffer
+	SwizzleRow swizzleRow = pickSwizzle();
+	const unsigned char* rows = data + dataOffset;
+	char* pixels = new char[(size_t)width * height * 3];
+
+	for(int row = 0; row < height; row++)
+	{
+		int sourceRow = topDown ? height - 1 - row : row;
+		swizzleRow(pixels + (size_t)3 * width * row,
+		           rows + bytesPerRow * sourceRow, width);
+	}
 
+	return new Image(pixels, width, height);
+}
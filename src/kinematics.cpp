@@ -0,0 +1,530 @@
+#include <algorithm>
+#include <cmath>
+
+#include "kinematics.h"
+#include "cpufeatures.h"
+#include "constants.h"
+
+#if defined(NIMBLE_X86)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+const char* const KinematicChannelNames[KinematicChannelCount] = {
+  "x", "y", "z", "vx", "vy", "vz", "ax", "ay", "az", "jx", "jy", "jz",
+  "speed", "curvature", "tremor"
+};
+
+namespace {
+  //Frames a central difference reaches on either side
+  const int Margin = 2;
+
+  //Frames dropped from the front of the history at a time
+  const size_t CompactStep = 1024;
+
+  //Samples drained from the live ring at a time
+  const size_t BatchSize = 1024;
+
+  //Below this speed (mm/s) the direction, and so the curvature, is noise
+  const float MinCurvatureSpeed = 1e-3f;
+
+  const double Pi = 3.14159265358979323846;
+
+  /*****************************************************************************
+   out[i] = sum of taps[k] * in[i + k - 2] for i in [0, n); in[-2] to
+   in[n + 1] must be readable.
+  *****************************************************************************/
+  void stencilScalar(const float* in, size_t n, const float taps[5], float* out)
+  {
+    for(size_t i = 0; i < n; i++)
+      out[i] = taps[0] * in[i - 2] + taps[1] * in[i - 1] + taps[2] * in[i]
+               + taps[3] * in[i + 1] + taps[4] * in[i + 2];
+  }
+
+  //|v| and |v x a| / |v|^3 for each frame
+  void motionScalar(const float* const v[3], const float* const a[3], size_t n,
+                    float* speed, float* curvature)
+  {
+    for(size_t i = 0; i < n; i++)
+    {
+      float cx = v[1][i] * a[2][i] - v[2][i] * a[1][i];
+      float cy = v[2][i] * a[0][i] - v[0][i] * a[2][i];
+      float cz = v[0][i] * a[1][i] - v[1][i] * a[0][i];
+      float s = sqrt(v[0][i] * v[0][i] + v[1][i] * v[1][i] + v[2][i] * v[2][i]);
+
+      speed[i] = s;
+      curvature[i] = s < MinCurvatureSpeed ? 0.0f
+                     : sqrt(cx * cx + cy * cy + cz * cz) / (s * s * s);
+    }
+  }
+
+  //Goertzel power |X_k|^2 of in[0, n) weighted by window, at every bin;
+  //coefficients holds 2 cos(2 pi k / N) per bin, lanes in groups of four
+  void goertzelScalar(const float* in, const float* window, int n,
+                      const float* coefficients, size_t lanes, float* power)
+  {
+    for(size_t k = 0; k < lanes; k++)
+    {
+      float c = coefficients[k], s1 = 0.0f, s2 = 0.0f;
+
+      for(int i = 0; i < n; i++)
+      {
+        float s = in[i] * window[i] + c * s1 - s2;
+        s2 = s1;
+        s1 = s;
+      }
+
+      power[k] = s1 * s1 + s2 * s2 - c * s1 * s2;
+    }
+  }
+
+#if defined(NIMBLE_X86)
+  NIMBLE_TARGET("sse2")
+  void stencilSse2(const float* in, size_t n, const float taps[5], float* out)
+  {
+    __m128 t0 = _mm_set1_ps(taps[0]), t1 = _mm_set1_ps(taps[1]);
+    __m128 t2 = _mm_set1_ps(taps[2]), t3 = _mm_set1_ps(taps[3]);
+    __m128 t4 = _mm_set1_ps(taps[4]);
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+      __m128 sum = _mm_mul_ps(t0, _mm_loadu_ps(in + i - 2));
+      sum = _mm_add_ps(sum, _mm_mul_ps(t1, _mm_loadu_ps(in + i - 1)));
+      sum = _mm_add_ps(sum, _mm_mul_ps(t2, _mm_loadu_ps(in + i)));
+      sum = _mm_add_ps(sum, _mm_mul_ps(t3, _mm_loadu_ps(in + i + 1)));
+      sum = _mm_add_ps(sum, _mm_mul_ps(t4, _mm_loadu_ps(in + i + 2)));
+      _mm_storeu_ps(out + i, sum);
+    }
+
+    stencilScalar(in + i, n - i, taps, out + i);
+  }
+
+  NIMBLE_TARGET("sse2")
+  void motionSse2(const float* const v[3], const float* const a[3], size_t n,
+                  float* speed, float* curvature)
+  {
+    const __m128 minSpeed = _mm_set1_ps(MinCurvatureSpeed);
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+      __m128 vx = _mm_loadu_ps(v[0] + i), vy = _mm_loadu_ps(v[1] + i);
+      __m128 vz = _mm_loadu_ps(v[2] + i);
+      __m128 ax = _mm_loadu_ps(a[0] + i), ay = _mm_loadu_ps(a[1] + i);
+      __m128 az = _mm_loadu_ps(a[2] + i);
+
+      __m128 cx = _mm_sub_ps(_mm_mul_ps(vy, az), _mm_mul_ps(vz, ay));
+      __m128 cy = _mm_sub_ps(_mm_mul_ps(vz, ax), _mm_mul_ps(vx, az));
+      __m128 cz = _mm_sub_ps(_mm_mul_ps(vx, ay), _mm_mul_ps(vy, ax));
+
+      __m128 s = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx),
+                             _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+      __m128 c = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx),
+                             _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)));
+
+      // Lanes too slow to have a direction divide by one and are masked out.
+      __m128 moving = _mm_cmpge_ps(s, minSpeed);
+      __m128 s3 = _mm_mul_ps(_mm_mul_ps(s, s), s);
+      s3 = _mm_or_ps(_mm_and_ps(moving, s3), _mm_andnot_ps(moving, _mm_set1_ps(1.0f)));
+
+      _mm_storeu_ps(speed + i, s);
+      _mm_storeu_ps(curvature + i, _mm_and_ps(moving, _mm_div_ps(c, s3)));
+    }
+
+    const float* vt[3] = {v[0] + i, v[1] + i, v[2] + i};
+    const float* at[3] = {a[0] + i, a[1] + i, a[2] + i};
+
+    motionScalar(vt, at, n - i, speed + i, curvature + i);
+  }
+
+  //Four bins per register; the same input feeds every lane
+  NIMBLE_TARGET("sse2")
+  void goertzelSse2(const float* in, const float* window, int n,
+                    const float* coefficients, size_t lanes, float* power)
+  {
+    for(size_t k = 0; k < lanes; k += 4)
+    {
+      __m128 c = _mm_loadu_ps(coefficients + k);
+      __m128 s1 = _mm_setzero_ps(), s2 = _mm_setzero_ps();
+
+      for(int i = 0; i < n; i++)
+      {
+        __m128 s = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(in[i] * window[i]),
+                                         _mm_mul_ps(c, s1)), s2);
+        s2 = s1;
+        s1 = s;
+      }
+
+      __m128 p = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(s1, s1), _mm_mul_ps(s2, s2)),
+                            _mm_mul_ps(c, _mm_mul_ps(s1, s2)));
+      _mm_storeu_ps(power + k, p);
+    }
+  }
+#endif
+
+  typedef void (*Stencil)(const float*, size_t, const float[5], float*);
+  typedef void (*Motion)(const float* const[3], const float* const[3], size_t,
+                         float*, float*);
+  typedef void (*Goertzel)(const float*, const float*, int, const float*,
+                           size_t, float*);
+
+  struct Kernels
+  {
+    Stencil stencil;
+    Motion motion;
+    Goertzel goertzel;
+  };
+
+  Kernels pickKernels(bool sse2)
+  {
+#if defined(NIMBLE_X86)
+    if(sse2)
+    {
+      Kernels simd = {stencilSse2, motionSse2, goertzelSse2};
+      return simd;
+    }
+#else
+    (void)sse2;
+#endif
+    Kernels scalar = {stencilScalar, motionScalar, goertzelScalar};
+    return scalar;
+  }
+
+  //Appends n uninitialised frames to a channel and returns the first
+  float* extend(vector<float>& channel, size_t n)
+  {
+    size_t first = channel.size();
+
+    channel.resize(first + n);
+    return n > 0 ? &channel[first] : NULL;
+  }
+}
+
+
+void KinematicFeatures::clear()
+{
+  startTime = 0;
+
+  for(int c = 0; c < KinematicChannelCount; c++)
+    channel[c].clear();
+}
+
+
+void KinematicFeatures::keepLast(size_t keep)
+{
+  size_t n = size();
+
+  if(n <= keep)
+    return;
+
+  startTime += (long long)floor(double(n - keep) * 1.0e9 / rate + 0.5);
+
+  for(int c = 0; c < KinematicChannelCount; c++)
+    channel[c].erase(channel[c].begin(), channel[c].begin() + (n - keep));
+}
+
+
+KinematicPipeline::KinematicPipeline(double frameRate, int tremorWindow,
+                                     double bandLow, double bandHigh)
+  : rate(frameRate), window(max(tremorWindow, 4)), sse2(cpuHasSse2())
+{
+  // Bins whose centre lies in the band; the DC and Nyquist bins never do.
+  int first = max(int(ceil(bandLow * window / rate)), 1);
+  int last = min(int(floor(bandHigh * window / rate)), window / 2 - 1);
+
+  for(int k = first; k <= last; k++)
+    coefficients.push_back(float(2.0 * cos(2.0 * Pi * k / window)));
+
+  while(coefficients.size() % 4 != 0)
+    coefficients.push_back(0.0f);
+
+  // Periodic Hann. By Parseval, the band holds 2 sum |X_k|^2 / (N sum w^2)
+  // of the mean square.
+  double sum2 = 0.0;
+
+  hann.resize(window);
+
+  for(int i = 0; i < window; i++)
+  {
+    hann[i] = float(0.5 - 0.5 * cos(2.0 * Pi * i / window));
+    sum2 += double(hann[i]) * hann[i];
+  }
+
+  bandScale = float(2.0 / (window * sum2));
+  bandBins = last >= first ? size_t(last - first + 1) : 0;
+  power.resize(coefficients.size());
+
+  reset();
+}
+
+
+void KinematicPipeline::reset()
+{
+  started = false;
+  startTime = 0;
+  nextFrame = 0;
+  previousTime = 0;
+  done = 0;
+
+  for(int k = 0; k < 3; k++)
+  {
+    previous[k] = 0.0;
+    position[k].clear();
+    velocity[k].clear();
+  }
+}
+
+
+void KinematicPipeline::push(const TrajectorySample* samples, size_t count,
+                             KinematicFeatures& out)
+{
+  for(size_t i = 0; i < count; i++)
+    add(samples[i].position, samples[i].time, out);
+
+  emit(out);
+}
+
+
+void KinematicPipeline::push(const DeviceState* samples, size_t count,
+                             KinematicFeatures& out)
+{
+  for(size_t i = 0; i < count; i++)
+    add(samples[i].position, samples[i].time, out);
+
+  emit(out);
+}
+
+
+void KinematicPipeline::finish(KinematicFeatures& out)
+{
+  if(started && !position[0].empty())
+  {
+    float last[3] = {position[0].back(), position[1].back(), position[2].back()};
+
+    for(int i = 0; i < Margin; i++)
+      addFrame(last);
+
+    emit(out);
+  }
+
+  reset();
+}
+
+
+/*******************************************************************************
+ Interpolates the frames that fall between the previous sample and this one.
+*******************************************************************************/
+void KinematicPipeline::add(const double sample[3], long long time,
+                            KinematicFeatures& out)
+{
+  const double period = 1.0e9 / rate;
+
+  if(!started)
+  {
+    float first[3] = {float(sample[0]), float(sample[1]), float(sample[2])};
+
+    started = true;
+    startTime = time;
+    out.rate = rate;
+
+    if(out.size() == 0)
+      out.startTime = time;
+
+    // The first position stands in for the frames before it.
+    for(int i = 0; i < Margin; i++)
+      addFrame(first);
+
+    done = Margin;
+  }
+  else if(time < previousTime)
+    return; // out of order; keep the grid monotonic
+
+  for(;;)
+  {
+    double frameTime = double(startTime) + double(nextFrame) * period;
+
+    if(frameTime > double(time))
+      break;
+
+    double span = double(time - previousTime);
+    double u = span > 0.0 && nextFrame > 0 ? (frameTime - previousTime) / span : 1.0;
+    float p[3];
+
+    for(int k = 0; k < 3; k++)
+      p[k] = float(previous[k] + u * (sample[k] - previous[k]));
+
+    addFrame(p);
+    nextFrame++;
+  }
+
+  for(int k = 0; k < 3; k++)
+    previous[k] = sample[k];
+
+  previousTime = time;
+}
+
+
+void KinematicPipeline::addFrame(const float p[3])
+{
+  for(int k = 0; k < 3; k++)
+  {
+    position[k].push_back(p[k]);
+    velocity[k].push_back(0.0f);
+  }
+}
+
+
+/*******************************************************************************
+ Computes the features of every frame that has two frames after it.
+*******************************************************************************/
+void KinematicPipeline::emit(KinematicFeatures& out)
+{
+  const size_t size = position[0].size();
+
+  if(size < done + Margin + 1)
+    return;
+
+  const Kernels kernels = pickKernels(sse2);
+  const size_t n = size - Margin - done;
+  const float r = float(rate);
+  const float velocityTaps[5] = {0.0f, -0.5f * r, 0.0f, 0.5f * r, 0.0f};
+  const float accelerationTaps[5] = {0.0f, r * r, -2.0f * r * r, r * r, 0.0f};
+  const float jerkTaps[5] = {-0.5f * r * r * r, r * r * r, 0.0f,
+                             -r * r * r, 0.5f * r * r * r};
+
+  const float* v[3];
+  const float* a[3];
+
+  for(int k = 0; k < 3; k++)
+  {
+    const float* p = &position[k][done];
+    float* pOut = extend(out.channel[KinematicPositionX + k], n);
+    float* vOut = extend(out.channel[KinematicVelocityX + k], n);
+    float* aOut = extend(out.channel[KinematicAccelerationX + k], n);
+    float* jOut = extend(out.channel[KinematicJerkX + k], n);
+
+    copy(p, p + n, pOut);
+    kernels.stencil(p, n, velocityTaps, vOut);
+    kernels.stencil(p, n, accelerationTaps, aOut);
+    kernels.stencil(p, n, jerkTaps, jOut);
+
+    copy(vOut, vOut + n, &velocity[k][done]);
+    v[k] = vOut;
+    a[k] = aOut;
+  }
+
+  kernels.motion(v, a, n, extend(out.channel[KinematicSpeed], n),
+                 extend(out.channel[KinematicCurvature], n));
+
+  // Tremor over the window ending at each frame; before a full window has
+  // passed, the missing frames count as zero.
+  float* tremor = extend(out.channel[KinematicTremor], n);
+
+  for(size_t i = 0; i < n; i++)
+  {
+    size_t frame = done + i;
+    size_t first = frame + 1 >= size_t(window) ? frame + 1 - window : 0;
+    int length = int(frame + 1 - first);
+    const float* hannTail = &hann[window - length];
+    double energy = 0.0;
+
+    for(int k = 0; k < 3 && bandBins > 0; k++)
+    {
+      kernels.goertzel(&velocity[k][first], hannTail, length, &coefficients[0],
+                       coefficients.size(), &power[0]);
+
+      for(size_t b = 0; b < bandBins; b++)
+        energy += power[b];
+    }
+
+    tremor[i] = float(sqrt(energy * bandScale));
+  }
+
+  done += n;
+  compact();
+}
+
+
+//Drops frames no later feature reaches back to
+void KinematicPipeline::compact()
+{
+  size_t keep = size_t(window) + Margin;
+
+  if(done < keep + CompactStep)
+    return;
+
+  size_t drop = done - keep;
+
+  for(int k = 0; k < 3; k++)
+  {
+    position[k].erase(position[k].begin(), position[k].begin() + drop);
+    velocity[k].erase(velocity[k].begin(), velocity[k].begin() + drop);
+  }
+
+  done -= drop;
+}
+
+
+void extractKinematics(const TrajectorySample* samples, size_t count,
+                       KinematicFeatures& out)
+{
+  KinematicPipeline pipeline(Constant::FeatureRate, Constant::TremorWindow,
+                             Constant::TremorBandLow, Constant::TremorBandHigh);
+
+  out.clear();
+  pipeline.push(samples, count, out);
+  pipeline.finish(out);
+}
+
+
+/*******************************************************************************
+ LiveKinematics
+*******************************************************************************/
+LiveKinematics::LiveKinematics()
+  : pipeline(Constant::FeatureRate, Constant::TremorWindow,
+             Constant::TremorBandLow, Constant::TremorBandHigh),
+    historyFrames(0), frames(0), latestTime(0)
+{
+}
+
+
+void LiveKinematics::init(size_t ringCapacity, size_t keepFrames)
+{
+  ring.reset(ringCapacity);
+  batch.resize(BatchSize);
+  historyFrames = keepFrames;
+}
+
+
+size_t LiveKinematics::update()
+{
+  size_t count, drained = 0;
+
+  while((count = ring.drain(&batch[0], batch.size())) > 0)
+  {
+    size_t before = history.size();
+
+    pipeline.push(&batch[0], count, history);
+    frames += (long long)(history.size() - before);
+    latestTime = batch[count - 1].time;
+    drained += count;
+  }
+
+  // Trim in steps so the erase is paid once per many frames.
+  if(history.size() > 2 * historyFrames)
+    history.keepLast(historyFrames);
+
+  return drained;
+}
+
+
+void LiveKinematics::clear()
+{
+  // Samples already in the ring belong to the new run.
+  pipeline.reset();
+  history.clear();
+  frames = 0;
+  latestTime = 0;
+}
@@ -9,6 +9,7 @@
 #include <cmath>
 #include <cassert>
 #include <ctime>
+#include <cstring>
 
 #include <iostream>
 #include <iomanip>
@@ -16,7 +17,9 @@
 #include <fstream>
 #include <list>
 #include <limits>
+#include <memory>
 #include <string>
+#include <thread>
 
 //playback
 #include <cstdio>
@@ -44,6 +47,26 @@
 
 #include "imageloader.h"
 #include "constants.h"
+#include "devicestate.h"
+#include "recorder.h"
+#include "hapticdevice.h"
+#include "servoprofiler.h"
+#include "timestamp.h"
+#include "patterncache.h"
+#include "glfunctions.h"
+#include "renderer.h"
+#include "capturefanout.h"
+#include "traceoverlay.h"
+#include "hapticscene.h"
+#include "distancefield.h"
+#include "servohandoff.h"
+#include "servoparams.h"
+#include "forcefield.h"
+#include "forceeffects.h"
+#include "trajectoryscore.h"
+#include "skillmonitor.h"
+#include "affine.h"
+#include "framescheduler.h"
 
 using namespace std;
 
@@ -58,49 +81,92 @@ HLuint gHapticsStringShapeId = 0;
 HLuint gPlaneShapeId = 0;;
 static GLfloat linePos[] = {0, 0, 0};
 static double gLineShapeSnapDistance = 0.0;
-static HHD hHD = HD_INVALID_HANDLE;
+static HapticDevice *device = NULL;
 static HHLRC hHLRC = 0;
 
-/* Shape id for shapes we will render haptically. */
-HLuint gBoxesShapeId;
+/* Shapes we will render haptically. */
+HapticScene hapticScene;
+int gWritingSurface;
 
 GLfloat mass_weight = 0.0; // default weight
 GLfloat k_damping;
 GLfloat spring_stiffness;
-hduVector3Dd position;
 
 #define CURSOR_SIZE_PIXELS 30
 static double gCursorScale;
-static GLuint gCursorDisplayList = 0;
-int menuSelection;
-
+static SceneRenderer renderer;
+static FrameScheduler frameScheduler;
 
 /*******************************************************************************
-Point mass structure, represents a draggable mass.
+ The device as one graphics frame sees it, read from HLAPI once at the start
+ of the frame and shared by everything drawn in it. What is worked out from
+ it is only worked out again when its inputs change.
 *******************************************************************************/
-struct PointMass
+struct FrameState
 {
-  hduVector3Dd m_position;
-  hduVector3Dd m_velocity;
-  HDdouble m_mass;
-  HDdouble m_kStiffness;
-  HDdouble m_kDamping;
+  HLdouble proxyTransform[16];  // world coordinates
+  HLdouble devicePosition[3];   // world coordinates
+  HLdouble cursorTransform[16]; // proxy flattened onto z=0, scaled to the cursor
+  double cursorScale;           // gCursorScale cursorTransform was made with
+  int windowWidth, windowHeight;
+  long long skillTime;          // publishTime of the estimate skillText shows
+  string skillText;
 };
- 
-PointMass pointMass;
+
+static FrameState frameState;
+int menuSelection;
+
+// Every pattern is decoded at startup and kept as a texture, indexed by
+// menu selection; 0 until uploaded.
+PatternCache patternCache;
+GLuint patternTextures[PatternCount + 1];
+const int PatternMenuBase = 100; // context menu keys for the patterns
+
+// Half size of the pattern as drawn, at 4:3
+const float PatternHalfWidth = 2, PatternHalfHeight = PatternHalfWidth*0.75f;
+
+// Network the skill monitor scores the live exercise with
+const char SkillModelFile[] = "models/skill.mlp";
+
+// The guidance force pulls toward the current pattern's stroke. Its field is
+// built by the pattern cache workers, picked up once the pattern is selected
+// and handed to the servo loop together with the workspace mapping.
+shared_ptr<const DistanceField> patternField;
+bool patternFieldPending = false; // selected pattern's field not yet built
+double workspaceToWorld[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+double worldToWorkspace[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+ServoHandoff<PatternGuidance> patternGuidance;
+
+// Sessions are scored as soon as they stop, against the pattern they were
+// drawn over.
+string sessionPath;
+
+// Points the device is pulled toward once near, such as the ratio points
+// set from the menu. The servo loop gets them indexed, as a whole set.
+vector<Attractor> anchors;
+int ratioPointAnchor[2] = {-1, -1}; // index into anchors, -1 while unset
+ServoHandoff<AttractorField> anchorField;
+
+
+// The draggable point mass. Only the servo thread touches it; its settings
+// come through effectParameters.
+EffectState pointMass;
+
+// The menu's effect settings, picked up by the servo loop between ticks.
+ServoParameters effectParameters(Constant::EffectRampSeconds);
 HLuint effect = NULL;
 
-/*******************************************************************************
- ANN: Spatio-temporal device state for artificial neural network analysis
-*******************************************************************************/
-struct DeviceState
-{
-  HDdouble position[3];
-  LARGE_INTEGER counter;
-};
+// Servo samples go to the recorder while a session runs, and to the trace
+// overlay and the skill monitor all the time.
+CaptureFanout captureFanout;
+SessionRecorder recorder;
+TraceOverlay trace;
+SkillMonitor skillMonitor;
+ServoHandle deviceStateHandle = 0;
 
-list<DeviceState> deviceStateList;
-HDSchedulerHandle deviceStateHandle = NULL;
+// Servo callback timing; budgets are fractions of one tick.
+ServoProbe forceProbe("computeForceCB", 0.5);
+ServoProbe captureProbe("DeviceStateCallback", 0.1);
 
 // Function prototypes
 void glutDisplay(void);
@@ -110,27 +176,55 @@ void glutContextMenu(int);
 
 void exitHandler(void);
 
+void startRecording();
+void stopRecording();
+bool DeviceStateCallback(void *pUserData);
+
 void getPatternSelection();
 void loadPattern();
+bool selectPattern(int selection);
+void uploadPattern(int selection, bool wait);
+void adoptPatternField(bool wait);
+void publishGuidance();
+void scoreSession(const string& path);
+void setRatioPoint(int point);
+void clearRatioPoints();
 void attachContextMenu();
 
 void initGL();
 void initHD();
 void initScene();
 void drawSceneHaptics();
+void captureFrameState();
 void drawSceneGraphics();
 void drawCursor_Air();
+void drawSkillEstimate();
 void updateWorkspace();
 void initRendering();
 
-GLuint loadTexture(Image* image);
-
 /*******************************************************************************
  Initializes GLUT for displaying a simple haptic scene.
 *******************************************************************************/
 int main(int argc, char *argv[])
 {
   glutInit(&argc, argv);
+
+  // --fps sets the graphics rate, 60 or 120 say, or vsync to draw once a
+  // refresh.
+  double graphicsRate = Constant::GraphicsRate;
+  bool vsync = false;
+
+  for(int i = 1; i + 1 < argc; i++)
+  {
+    if(strcmp(argv[i], "--fps") == 0)
+    {
+      vsync = strcmp(argv[i + 1], "vsync") == 0;
+      graphicsRate = vsync ? 0.0 : atof(argv[i + 1]);
+
+      if(!vsync && graphicsRate <= 0.0)
+        graphicsRate = Constant::GraphicsRate;
+    }
+  }
     
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 
@@ -142,6 +236,19 @@ int main(int argc, char *argv[])
   glutInitWindowPosition((screenWidth-800)/2,(screenHeight-600)/2);
   glutCreateWindow("Nimble");
 
+  if(vsync && !setSwapInterval(1))
+  {
+    cout << "NO VSYNC CONTROL: drawing at " << Constant::GraphicsRate << " Hz"
+         << endl;
+    graphicsRate = Constant::GraphicsRate;
+  }
+
+  // Build every pattern texture while the user picks one, compressed when
+  // the driver can sample S3TC.
+  loadGLFunctions();
+  patternCache.preload("patterns/", GLExt::textureCompressionS3tc ? TextureDXT1
+                                                                   : TextureRGB8);
+
   // load pattern
   getPatternSelection();
   loadPattern();
@@ -155,6 +262,7 @@ int main(int argc, char *argv[])
   
   atexit(exitHandler); // Provide a cleanup routine for application exit.
   initScene(); // Initializes OpenGL and Haptic scenes
+  frameScheduler.start(graphicsRate, Constant::HapticFrameRate);
   glutMainLoop(); // Start main graphics loop
 
   return 0;
@@ -166,14 +274,23 @@ int main(int argc, char *argv[])
 *******************************************************************************/
 void initScene()
 {
+  // The sample clock must be settled before the servo thread reads it.
+  calibrateTimestamps();
+  cout << "Timestamps from " << timestampSource() << endl;
+
   initGL();
   initHD();
 }
 
 
-// write the devices states to file with the given file name.
-void writeDeviceStatesToFile()
+/*******************************************************************************
+ Opens a new session file and starts streaming device states into it.
+*******************************************************************************/
+void startRecording()
 {
+  if(recorder.isRecording())
+    return;
+
   //TODO: incorperate patient id into name
   ostringstream fileName;
   time_t rawtime = time(NULL);
@@ -187,86 +304,116 @@ void writeDeviceStatesToFile()
 
   fileDir.append(fileName.str());
 
-  ofstream dsFile(fileDir.c_str());
+  SessionInfo info;
 
-  if(dsFile.is_open())
-  {
-    dsFile.clear();
-
-    dsFile << "%YAML 1.2" << endl
-           << "---" << endl
-           << "patient-id: " << endl //TODO: patient ID
-           << "date: " << asctime(timeInfo) << endl //TODO: format to canonical YAML timestamp
-           << "location: " << endl;
-
-    dsFile << "pattern: " << endl
-           << "  type: ";
-
-    if(menuSelection < 4)
-      dsFile << "complexity" << endl;
-    else if(menuSelection < 7)
-      dsFile << "straight to Curvy" << endl;
-    else if(menuSelection < 10)
-      dsFile << "width" << endl;
-
-    dsFile << "  level: ";
-
-    if(menuSelection%3 == 1)
-      dsFile << "1" << endl;
-    else if(menuSelection%3 == 2)
-      dsFile << "2" << endl;
-    else if(menuSelection%3 == 0)
-      dsFile << "3" << endl;
-    
-    //workspace in the Air/Desk 
-    dsFile << "workspace: in air\n"
-           << "coordinate-space: world\n";
+  info.patientId = ""; //TODO: patient ID
+  info.location = "";
 
-    double countTime;
-    LARGE_INTEGER freq;
-    LONGLONG counterEpoch = deviceStateList.front().counter.QuadPart;
+  if(menuSelection < 4)
+    info.patternType = "complexity";
+  else if(menuSelection < 7)
+    info.patternType = "straight to Curvy";
+  else if(menuSelection < 10)
+    info.patternType = "width";
 
-    QueryPerformanceFrequency(&freq);
+  info.patternLevel = (menuSelection%3 == 0) ? 3 : menuSelection%3;
 
-    countTime = (double(deviceStateList.back().counter.QuadPart - counterEpoch)
-                 *1.0e3) / (double(freq.QuadPart));
+  //workspace in the Air/Desk 
+  info.workspace = "in air";
 
+  // Where the pattern lay under the device, so the session can be scored.
+  info.patternFile = patternFile(menuSelection);
 
-    dsFile << "total-time: " << countTime << endl
-           << "data: " << endl
-           << "- [x, y, z, time]" << endl;
-    
-    list<DeviceState>::iterator it;
+  if(patternFieldPending)
+    adoptPatternField(true);
 
-    for(it = deviceStateList.begin(); it != deviceStateList.end(); it++)
-    {
-      countTime = (double(it->counter.QuadPart - counterEpoch)*1.0e3)
-                  /(double(freq.QuadPart));
-        
-      dsFile << fixed << setprecision(4) << "- ["
-             << it->position[0] << ", " 
-             << it->position[1] << ", "
-             << it->position[2] << ", "
-             << setprecision(1) << countTime << "]" << endl;
-    }
-    
-    deviceStateList.clear();
+  if(patternField)
+  {
+    PatternGuidance mapping;
 
-    dsFile.close();
+    mapping.field = patternField;
+    mapping.setMapping(workspaceToWorld, PatternHalfWidth, PatternHalfHeight);
+    memcpy(info.patternTransform, mapping.toPixel, sizeof(info.patternTransform));
+    info.hasPatternTransform = true;
   }
-  else
+
+  // The ring only has to absorb the samples produced while the writer
+  // thread is between batches.
+  double updateRate = device->getNominalUpdateRate();
+
+  if(!recorder.start(fileDir, info,
+                     size_t(updateRate) * Constant::RecordBufferSeconds))
+  {
     cout << "CAN'T OPEN OUTPUT FILE: " << fileDir << endl;
+    return;
+  }
+
+  // The trace and the features follow the session being recorded.
+  trace.clear();
+  skillMonitor.clear();
+  captureFanout.attach(&recorder.samples());
+  sessionPath = fileDir;
 }
 
 
 /*******************************************************************************
- GLUT callback for redrawing the view.
+ Detaches the recorder from the servo samples, then flushes and closes the
+ session file.
+*******************************************************************************/
+void stopRecording()
+{
+  if(!recorder.isRecording())
+    return;
+
+  captureFanout.detach(&recorder.samples());
+  recorder.stop();
+  scoreSession(sessionPath);
+}
+
+
+/*******************************************************************************
+ Scores a finished session against the pattern it was drawn over, from its
+ binary file.
+*******************************************************************************/
+void scoreSession(const string& path)
+{
+  TrajectoryReader reader;
+
+  if(!reader.open(binarySessionPath(path).c_str()))
+    return;
+
+  const SessionInfo& info = reader.info();
+  shared_ptr<const PatternScorer> scorer;
+
+  if(!info.hasPatternTransform || reader.size() == 0 ||
+     !patternCache.getScorer(patternSelection(info.patternFile), true, scorer) ||
+     !scorer)
+    return;
+
+  vector<TrajectorySample> samples(reader.size());
+
+  for(size_t i = 0; i < samples.size(); i++)
+    samples[i] = reader.sample(i);
+
+  TrajectoryScore score = scorer->score(&samples[0], samples.size(),
+                                        info.patternTransform,
+                                        Constant::ScoreReach);
+
+  cout << "Session score for " << path << ":" << endl;
+  printTrajectoryScore(stdout, score);
+}
+
+
+/*******************************************************************************
+ GLUT callback for redrawing the view. The haptic frame runs from glutIdle on
+ its own cadence.
 *******************************************************************************/
 void glutDisplay()
 {   
-  drawSceneHaptics();
+  captureFrameState();
   drawSceneGraphics();
   glutSwapBuffers();
+  frameScheduler.frameDrawn();
 }
 
 
@@ -282,6 +429,8 @@ void glutReshape(int w, int h)
   double nearDist, farDist, aspect;
 
   glViewport(0, 0, w, h);
+  frameState.windowWidth = w;
+  frameState.windowHeight = h;
 
   // Compute the viewing parameters based on a fixed fov and viewing
   // a canonical box centered at the origin.
@@ -304,8 +453,9 @@ void glutReshape(int w, int h)
 
 
 /*******************************************************************************
- GLUT callback for idle state.  Use this as an opportunity to request a redraw.
- Checks for HLAPI errors that have occurred since the last idle check.
+ GLUT callback for idle state. Sleeps until the next haptic or graphics frame
+ is due, then runs the haptic frame or requests a redraw. Checks for HLAPI
+ errors that have occurred since the last idle check.
 *******************************************************************************/
 void glutIdle()
 {
@@ -315,7 +465,28 @@ void glutIdle()
     if(error.errorCode == HL_DEVICE_ERROR)
       hduPrintError(stderr, &error.errorInfo,"Error during haptic rendering\n");
 
-  glutPostRedisplay();
+  // Upload patterns as the workers finish them, one per frame at most.
+  for(int i = 1; i <= PatternCount; i++)
+  {
+    if(patternTextures[i] == 0)
+    {
+      uploadPattern(i, false);
+
+      if(patternTextures[i] != 0)
+        break;
+    }
+  }
+
+  if(patternFieldPending)
+    adoptPatternField(false);
+
+  int due = frameScheduler.wait();
+
+  if(due & FrameScheduler::Haptics)
+    drawSceneHaptics();
+
+  if(due & FrameScheduler::Graphics)
+    glutPostRedisplay();
 }
 
 
@@ -348,6 +519,9 @@ void initGL()
   glLightfv(GL_LIGHT0, GL_DIFFUSE, light0_diffuse);
   glLightfv(GL_LIGHT0, GL_POSITION, light0_direction);
   glEnable(GL_LIGHT0);   
+
+  // Upload the pattern plane and cursor meshes once.
+  renderer.init();
 }
 
 
@@ -356,46 +530,35 @@ void initGL()
 *******************************************************************************/
 void HLCALLBACK computeForceCB(HDdouble force[3], HLcache *cache, void *userdata)
 {
-  PointMass *pPointMass = static_cast<PointMass *>(userdata);
+  ServoTimer timer(forceProbe);
+  EffectState *pState = static_cast<EffectState *>(userdata);
+  EffectInput in;
 
-  // Get the time delta since the last update.
-  HDdouble instRate;
-  hdGetDoublev(HD_INSTANTANEOUS_UPDATE_RATE, &instRate);
-  HDdouble deltaT = 1.0 / instRate;
-    
-  // Get the current proxy position from the state cache.
+  // Get the current proxy and device positions from the state cache.
   // Note that the effect state cache is maintained in workspace coordinates,
   // so we don't need to do any transformations in using the proxy
   // position for computing forces.
-  hduVector3Dd proxyPos;
+  hlCacheGetDoublev(cache, HL_PROXY_POSITION, in.proxy);
+  hlCacheGetDoublev(cache, HL_DEVICE_POSITION, in.device);
 
-  hlCacheGetDoublev(cache, HL_PROXY_POSITION, proxyPos);
+  // The effect settings for this tick, eased toward any new menu choice.
+  // The loop runs at a fixed rate, so every tick is the same step.
+  in.params = &effectParameters.update(pState->tickSeconds, in.paramsChanged);
+  in.guidance = patternGuidance.acquire();
+  in.anchors = anchorField.acquire();
 
-  // Compute inertial force based on pulling the point mass around by a spring.
-  hduVector3Dd springForce = pPointMass->m_kStiffness * (proxyPos - pPointMass->m_position);
-  hduVector3Dd damperForce = -pPointMass->m_kDamping * pPointMass->m_velocity;
-  hduVector3Dd inertiaForce = springForce + damperForce;
-      
-  // Perform Euler integration of the point mass state.
-  hduVector3Dd acceleration = inertiaForce / pPointMass->m_mass;
-  pPointMass->m_velocity += acceleration * deltaT;    
-  pPointMass->m_position += pPointMass->m_velocity * deltaT;
-                                   
-  // gravity well-------------------------------------------------------
-  hdGetDoublev(HD_CURRENT_POSITION,position);
-  hduVector3Dd gravityWellCenter(0.0,0.0,0.0); //coord doesn't work yet
-  const float k = k_damping;
-  hduVector3Dd forceVector = (gravityWellCenter-position)*k;
-    
-  force[0] += forceVector[0];
-  force[1] += forceVector[1];
-  force[2] += forceVector[2];
-  // gravity well--------------------------------------------------------
+  // The inertia effect plus the pulls toward the stroke and the ratio
+  // points, in one kernel built for whichever of them are in play.
+  double effectForce[3];
+
+  selectEffectKernel(in)(*pState, in, effectForce);
+
+  patternGuidance.release();
+  anchorField.release();
 
-  // Send the opposing force to the device.
-  force[0] += -inertiaForce[0];
-  force[1] += -inertiaForce[1];
-  force[2] += -inertiaForce[2];
+  force[0] += effectForce[0];
+  force[1] += effectForce[1];
+  force[2] += effectForce[2];
 }
 
 
@@ -404,14 +567,14 @@ void HLCALLBACK computeForceCB(HDdouble force[3], HLcache *cache, void *userdata
 *******************************************************************************/
 void HLCALLBACK startEffectCB(HLcache *cache, void *userdata)
 {
-  PointMass *pPointMass = static_cast<PointMass *>(userdata);
+  EffectState *pState = static_cast<EffectState *>(userdata);
+  hduVector3Dd proxyPos;
     
   fprintf(stdout, "Custom effect started\n");
 
   // Initialize the position of the mass to be at the proxy position.
-  hlCacheGetDoublev(cache, HL_PROXY_POSITION, pPointMass->m_position);
-
-  pPointMass->m_velocity.set(0, 0, 0);
+  hlCacheGetDoublev(cache, HL_PROXY_POSITION, proxyPos);
+  startEffect(*pState, proxyPos);
 }
 
 
@@ -425,37 +588,44 @@ void HLCALLBACK stopEffectCB(HLcache *cache, void *userdata)
 
 
 /*******************************************************************************
- Initializes the control parameters used for simulating the point mass.
+ Hands the control parameters used for simulating the point mass to the servo
+ loop, which ramps to them over a few milliseconds.
 *******************************************************************************/
-void initPointMass(PointMass *pPointMass)
+void initPointMass()
 {
-  pPointMass->m_mass = mass_weight; // Kg        
+  EffectParameters params;
+
+  params.mass = mass_weight; // Kg        
 
   // Query HDAPI for the max spring stiffness and then tune it down to allow
   // for stable force rendering throughout the workspace.
-  hdGetDoublev(HD_NOMINAL_MAX_STIFFNESS, &pPointMass->m_kStiffness);
-  pPointMass->m_kStiffness *= spring_stiffness;
+  params.stiffness = device->getMaxStiffness() * spring_stiffness;
 
   // Compute damping constant so that the point mass motion is critically damped.
-  pPointMass->m_kDamping = 2 * sqrt(pPointMass->m_mass * pPointMass->m_kStiffness);
+  params.damping = 2 * sqrt(params.mass * params.stiffness);
+
+  params.guidanceStiffness = k_damping;
+  effectParameters.publish(params);
 }
 
 
 /*******************************************************************************
  ANN: Servo loop thread callback for recording device states.
 *******************************************************************************/
-HDCallbackCode HDCALLBACK DeviceStateCallback(void *pUserData)
+bool DeviceStateCallback(void *pUserData)
 {
+  ServoTimer timer(captureProbe);
   DeviceState state;
-  list<DeviceState> *pDSL = static_cast<list<DeviceState> *>(pUserData);
+  CaptureFanout *pFanout = static_cast<CaptureFanout *>(pUserData);
 
-  QueryPerformanceCounter(&state.counter);
+  state.time = timestampNow();
   
-  hdGetDoublev(HD_CURRENT_POSITION, state.position);
+  device->getPosition(state.position);
 
-  pDSL->push_back(state);
+  // Wait-free and allocation-free; a full ring just counts the drop.
+  pFanout->push(state);
 
-  return HD_CALLBACK_CONTINUE;
+  return true;
 }
 
 
@@ -465,19 +635,19 @@ HDCallbackCode HDCALLBACK DeviceStateCallback(void *pUserData)
 *******************************************************************************/
 void initHD()
 {
-  HDErrorInfo error;
-
-  hHD = hdInitDevice(HD_DEFAULT_DEVICE);
+  device = createHDDevice();
 
-  if(HD_DEVICE_ERROR(error = hdGetError()))
+  if(!device->init())
   {
-    hduPrintError(stderr, &error, "Failed to initialize haptic device");
     fprintf(stderr, "Press any key to exit");
     getchar();
     exit(-1);
   }
 
-  hHLRC = hlCreateContext(hHD);
+  forceProbe.setUpdateRate(device->getNominalUpdateRate());
+  captureProbe.setUpdateRate(device->getNominalUpdateRate());
+
+  hHLRC = hlCreateContext(hdGetCurrentDevice());
   hlMakeCurrent(hHLRC);
 
   // Enable optimization of the viewing parameters when rendering
@@ -485,11 +655,26 @@ void initHD()
   hlEnable(HL_HAPTIC_CAMERA_VIEW);
 
   // Generate id's for the shapes.
-  gBoxesShapeId = hlGenShapes(1);
   gLineShapeId  = hlGenShapes(1);
 
-  // Initialize the point mass.
-  initPointMass(&pointMass);
+  // The writing surface never moves with the pattern, so its geometry is
+  // made once here.
+  static const HapticMaterial surfaceMaterial = {1.0f, 0.0f, 0.0f, 0.0f};
+  float x = 4, y = x*0.75f;//set haptic surface size at 4:3 ratios
+  const float surface[4 * 3] = {
+    -x, -y, 0.0f,
+     x, -y, 0.0f,
+     x,  y, 0.0f,
+    -x,  y, 0.0f
+  };
+
+  gWritingSurface = hapticScene.addShape(surfaceMaterial);
+  hapticScene.setGeometry(gWritingSurface, surface, 4, GL_QUADS);
+
+  // Initialize the point mass. The servo loop steps it at the nominal rate
+  // rather than asking for the measured one every tick.
+  pointMass.tickSeconds = 1.0 / device->getNominalUpdateRate();
+  initPointMass();
   effect = hlGenEffects(1);
   hlBeginFrame();
 
@@ -499,6 +684,31 @@ void initHD()
 
   hlStartEffect(HL_EFFECT_CALLBACK, effect);
   hlEndFrame();
+
+  // Sample the device for the trace overlay and the skill monitor, and for
+  // the recorder once a session starts. -AK
+  double updateRate = device->getNominalUpdateRate();
+
+  trace.init(size_t(updateRate) * Constant::TraceBufferSeconds,
+             Constant::TraceTolerance);
+  captureFanout.attach(&trace.samples());
+
+  // Score the exercise live if there is a network to do it with.
+  string modelError;
+
+  if(skillMonitor.loadModel(SkillModelFile, modelError))
+  {
+    skillMonitor.start(size_t(updateRate) * Constant::TraceBufferSeconds);
+    captureFanout.attach(&skillMonitor.samples());
+  }
+  else
+    cout << "NO SKILL MODEL: " << SkillModelFile << " (" << modelError << ")"
+         << endl;
+
+  deviceStateHandle = device->schedule(DeviceStateCallback,
+                                       (void *) &captureFanout,
+                                       ServoPriorityMax);
+  device->startScheduler();
 }
 
 
@@ -508,8 +718,24 @@ void initHD()
 *******************************************************************************/
 void exitHandler()
 {
-  // Deallocate the sphere shape id we reserved in initHD().
-  hlDeleteShapes(gBoxesShapeId, 1);
+  // Make sure a session in progress reaches the disk.
+  stopRecording();
+
+  // Stop sampling the device.
+  if(deviceStateHandle)
+  {
+    device->stopScheduler();
+    device->unschedule(deviceStateHandle);
+    deviceStateHandle = 0;
+  }
+
+  captureFanout.detach(&skillMonitor.samples());
+  skillMonitor.stop();
+
+  dumpServoProfile(stdout);
+
+  // Deallocate the shape ids we reserved in initHD().
+  hapticScene.release();
   hlDeleteShapes(gLineShapeId, 1);
 
   // Free up the haptic rendering context.
@@ -519,8 +745,8 @@ void exitHandler()
     hlDeleteContext(hHLRC);
 
   // Free up the haptic device.
-  if(hHD != HD_INVALID_HANDLE)
-    hdDisableDevice(hHD);
+  if(device != NULL)
+    device->shutdown();
 
   hlBeginFrame();
   hlStopEffect(effect);
@@ -538,58 +764,72 @@ void glutContextMenu(int key)
   switch(key)
   {
     case 0: // Get Ratio Point 1
-      break;
-
     case 1: // Get Ratio Point 2
+      setRatioPoint(key);
       break;
 
     case 2: // No Effect
       mass_weight = 0.0;
       k_damping = 0.0;
       spring_stiffness = 0.0;
-      initPointMass(&pointMass);
+      initPointMass();
       break;
 
     case 3: // Low Inertia Effect
       mass_weight = 0.010;
       k_damping = 0.001;
       spring_stiffness = 0.1;
-      initPointMass(&pointMass);
+      initPointMass();
       break;
 
     case 4: // Medium Inertia Effect
       mass_weight = 0.030;
       k_damping = 0.003;
       spring_stiffness = 0.2;
-      initPointMass(&pointMass);
+      initPointMass();
       break;
 
     case 5: // High Inertia Effect
       mass_weight = 0.050;
       k_damping = 0.005;
       spring_stiffness = 0.4;
-      initPointMass(&pointMass);
+      initPointMass();
       break;
 
     case 6: // Start Recording
-      //Schedule device state sampling callback in servo loop -AK
-      deviceStateHandle = hdScheduleAsynchronous(DeviceStateCallback,
-                                                 (void *) &deviceStateList,
-                                                 HD_MAX_SCHEDULER_PRIORITY);
-      hdStartScheduler();
+      startRecording();
       break;
 
     case 7: // Quit
-      // Unschedule device state sampling callback in servo loop -AK
-      if(deviceStateHandle)
+      stopRecording();
+      exit(0);
+
+    case 8: // Dump Servo Timing
+      dumpServoProfile(stdout);
+      break;
+
+    case 9: // Clear Trace
+      trace.clear();
+      break;
+
+    case 10: // Clear Ratio Points
+      clearRatioPoints();
+      break;
+
+    default: // Pattern submenu
+      if(key > PatternMenuBase && key <= PatternMenuBase + PatternCount)
       {
-        hdStopScheduler();
-        hdUnschedule(deviceStateHandle);
-        writeDeviceStatesToFile();
-        deviceStateHandle = NULL;
+        // The session header names the pattern, so a session can't span two.
+        if(recorder.isRecording())
+        {
+          cout << "Recording stopped for the pattern change." << endl;
+          stopRecording();
+        }
+
+        if(selectPattern(key - PatternMenuBase))
+          trace.clear();
       }
-
-      exit(0);
+      break;
   }
 }
 
@@ -617,6 +857,24 @@ void updateWorkspace()
   // Compute cursor scale.
   gCursorScale = hluScreenToModelScale(modelview, projection, (HLint*)viewport);
   gCursorScale *= CURSOR_SIZE_PIXELS;
+
+  // The trace is kept in workspace coordinates; give it the way back.
+  HLdouble viewtouch[16], touchworkspace[16], worldworkspace[16];
+
+  hlGetDoublev(HL_VIEWTOUCH_MATRIX, viewtouch);
+  hlGetDoublev(HL_TOUCHWORKSPACE_MATRIX, touchworkspace);
+  hluModelToWorkspaceTransform(modelview, viewtouch, touchworkspace, worldworkspace);
+  trace.setWorkspaceTransform(worldworkspace);
+
+  // So is the pattern the guidance force follows.
+  if(invertAffine(worldworkspace, workspaceToWorld))
+  {
+    memcpy(worldToWorkspace, worldworkspace, sizeof(worldToWorkspace));
+    publishGuidance();
+  }
+
+  // The haptic shapes have moved relative to the device.
+  hapticScene.invalidate();
 }
 
 
@@ -656,77 +914,208 @@ void getPatternSelection()
 
 void loadPattern()
 {
-  string filepath = "patterns/";
+  if(menuSelection == 0) // Exit Application
+  {
+    cout << "Thank you." << endl;
+    exit(0);
+  }
 
-  switch(menuSelection)
+  if(menuSelection < 1 || menuSelection > PatternCount)
   {
-    // Complexity
-    case 1:filepath += "comp1.bmp"; break;
-    case 2:filepath += "comp2.bmp"; break;
-    case 3:filepath += "comp3.bmp"; break;
-
-    // Straight to Curvy
-    case 4:filepath += "stc1.bmp"; break;
-    case 5:filepath += "stc2.bmp"; break;
-    case 6:filepath += "stc3.bmp"; break;
-    
-    // Width
-    case 7:filepath += "wid1.bmp"; break;
-    case 8:filepath += "wid2.bmp"; break;
-    case 9:filepath += "wid3.bmp"; break;
+    cout << "Selection not valid." << endl;
+    exit(0);
+  }
 
-    case 0: // Exit Application
-      cout << "Thank you." << endl;
-      exit(0);
-      
-    default:
-      cout << "Selection not valid." << endl;
-      exit(0);
+  if(!selectPattern(menuSelection))
+    exit(-1);
+}
+
+
+/*******************************************************************************
+ Makes a pattern the current one, uploading it first if the idle loop hasn't
+ got to it yet.
+*******************************************************************************/
+bool selectPattern(int selection)
+{
+  if(patternTextures[selection] == 0)
+    uploadPattern(selection, true);
+
+  if(patternTextures[selection] == 0)
+  {
+    cout << "CAN'T LOAD PATTERN: patterns/" << patternFile(selection) << endl;
+    return false;
   }
-  
-  // load selected pattern
-  _textureList[3] = loadTexture(loadBMP(filepath.c_str()));
+
+  menuSelection = selection;
+  _textureList[3] = patternTextures[selection];
+
+  // No guidance from the last pattern while this one's field is built.
+  patternField.reset();
+  patternFieldPending = true;
+  adoptPatternField(false);
+
+  if(patternFieldPending)
+    publishGuidance();
+
+  // Shapes that follow the pattern must be sent again.
+  hapticScene.invalidate();
+  return true;
+}
+
+
+/*******************************************************************************
+ Uploads a built pattern as a texture. Without wait it does nothing while the
+ pattern is still being built.
+*******************************************************************************/
+void uploadPattern(int selection, bool wait)
+{
+  TextureImage* texture = patternCache.take(selection, wait);
+
+  if(texture == NULL)
+    return;
+
+  patternTextures[selection] = loadTexture(*texture);
+  delete texture; // OpenGL keeps its own copy
+}
+
+
+/*******************************************************************************
+ Takes the current pattern's distance field from the pattern cache and hands
+ it to the servo loop. Without wait it does nothing while the field is still
+ being built. Without a field there is no guidance.
+*******************************************************************************/
+void adoptPatternField(bool wait)
+{
+  shared_ptr<const DistanceField> field;
+
+  if(!patternCache.getField(menuSelection, wait, field))
+    return;
+
+  if(!field)
+    cout << "NO STROKE TO GUIDE ALONG IN: patterns/"
+         << patternFile(menuSelection) << endl;
+
+  patternFieldPending = false;
+  patternField = field;
+  publishGuidance();
+}
+
+
+/*******************************************************************************
+ Gives the servo loop the current field, mapped onto the device workspace
+ where the pattern is drawn.
+*******************************************************************************/
+void publishGuidance()
+{
+  PatternGuidance* guidance = NULL;
+
+  if(patternField)
+  {
+    guidance = new PatternGuidance();
+    guidance->field = patternField;
+    guidance->setMapping(workspaceToWorld, PatternHalfWidth, PatternHalfHeight);
+  }
+
+  patternGuidance.publish(guidance);
+}
+
+
+/*******************************************************************************
+ Anchors a ratio point where the device was at the last frame, replacing the
+ one set before, and gives the servo loop the new set of anchors. The servo
+ loop works in workspace coordinates, so the frame's world position is
+ mapped back there.
+*******************************************************************************/
+void setRatioPoint(int point)
+{
+  const HLdouble* p = frameState.devicePosition;
+  const double* m = worldToWorkspace;
+  Attractor anchor;
+
+  for(int i = 0; i < 3; i++)
+    anchor.position[i] = m[i] * p[0] + m[4 + i] * p[1] + m[8 + i] * p[2]
+                       + m[12 + i];
+
+  anchor.radius = Constant::AnchorRadius;
+  anchor.stiffness = Constant::AnchorStiffness;
+
+  if(ratioPointAnchor[point] < 0)
+  {
+    ratioPointAnchor[point] = int(anchors.size());
+    anchors.push_back(anchor);
+  }
+  else
+    anchors[ratioPointAnchor[point]] = anchor;
+
+  anchorField.publish(new AttractorField(anchors));
+}
+
+
+void clearRatioPoints()
+{
+  anchors.clear();
+  ratioPointAnchor[0] = ratioPointAnchor[1] = -1;
+  anchorField.publish(NULL);
 }
 
 
 void attachContextMenu()
 {
+  int patternMenu = glutCreateMenu(glutContextMenu);
+
+  for(int i = 1; i <= PatternCount; i++)
+    glutAddMenuEntry(patternLabel(i), PatternMenuBase + i);
+
   glutCreateMenu(glutContextMenu);  
+  glutAddSubMenu("Pattern", patternMenu);
   glutAddMenuEntry("No Effect", 2);
   glutAddMenuEntry("Low Inertia Effect", 3);
   glutAddMenuEntry("Medium Inertia Effect", 4);
   glutAddMenuEntry("High Inertia Effect", 5);
+  glutAddMenuEntry("Set Ratio Point 1", 0);
+  glutAddMenuEntry("Set Ratio Point 2", 1);
+  glutAddMenuEntry("Clear Ratio Points", 10);
   glutAddMenuEntry("Start Recording",6);  
+  glutAddMenuEntry("Clear Trace", 9);
+  glutAddMenuEntry("Dump Servo Timing", 8);
   glutAddMenuEntry("Quit", 7);
   glutAttachMenu(GLUT_RIGHT_BUTTON);
 }
 
 
-//Makes the image into a texture, and returns the id of the texture
-GLuint loadTexture(Image* image)
+/*******************************************************************************
+ Reads the proxy and the device from HLAPI for this frame, as of the last
+ haptic frame, and brings what depends on them up to date.
+*******************************************************************************/
+void captureFrameState()
 {
-  GLuint textureId;
-  glGenTextures(1, &textureId); //Make room for our texture
-  glBindTexture(GL_TEXTURE_2D, textureId); //Tell OpenGL which texture to edit
+  HLdouble proxyTransform[16];
+
+  hlGetDoublev(HL_PROXY_TRANSFORM, proxyTransform);
+  hlGetDoublev(HL_DEVICE_POSITION, frameState.devicePosition);
+
+  // The cursor only moves with the proxy or when the view is resized.
+  if(gCursorScale != frameState.cursorScale
+     || memcmp(proxyTransform, frameState.proxyTransform,
+               sizeof(proxyTransform)) != 0)
+  {
+    memcpy(frameState.proxyTransform, proxyTransform, sizeof(proxyTransform));
+    frameState.cursorScale = gCursorScale;
 
-  //Map the image to the texture
-  glTexImage2D(GL_TEXTURE_2D,    //Always GL_TEXTURE_2D
-               0,                //0 for now
-               GL_RGB,           //Format OpenGL uses for image
-               image->width,     //image width
-               image->height,    //image height
-               0,                //image border
-               GL_RGB,           //GL_RGB pixel format
-               GL_UNSIGNED_BYTE, //GL_UNSIGNED_BYTE pixel format
-               image->pixels);   //actual pixel data
+    // The proxy flattened onto the pattern plane, then the cursor scale:
+    // the first three columns scaled and the z translation dropped.
+    for(int i = 0; i < 16; i++)
+      frameState.cursorTransform[i] = i < 12 ? proxyTransform[i] * gCursorScale
+                                             : proxyTransform[i];
 
-  return textureId; //Returns the id of the texture
+    frameState.cursorTransform[14] = 0.0;
+  }
 }
 
 
 /*******************************************************************************
- The main routine for displaying the scene. Gets the latest snapshot of state
- from the haptic thread and uses it to display a 3D cursor.
+ The main routine for displaying the scene. Draws from the state
+ captureFrameState() read for this frame.
 *******************************************************************************/
 void drawSceneGraphics()
 {
@@ -735,38 +1124,88 @@ void drawSceneGraphics()
   // Draw 3D cursor at haptic device position.
   drawCursor_Air();
 
-  glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_LIGHTING_BIT);
+  // Overlay the path so far; only the new samples are uploaded.
+  trace.update();
+  trace.draw();
+
+  // Neither the plane nor the text touches lighting parameters, and they
+  // share the one push.
+  glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT);
 
   glMatrixMode(GL_MODELVIEW); //Switch to the drawing perspective
   glLoadIdentity(); //Reset the drawing perspective
 
   glTranslatef(0.0f, 0.0f, -4.0f); //Move forward 5 units
   
-  glPushMatrix(); //Save the transformations performed thus far
-  glEnable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, _textureList[3]);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  float x = 2, y = x*0.75;//set pattern size at 4:3 ratio
-
-  glBegin(GL_QUADS);
-    glTexCoord2f(0,0);
-    glVertex2f(-x,-y);
-    glTexCoord2f(1,0);
-    glVertex2f( x,-y);
-    glTexCoord2f(1,1);
-    glVertex2f( x, y);
-    glTexCoord2f(0,1);
-    glVertex2f(-x, y);
-  glEnd();
+  renderer.drawPatternPlane(_textureList[3], PatternHalfWidth, PatternHalfHeight);
+
+  drawSkillEstimate();
 
-  glPopMatrix();
   glPopAttrib();
 }
 
 
+/*******************************************************************************
+ Prints the skill monitor's latest estimate in the bottom left corner, with
+ how long after the newest sample behind it the estimate was ready. Turns
+ lighting, texturing and depth testing off; call it inside an attribute push.
+*******************************************************************************/
+void drawSkillEstimate()
+{
+  SkillEstimate estimate = skillMonitor.latest();
+
+  if(estimate.count == 0)
+    return;
+
+  // Only a new estimate changes the text.
+  if(estimate.publishTime != frameState.skillTime)
+  {
+    const vector<string>& labels = skillMonitor.labels();
+    string& text = frameState.skillText;
+    char item[64];
+
+    text.clear();
+
+    for(int i = 0; i < estimate.count; i++)
+    {
+      sprintf(item, "%.24s %.2f   ",
+              i < int(labels.size()) ? labels[i].c_str() : "output", estimate.value[i]);
+      text += item;
+    }
+
+    sprintf(item, "(%.1f ms)", double(estimate.publishTime - estimate.sampleTime) * 1.0e-6);
+    text += item;
+    frameState.skillTime = estimate.publishTime;
+  }
+
+  const string& text = frameState.skillText;
+
+  glDisable(GL_LIGHTING);
+  glDisable(GL_TEXTURE_2D);
+  glDisable(GL_DEPTH_TEST);
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0, frameState.windowWidth, 0, frameState.windowHeight, -1, 1);
+
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glColor3f(0.1f, 0.1f, 0.6f);
+  glRasterPos2i(10, 10);
+
+  for(size_t i = 0; i < text.size(); i++)
+    glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, text[i]);
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+
 /*******************************************************************************
  The main routine for rendering scene haptics.
 *******************************************************************************/
@@ -777,39 +1216,12 @@ void drawSceneHaptics()
 
   // Start haptic frame (Must do this before rendering any haptic shapes)
   hlBeginFrame();
-  
-  // Draw 3D cursor at haptic device position
-  drawCursor_Air();
 
-  // Set material properties for the shapes to be drawn
-  hlMaterialf(HL_FRONT_AND_BACK, HL_STIFFNESS, 1);
-  hlMaterialf(HL_FRONT_AND_BACK, HL_DAMPING, 0);
-  hlMaterialf(HL_FRONT_AND_BACK, HL_STATIC_FRICTION, 0);
-  hlMaterialf(HL_FRONT_AND_BACK, HL_DYNAMIC_FRICTION, 0);
-  hlHintb(HL_SHAPE_DYNAMIC_SURFACE_CHANGE, HL_TRUE);
-  
   hlTouchModel(HL_CONTACT);
   
-  // Start the haptic shape
-  hlBeginShape(HL_SHAPE_DEPTH_BUFFER, gBoxesShapeId);
-
-  glPushMatrix();
-
-  float x = 4, y = x*0.75;//set haptic surface size at 4:3 ratios
-
-  glBegin(GL_QUADS);
-    glTexCoord2f(0,0);
-    glVertex2f(-x,-y);
-    glTexCoord2f(1,0);
-    glVertex2f( x,-y);
-    glTexCoord2f(1,1);
-    glVertex2f( x, y);
-    glTexCoord2f(0,1);
-    glVertex2f(-x, y);
-  glEnd();
-
-  glPopMatrix();
-  hlEndShape();
+  // Define the cached shapes; only those that changed are sent as moving,
+  // and none of them reads back the depth buffer.
+  hapticScene.render();
 
   // End the haptic frame
   hlEndFrame();
@@ -818,83 +1230,24 @@ void drawSceneHaptics()
 
 /*******************************************************************************
  Draws a 3D cursor for the haptic device using the current local transform,
- the workspace to world transform and the screen coordinate scale.
+ the workspace to world transform and the screen coordinate scale, as
+ captureFrameState() combined them.
  ******************************************************************************/
 void drawCursor_Air()
 {
-  static const double kCursorRadius = 0.3;
-  static const double kCursorHeight = 1.0;
-  static const int kCursorTess = 8;
-  HLdouble proxyTransform[16];
-  HLdouble proxyPosition[3];
-
-  GLUquadricObj *qobj = 0;
-
-  //TODO: move to better location. Can the line state be saved?
-  /*/ overlay path history
-  if(!deviceStateList.empty())
-  {
-    list<DeviceState>::iterator it;
-
-    glPushAttrib(GL_ENABLE_BIT | GL_LIGHTING_BIT);
-    glDisable(GL_LIGHTING);
-
-    glBegin(GL_LINE_STRIP);
-
-    for(it = deviceStateList.begin(); it != deviceStateList.end(); it++)
-      glVertex2f(it->x, it->y);
-
-    glEnd();
-
-    glPopAttrib();
-  }
-  // */
-
-
+  // Colour material rewrites the material, so the lighting state is pushed
+  // as well.
   glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_LIGHTING_BIT);
   
   glPushMatrix();
-
-  if(!gCursorDisplayList)
-  {
-    gCursorDisplayList = glGenLists(1);
-    glNewList(gCursorDisplayList, GL_COMPILE);
-    qobj = gluNewQuadric();
-               
-    glPushMatrix();
-    glColor3f(0.3, 0.5, 0.9); //BLUE
-    gluSphere(qobj, kCursorRadius, kCursorTess, kCursorTess);
-    glPopMatrix();
-
-    glPushMatrix();
-    glColor3f(0.9, 0.7, 0.1);//brown-yellow
-    glTranslated(0.0, 0.0, kCursorHeight/3);
-    gluSphere(qobj, kCursorRadius/3, kCursorTess, kCursorTess);
-    gluCylinder(qobj, 0.0, kCursorRadius/2, kCursorHeight/5.0, kCursorTess, kCursorTess);
-    glTranslated(0.0, 0.0, kCursorHeight/5);
-    gluCylinder(qobj, kCursorRadius/2, 0.0, kCursorHeight/5.0, kCursorTess, kCursorTess);
-    glPopMatrix();
-
-    gluDeleteQuadric(qobj);
-    glEndList();
-  }
-  
-  // Get the proxy transform in world coordinates.
-  hlGetDoublev(HL_PROXY_TRANSFORM, proxyTransform);
-
-  proxyTransform[14]= 0.0;
-  glMultMatrixd(proxyTransform);
-
-  // Apply the local cursor scale factor.
-  glScaled(gCursorScale, gCursorScale, gCursorScale);
-
-  hdGetDoublev(HD_CURRENT_POSITION, position);
+  glMultMatrixd(frameState.cursorTransform);
 
   glEnable(GL_LIGHTING);
   glEnable(GL_COLOR_MATERIAL);
   glColor3f(0.0, 0.5, 1.0);
 
-  glCallList(gCursorDisplayList);
+  // Blue ball with a yellow tip; the mesh carries its own colours.
+  renderer.drawCursor();
 
   glPopMatrix(); 
   glPopAttrib();
@@ -0,0 +1,135 @@
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mappedfile.h"
+
+#if defined(WIN32)
+
+MappedFile::MappedFile() : view(NULL), length(0), fileHandle(INVALID_HANDLE_VALUE),
+                           mappingHandle(NULL)
+{
+}
+
+
+bool MappedFile::open(const char* filename)
+{
+  close();
+
+  fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+  if(fileHandle == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+
+  if(!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+  {
+    close();
+    return false;
+  }
+
+  mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+  if(mappingHandle == NULL)
+  {
+    close();
+    return false;
+  }
+
+  view = static_cast<const unsigned char*>(
+           MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+  if(view == NULL)
+  {
+    close();
+    return false;
+  }
+
+  length = size_t(fileSize.QuadPart);
+  return true;
+}
+
+
+void MappedFile::close()
+{
+  if(view != NULL)
+    UnmapViewOfFile(view);
+
+  if(mappingHandle != NULL)
+    CloseHandle(mappingHandle);
+
+  if(fileHandle != INVALID_HANDLE_VALUE)
+    CloseHandle(fileHandle);
+
+  view = NULL;
+  length = 0;
+  mappingHandle = NULL;
+  fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : view(NULL), length(0), fileDescriptor(-1)
+{
+}
+
+
+bool MappedFile::open(const char* filename)
+{
+  close();
+
+  fileDescriptor = ::open(filename, O_RDONLY);
+
+  if(fileDescriptor < 0)
+    return false;
+
+  struct stat info;
+
+  if(fstat(fileDescriptor, &info) != 0 || info.st_size == 0)
+  {
+    close();
+    return false;
+  }
+
+  void* address = mmap(NULL, size_t(info.st_size), PROT_READ, MAP_PRIVATE,
+                       fileDescriptor, 0);
+
+  if(address == MAP_FAILED)
+  {
+    close();
+    return false;
+  }
+
+  view = static_cast<const unsigned char*>(address);
+  length = size_t(info.st_size);
+  return true;
+}
+
+
+void MappedFile::close()
+{
+  if(view != NULL)
+    munmap(const_cast<unsigned char*>(view), length);
+
+  if(fileDescriptor >= 0)
+    ::close(fileDescriptor);
+
+  view = NULL;
+  length = 0;
+  fileDescriptor = -1;
+}
+
+#endif
+
+
+MappedFile::~MappedFile()
+{
+  close();
+}
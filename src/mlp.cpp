@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "mlp.h"
+#include "cpufeatures.h"
+
+#if defined(NIMBLE_X86)
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+  //Columns of x kept hot in L1 while every row passes over them (4 KB)
+  const int ColumnBlock = 1024;
+
+  //Widest input or layer, and most weights in one layer, a model file may
+  //ask for. A corrupt count is rejected here rather than allocated.
+  const int MaxWidth = 1 << 16;
+  const size_t MaxLayerWeights = size_t(1) << 22; // 16 MB of floats
+
+  void gemvScalar(const float* w, int rows, int stride, const float* x,
+                  float* y)
+  {
+    for(int c0 = 0; c0 < stride; c0 += ColumnBlock)
+    {
+      int c1 = c0 + ColumnBlock < stride ? c0 + ColumnBlock : stride;
+
+      for(int r = 0; r < rows; r++)
+      {
+        const float* row = w + size_t(r) * stride;
+        float sum = 0.0f;
+
+        for(int c = c0; c < c1; c++)
+          sum += row[c] * x[c];
+
+        y[r] += sum;
+      }
+    }
+  }
+
+#if defined(NIMBLE_X86)
+  /*****************************************************************************
+   Four rows at a time: each column block of x is loaded once per four rows,
+   and the four running sums are transposed so one add finishes them all.
+  *****************************************************************************/
+  NIMBLE_TARGET("sse2")
+  void gemvSse2(const float* w, int rows, int stride, const float* x,
+                float* y)
+  {
+    for(int c0 = 0; c0 < stride; c0 += ColumnBlock)
+    {
+      int c1 = c0 + ColumnBlock < stride ? c0 + ColumnBlock : stride;
+      int r = 0;
+
+      for(; r + 4 <= rows; r += 4)
+      {
+        const float* w0 = w + size_t(r) * stride;
+        const float* w1 = w0 + stride;
+        const float* w2 = w1 + stride;
+        const float* w3 = w2 + stride;
+        __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+        __m128 s2 = _mm_setzero_ps(), s3 = _mm_setzero_ps();
+
+        for(int c = c0; c < c1; c += 4)
+        {
+          __m128 xv = _mm_loadu_ps(x + c);
+
+          s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(w0 + c), xv));
+          s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(w1 + c), xv));
+          s2 = _mm_add_ps(s2, _mm_mul_ps(_mm_loadu_ps(w2 + c), xv));
+          s3 = _mm_add_ps(s3, _mm_mul_ps(_mm_loadu_ps(w3 + c), xv));
+        }
+
+        _MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+        __m128 sums = _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3));
+        _mm_storeu_ps(y + r, _mm_add_ps(_mm_loadu_ps(y + r), sums));
+      }
+
+      for(; r < rows; r++)
+      {
+        const float* row = w + size_t(r) * stride;
+        __m128 s = _mm_setzero_ps();
+        float lanes[4];
+
+        for(int c = c0; c < c1; c += 4)
+          s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(row + c), _mm_loadu_ps(x + c)));
+
+        _mm_storeu_ps(lanes, s);
+        y[r] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+      }
+    }
+  }
+#endif
+
+  //Reads the next token, skipping '#' comments; false at the end
+  bool nextToken(FILE* file, char* token, size_t size)
+  {
+    char format[16];
+
+    sprintf(format, "%%%ds", int(size - 1));
+
+    for(;;)
+    {
+      if(fscanf(file, format, token) != 1)
+        return false;
+
+      if(token[0] != '#')
+        return true;
+
+      int c;
+
+      while((c = fgetc(file)) != EOF && c != '\n')
+        ;
+    }
+  }
+
+  bool nextInt(FILE* file, int& value)
+  {
+    char token[64], *end;
+
+    if(!nextToken(file, token, sizeof(token)))
+      return false;
+
+    value = int(strtol(token, &end, 10));
+    return *end == 0;
+  }
+
+  bool nextFloat(FILE* file, float& value)
+  {
+    char token[64], *end;
+
+    if(!nextToken(file, token, sizeof(token)))
+      return false;
+
+    value = float(strtod(token, &end));
+    return *end == 0;
+  }
+
+  bool parseActivation(const char* name, MlpActivation& activation)
+  {
+    static const char* const names[] = {"linear", "relu", "tanh", "sigmoid"};
+
+    for(int i = 0; i < 4; i++)
+    {
+      if(strcmp(name, names[i]) == 0)
+      {
+        activation = MlpActivation(i);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void activate(MlpActivation activation, float* y, int n)
+  {
+    switch(activation)
+    {
+      case MlpRelu:
+        for(int i = 0; i < n; i++)
+          y[i] = y[i] > 0.0f ? y[i] : 0.0f;
+        break;
+
+      case MlpTanh:
+        for(int i = 0; i < n; i++)
+          y[i] = tanh(y[i]);
+        break;
+
+      case MlpSigmoid:
+        for(int i = 0; i < n; i++)
+          y[i] = 1.0f / (1.0f + exp(-y[i]));
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+
+void gemv(const float* w, int rows, int stride, const float* x,
+          const float* bias, float* y, bool sse2)
+{
+  for(int r = 0; r < rows; r++)
+    y[r] = bias[r];
+
+#if defined(NIMBLE_X86)
+  if(sse2)
+  {
+    gemvSse2(w, rows, stride, x, y);
+    return;
+  }
+#else
+  (void)sse2;
+#endif
+
+  gemvScalar(w, rows, stride, x, y);
+}
+
+
+Mlp::Mlp() : inputs(0), sse2(cpuHasSse2())
+{
+}
+
+
+int Mlp::outputSize() const
+{
+  return layers.empty() ? 0 : layers.back().outputs;
+}
+
+
+bool Mlp::load(const char* filename, string& error)
+{
+  inputs = 0;
+  offset.clear();
+  scale.clear();
+  layers.clear();
+  labels.clear();
+
+  FILE* file = fopen(filename, "r");
+
+  if(file == NULL)
+  {
+    error = "can't open file";
+    return false;
+  }
+
+  char token[64];
+  int version = 0;
+  int size = 0; // outputs of the last layer read, or the input count
+
+  error.clear();
+
+  if(!nextToken(file, token, sizeof(token)) || strcmp(token, "nimble-mlp") != 0
+     || !nextInt(file, version) || version != 1)
+    error = "not a version 1 nimble-mlp file";
+
+  while(error.empty() && nextToken(file, token, sizeof(token)))
+  {
+    if(strcmp(token, "inputs") == 0 && inputs == 0)
+    {
+      if(!nextInt(file, inputs) || inputs <= 0 || inputs > MaxWidth)
+      {
+        error = "bad input count";
+        break;
+      }
+
+      size = inputs;
+      offset.assign(size_t(inputs), 0.0f);
+      scale.assign(size_t(inputs), 1.0f);
+    }
+    else if(strcmp(token, "normalize") == 0 && inputs > 0 && layers.empty())
+    {
+      int groups;
+
+      if(!nextInt(file, groups) || groups <= 0 || inputs % groups != 0)
+      {
+        error = "normalize groups must divide the inputs";
+        break;
+      }
+
+      int run = inputs / groups;
+
+      for(int g = 0; g < groups && error.empty(); g++)
+      {
+        float o = 0.0f, s = 1.0f;
+
+        if(!nextFloat(file, o) || !nextFloat(file, s))
+          error = "short normalize table";
+
+        for(int i = 0; i < run; i++)
+        {
+          offset[g * run + i] = o;
+          scale[g * run + i] = s;
+        }
+      }
+    }
+    else if(strcmp(token, "dense") == 0 && inputs > 0)
+    {
+      Layer layer;
+      char activation[64];
+
+      if(!nextInt(file, layer.outputs) || layer.outputs <= 0
+         || layer.outputs > MaxWidth
+         || !nextToken(file, activation, sizeof(activation))
+         || !parseActivation(activation, layer.activation))
+      {
+        error = "bad dense layer header";
+        break;
+      }
+
+      layer.inputs = size;
+      layer.stride = (size + 3) & ~3;
+
+      if(size_t(layer.outputs) * layer.stride > MaxLayerWeights)
+      {
+        error = "dense layer too large";
+        break;
+      }
+      layer.weights.assign(size_t(layer.outputs) * layer.stride, 0.0f);
+      layer.bias.resize(layer.outputs);
+
+      for(int r = 0; r < layer.outputs && error.empty(); r++)
+      {
+        for(int c = 0; c < layer.inputs && error.empty(); c++)
+          if(!nextFloat(file, layer.weights[size_t(r) * layer.stride + c]))
+            error = "short weight table";
+
+        if(error.empty() && !nextFloat(file, layer.bias[r]))
+          error = "short weight table";
+      }
+
+      size = layer.outputs;
+      layers.push_back(layer);
+    }
+    else if(strcmp(token, "labels") == 0 && !layers.empty())
+    {
+      for(int i = 0; i < size && error.empty(); i++)
+      {
+        if(nextToken(file, token, sizeof(token)))
+          labels.push_back(token);
+        else
+          error = "short label list";
+      }
+    }
+    else
+      error = string("unexpected '") + token + "'";
+  }
+
+  fclose(file);
+
+  if(error.empty() && layers.empty())
+    error = "no layers";
+
+  if(!error.empty())
+  {
+    inputs = 0;
+    offset.clear();
+    scale.clear();
+    layers.clear();
+    labels.clear();
+    return false;
+  }
+
+  // Scratch wide enough for any layer, zero past each layer's outputs so
+  // the next one's padded columns read zeros.
+  int widest = (inputs + 3) & ~3;
+
+  for(size_t i = 0; i < layers.size(); i++)
+    widest = max(widest, (layers[i].outputs + 3) & ~3);
+
+  scratch[0].assign(size_t(widest), 0.0f);
+  scratch[1].assign(size_t(widest), 0.0f);
+
+  return true;
+}
+
+
+void Mlp::evaluate(const float* input, float* output)
+{
+  float* x = &scratch[0][0];
+
+  for(int i = 0; i < inputs; i++)
+    x[i] = (input[i] - offset[i]) * scale[i];
+
+  for(size_t l = 0; l < layers.size(); l++)
+  {
+    const Layer& layer = layers[l];
+    float* y = l + 1 < layers.size() ? &scratch[(l + 1) % 2][0] : output;
+
+    gemv(&layer.weights[0], layer.outputs, layer.stride, x, &layer.bias[0], y,
+         sse2);
+    activate(layer.activation, y, layer.outputs);
+
+    // Clear what a wider earlier layer left past this one's outputs.
+    if(l + 1 < layers.size())
+    {
+      int next = layers[l + 1].stride;
+
+      for(int i = layer.outputs; i < next; i++)
+        y[i] = 0.0f;
+    }
+
+    x = y;
+  }
+}
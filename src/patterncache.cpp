@@ -0,0 +1,250 @@
+#include "constants.h"
+#include "patterncache.h"
+
+using namespace std;
+
+namespace {
+  const char* const Files[PatternCount + 1] = {
+    "",
+    "comp1.bmp", "comp2.bmp", "comp3.bmp",
+    "stc1.bmp", "stc2.bmp", "stc3.bmp",
+    "wid1.bmp", "wid2.bmp", "wid3.bmp"
+  };
+
+  const char* const Labels[PatternCount + 1] = {
+    "",
+    "Complexity 1", "Complexity 2", "Complexity 3",
+    "Straight to Curvy 1", "Straight to Curvy 2", "Straight to Curvy 3",
+    "Width 1", "Width 2", "Width 3"
+  };
+
+  bool validSelection(int selection)
+  {
+    return selection >= 1 && selection <= PatternCount;
+  }
+}
+
+
+const char* patternFile(int selection)
+{
+  return validSelection(selection) ? Files[selection] : "";
+}
+
+
+const char* patternLabel(int selection)
+{
+  return validSelection(selection) ? Labels[selection] : "";
+}
+
+
+int patternSelection(const string& file)
+{
+  for(int i = 1; i <= PatternCount; i++)
+    if(file == Files[i])
+      return i;
+
+  return 0;
+}
+
+
+PatternCache::PatternCache() : format(TextureRGB8), nextPattern(PatternCount + 1)
+{
+  for(int i = 0; i <= PatternCount; i++)
+  {
+    slots[i].state = Failed;
+    slots[i].texture = NULL;
+    slots[i].fieldBuilt = true;
+  }
+}
+
+
+PatternCache::~PatternCache()
+{
+  clear();
+}
+
+
+void PatternCache::preload(const string& patternDirectory,
+                           TextureFormat textureFormat)
+{
+  clear();
+
+  directory = patternDirectory;
+  format = textureFormat;
+  nextPattern = 1;
+
+  for(int i = 1; i <= PatternCount; i++)
+  {
+    slots[i].state = Pending;
+    slots[i].fieldBuilt = false;
+  }
+
+  unsigned int threads = thread::hardware_concurrency();
+
+  if(threads == 0)
+    threads = 2;
+  else if(threads > (unsigned int)PatternCount)
+    threads = PatternCount;
+
+  for(unsigned int i = 0; i < threads; i++)
+    workers.push_back(thread(&PatternCache::decodeLoop, this));
+}
+
+
+/*******************************************************************************
+ Worker thread body: builds pattern textures, then their distance fields
+ and scorers from the same decoded bitmap, until none are left. The workers
+ already build patterns side by side, so each field and scorer is built on
+ one thread.
+*******************************************************************************/
+void PatternCache::decodeLoop()
+{
+  for(;;)
+  {
+    int selection;
+
+    {
+      lock_guard<mutex> guard(lock);
+
+      if(nextPattern > PatternCount)
+        return;
+
+      selection = nextPattern++;
+    }
+
+    TextureImage* texture = new TextureImage();
+    Image* image;
+
+    if(!buildTexture(directory + Files[selection], format, *texture, image))
+    {
+      delete texture;
+      texture = NULL;
+    }
+
+    {
+      lock_guard<mutex> guard(lock);
+      slots[selection].texture = texture;
+      slots[selection].state = texture != NULL ? Ready : Failed;
+    }
+
+    settled.notify_all();
+
+    DistanceField* field = NULL;
+    PatternScorer* scorer = NULL;
+
+    if(image != NULL)
+    {
+      field = new DistanceField();
+
+      if(!field->build(*image, Constant::StrokeThreshold, 1))
+      {
+        delete field;
+        field = NULL;
+      }
+
+      scorer = new PatternScorer();
+
+      if(!scorer->load(*image, Constant::StrokeThreshold, 1))
+      {
+        delete scorer;
+        scorer = NULL;
+      }
+
+      delete image;
+    }
+
+    {
+      lock_guard<mutex> guard(lock);
+      slots[selection].field.reset(field);
+      slots[selection].scorer.reset(scorer);
+      slots[selection].fieldBuilt = true;
+    }
+
+    settled.notify_all();
+  }
+}
+
+
+TextureImage* PatternCache::take(int selection, bool wait)
+{
+  if(!validSelection(selection))
+    return NULL;
+
+  unique_lock<mutex> guard(lock);
+  Slot& slot = slots[selection];
+
+  while(wait && slot.state == Pending)
+    settled.wait(guard);
+
+  if(slot.state != Ready)
+    return NULL;
+
+  TextureImage* texture = slot.texture;
+  slot.texture = NULL;
+  slot.state = Taken;
+
+  return texture;
+}
+
+
+bool PatternCache::getField(int selection, bool wait,
+                            shared_ptr<const DistanceField>& field)
+{
+  field.reset();
+
+  if(!validSelection(selection))
+    return true;
+
+  unique_lock<mutex> guard(lock);
+  Slot& slot = slots[selection];
+
+  while(wait && !slot.fieldBuilt)
+    settled.wait(guard);
+
+  if(!slot.fieldBuilt)
+    return false;
+
+  field = slot.field;
+  return true;
+}
+
+
+bool PatternCache::getScorer(int selection, bool wait,
+                             shared_ptr<const PatternScorer>& scorer)
+{
+  scorer.reset();
+
+  if(!validSelection(selection))
+    return true;
+
+  unique_lock<mutex> guard(lock);
+  Slot& slot = slots[selection];
+
+  while(wait && !slot.fieldBuilt)
+    settled.wait(guard);
+
+  if(!slot.fieldBuilt)
+    return false;
+
+  scorer = slot.scorer;
+  return true;
+}
+
+
+void PatternCache::clear()
+{
+  for(size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+
+  workers.clear();
+
+  for(int i = 0; i <= PatternCount; i++)
+  {
+    delete slots[i].texture;
+    slots[i].texture = NULL;
+    slots[i].state = Failed;
+    slots[i].field.reset();
+    slots[i].scorer.reset();
+    slots[i].fieldBuilt = true;
+  }
+}
@@ -0,0 +1,160 @@
+#include <iostream>
+#include <chrono>
+
+#include "recorder.h"
+
+using namespace std;
+
+namespace {
+  //Samples moved out of the ring per write
+  const size_t BatchSize = 4096;
+
+  //How long the writer sleeps when the ring is empty
+  const int WriterIdleMillis = 10;
+}
+
+
+string binarySessionPath(const string& path)
+{
+  size_t dot = path.find_last_of('.');
+  size_t slash = path.find_last_of("/\\");
+
+  if(dot == string::npos || (slash != string::npos && dot < slash))
+    return path + ".nbt";
+
+  return path.substr(0, dot) + ".nbt";
+}
+
+
+SessionRecorder::SessionRecorder() : stopRequested(false), file(NULL),
+                                     totalTimeOffset(0), timeEpoch(0),
+                                     timeLast(0), haveEpoch(false)
+{
+}
+
+
+SessionRecorder::~SessionRecorder()
+{
+  stop();
+}
+
+
+/*******************************************************************************
+ Opens the session file, writes the YAML header and starts the writer thread.
+*******************************************************************************/
+bool SessionRecorder::start(const string& path, const SessionInfo& info,
+                            size_t ringCapacity)
+{
+  if(file != NULL)
+    return false;
+
+  file = fopen(path.c_str(), "w");
+
+  if(file == NULL)
+    return false;
+
+  SessionInfo header = info;
+  header.date = time(NULL);
+
+  writeYamlHeader(file, header, &totalTimeOffset);
+  fflush(file);
+  text.attach(file);
+
+  if(!binaryFile.open(binarySessionPath(path).c_str(), header))
+    cout << "CAN'T OPEN BINARY OUTPUT FILE: " << binarySessionPath(path) << endl;
+
+  haveEpoch = false;
+  timeEpoch = timeLast = 0;
+
+  ring.reset(ringCapacity);
+  batch.resize(BatchSize);
+  converted.resize(BatchSize);
+  stopRequested.store(false);
+  writer = thread(&SessionRecorder::writerLoop, this);
+
+  return true;
+}
+
+
+/*******************************************************************************
+ Drains the remaining samples, fills in the total time and closes the file.
+*******************************************************************************/
+void SessionRecorder::stop()
+{
+  if(file == NULL)
+    return;
+
+  stopRequested.store(true);
+  writer.join();
+
+  double totalTime = double(timeLast - timeEpoch) * 1.0e-6;
+
+  writeYamlTotalTime(file, totalTimeOffset, totalTime);
+
+  syncFile(file);
+  text.attach(NULL);
+  fclose(file);
+  file = NULL;
+
+  binaryFile.close();
+
+  if(ring.droppedCount() > 0)
+    cout << "WARNING: " << ring.droppedCount()
+         << " samples dropped, recording buffer was full" << endl;
+}
+
+
+/*******************************************************************************
+ Writer thread body. Runs until stop() is requested and the ring is empty.
+*******************************************************************************/
+void SessionRecorder::writerLoop()
+{
+  while(!stopRequested.load())
+  {
+    if(writeBatch() == 0)
+      this_thread::sleep_for(chrono::milliseconds(WriterIdleMillis));
+  }
+
+  // The producer has stopped by now, so whatever is left is final.
+  while(writeBatch() > 0)
+    ;
+}
+
+
+/*******************************************************************************
+ Moves one batch of samples from the ring to the file.
+*******************************************************************************/
+size_t SessionRecorder::writeBatch()
+{
+  size_t count = ring.drain(&batch[0], batch.size());
+
+  if(count == 0)
+    return 0;
+
+  if(!haveEpoch)
+  {
+    timeEpoch = batch[0].time;
+    haveEpoch = true;
+  }
+
+  for(size_t i = 0; i < count; i++)
+  {
+    converted[i].position[0] = batch[i].position[0];
+    converted[i].position[1] = batch[i].position[1];
+    converted[i].position[2] = batch[i].position[2];
+    converted[i].time = batch[i].time - timeEpoch;
+  }
+
+  text.writeSamples(&converted[0], count);
+
+  if(binaryFile.isOpen())
+    binaryFile.append(&converted[0], count);
+
+  timeLast = batch[count-1].time;
+
+  // Hand each batch to the OS so a crash loses at most what is in the ring.
+  text.flush();
+  fflush(file);
+
+  return count;
+}
@@ -0,0 +1,296 @@
+#include <cmath>
+
+#include "renderer.h"
+
+using namespace std;
+
+namespace {
+  //Cursor proportions, as drawn by the old display list
+  const float CursorRadius = 0.3f;
+  const float CursorHeight = 1.0f;
+  const int CursorTess = 8;
+
+  const unsigned char CursorBlue[4] = {77, 128, 230, 255};     // 0.3, 0.5, 0.9
+  const unsigned char CursorYellow[4] = {230, 179, 26, 255};   // 0.9, 0.7, 0.1
+
+  const float kPI = 3.14159265358979f;
+
+  LitVertex litVertex(float x, float y, float z, float nx, float ny, float nz,
+                      const unsigned char color[4])
+  {
+    LitVertex v;
+    float length = sqrt(nx * nx + ny * ny + nz * nz);
+
+    if(length > 0.0f)
+    {
+      nx /= length;
+      ny /= length;
+      nz /= length;
+    }
+
+    v.position[0] = x; v.position[1] = y; v.position[2] = z;
+    v.normal[0] = nx; v.normal[1] = ny; v.normal[2] = nz;
+
+    for(int i = 0; i < 4; i++)
+      v.color[i] = color[i];
+
+    return v;
+  }
+
+  //Two counter-clockwise triangles for the quad a, b, c, d
+  void addQuad(vector<LitVertex>& mesh, const LitVertex& a, const LitVertex& b,
+               const LitVertex& c, const LitVertex& d)
+  {
+    mesh.push_back(a); mesh.push_back(b); mesh.push_back(c);
+    mesh.push_back(a); mesh.push_back(c); mesh.push_back(d);
+  }
+
+  //The triangles gluSphere draws, centred at (0, 0, z)
+  void addSphere(vector<LitVertex>& mesh, float radius, float z,
+                 const unsigned char color[4])
+  {
+    for(int stack = 0; stack < CursorTess; stack++)
+    {
+      float rho0 = kPI * stack / CursorTess;
+      float rho1 = kPI * (stack + 1) / CursorTess;
+
+      for(int slice = 0; slice < CursorTess; slice++)
+      {
+        float theta0 = 2.0f * kPI * slice / CursorTess;
+        float theta1 = 2.0f * kPI * (slice + 1) / CursorTess;
+
+        float n[4][3] = {
+          {sin(rho0) * cos(theta0), sin(rho0) * sin(theta0), cos(rho0)},
+          {sin(rho1) * cos(theta0), sin(rho1) * sin(theta0), cos(rho1)},
+          {sin(rho1) * cos(theta1), sin(rho1) * sin(theta1), cos(rho1)},
+          {sin(rho0) * cos(theta1), sin(rho0) * sin(theta1), cos(rho0)}
+        };
+
+        LitVertex v[4];
+
+        for(int i = 0; i < 4; i++)
+          v[i] = litVertex(radius * n[i][0], radius * n[i][1],
+                           z + radius * n[i][2], n[i][0], n[i][1], n[i][2],
+                           color);
+
+        addQuad(mesh, v[0], v[1], v[2], v[3]);
+      }
+    }
+  }
+
+  //The side gluCylinder draws, from z0 to z0 + height
+  void addCone(vector<LitVertex>& mesh, float baseRadius, float topRadius,
+               float z0, float height, const unsigned char color[4])
+  {
+    float slope = (baseRadius - topRadius) / height;
+
+    for(int slice = 0; slice < CursorTess; slice++)
+    {
+      float theta0 = 2.0f * kPI * slice / CursorTess;
+      float theta1 = 2.0f * kPI * (slice + 1) / CursorTess;
+      float c0 = cos(theta0), s0 = sin(theta0);
+      float c1 = cos(theta1), s1 = sin(theta1);
+
+      addQuad(mesh,
+              litVertex(baseRadius * c0, baseRadius * s0, z0, c0, s0, slope, color),
+              litVertex(baseRadius * c1, baseRadius * s1, z0, c1, s1, slope, color),
+              litVertex(topRadius * c1, topRadius * s1, z0 + height, c1, s1, slope, color),
+              litVertex(topRadius * c0, topRadius * s0, z0 + height, c0, s0, slope, color));
+    }
+  }
+}
+
+
+StaticMesh::StaticMesh() : buffer(0), layout(Textured), mode(GL_TRIANGLES),
+                           count(0)
+{
+}
+
+
+void StaticMesh::upload(const TexturedVertex* vertices, size_t vertexCount,
+                        GLenum primitive)
+{
+  store(vertices, vertexCount * sizeof(TexturedVertex), Textured, vertexCount,
+        primitive);
+}
+
+
+void StaticMesh::upload(const LitVertex* vertices, size_t vertexCount,
+                        GLenum primitive)
+{
+  store(vertices, vertexCount * sizeof(LitVertex), Lit, vertexCount, primitive);
+}
+
+
+void StaticMesh::store(const void* vertices, size_t bytes, Layout vertexLayout,
+                       size_t vertexCount, GLenum primitive)
+{
+  release();
+
+  layout = vertexLayout;
+  mode = primitive;
+  count = GLsizei(vertexCount);
+
+  if(GLExt::vertexBufferObjects)
+  {
+    GLExt::genBuffers(1, &buffer);
+    GLExt::bindBuffer(GL_ARRAY_BUFFER, buffer);
+    GLExt::bufferData(GL_ARRAY_BUFFER, ptrdiff_t(bytes), vertices, GL_STATIC_DRAW);
+    GLExt::bindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  else
+    clientCopy.assign((const unsigned char*)vertices,
+                      (const unsigned char*)vertices + bytes);
+}
+
+
+void StaticMesh::draw() const
+{
+  if(count == 0)
+    return;
+
+  // With a buffer bound the pointers are offsets into it.
+  const unsigned char* base = NULL;
+
+  if(buffer != 0)
+    GLExt::bindBuffer(GL_ARRAY_BUFFER, buffer);
+  else
+    base = &clientCopy[0];
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+
+  if(layout == Textured)
+  {
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(TexturedVertex), base);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(TexturedVertex), base + 3 * sizeof(float));
+    glDrawArrays(mode, 0, count);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  }
+  else
+  {
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(LitVertex), base);
+    glNormalPointer(GL_FLOAT, sizeof(LitVertex), base + 3 * sizeof(float));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(LitVertex), base + 6 * sizeof(float));
+    glDrawArrays(mode, 0, count);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+  }
+
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  if(buffer != 0)
+    GLExt::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+void StaticMesh::release()
+{
+  if(buffer != 0)
+    GLExt::deleteBuffers(1, &buffer);
+
+  buffer = 0;
+  clientCopy.clear();
+  count = 0;
+}
+
+
+/*******************************************************************************
+ SceneRenderer
+*******************************************************************************/
+void SceneRenderer::init()
+{
+  // A unit plane, scaled to size when drawn.
+  const TexturedVertex plane[4] = {
+    {{-1.0f, -1.0f, 0.0f}, {0.0f, 0.0f}},
+    {{ 1.0f, -1.0f, 0.0f}, {1.0f, 0.0f}},
+    {{ 1.0f,  1.0f, 0.0f}, {1.0f, 1.0f}},
+    {{-1.0f,  1.0f, 0.0f}, {0.0f, 1.0f}}
+  };
+
+  patternPlane.upload(plane, 4, GL_QUADS);
+
+  // Blue ball with a yellow bead and double cone above it.
+  vector<LitVertex> mesh;
+  float beadZ = CursorHeight / 3.0f;
+  float coneHeight = CursorHeight / 5.0f;
+
+  addSphere(mesh, CursorRadius, 0.0f, CursorBlue);
+  addSphere(mesh, CursorRadius / 3.0f, beadZ, CursorYellow);
+  addCone(mesh, 0.0f, CursorRadius / 2.0f, beadZ, coneHeight, CursorYellow);
+  addCone(mesh, CursorRadius / 2.0f, 0.0f, beadZ + coneHeight, coneHeight, CursorYellow);
+
+  cursor.upload(&mesh[0], mesh.size(), GL_TRIANGLES);
+}
+
+
+void SceneRenderer::release()
+{
+  patternPlane.release();
+  cursor.release();
+}
+
+
+void SceneRenderer::drawPatternPlane(GLuint texture, float halfWidth,
+                                     float halfHeight) const
+{
+  if(texture != 0)
+  {
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+  }
+
+  glPushMatrix();
+  glScalef(halfWidth, halfHeight, 1.0f);
+  patternPlane.draw();
+  glPopMatrix();
+}
+
+
+void SceneRenderer::drawCursor() const
+{
+  cursor.draw();
+}
+
+
+//Makes the mip chain into a texture, and returns the id of the texture
+GLuint loadTexture(const TextureImage& texture)
+{
+  GLuint textureId;
+  glGenTextures(1, &textureId); //Make room for our texture
+  glBindTexture(GL_TEXTURE_2D, textureId); //Tell OpenGL which texture to edit
+
+  //Sampler state lives with the texture, so set it once here
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  //Rows are tightly packed, whatever the width
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  for(size_t i = 0; i < texture.levels.size(); i++)
+  {
+    const TextureLevel& level = texture.levels[i];
+
+    if(texture.format == TextureDXT1)
+      GLExt::compressedTexImage2D(GL_TEXTURE_2D, GLint(i),
+                                  GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                                  level.width, level.height, 0,
+                                  GLsizei(level.data.size()), &level.data[0]);
+    else
+      glTexImage2D(GL_TEXTURE_2D,    //Always GL_TEXTURE_2D
+                   GLint(i),         //mip level
+                   GL_RGB,           //Format OpenGL uses for image
+                   level.width,      //level width
+                   level.height,     //level height
+                   0,                //image border
+                   GL_RGB,           //GL_RGB pixel format
+                   GL_UNSIGNED_BYTE, //GL_UNSIGNED_BYTE pixel format
+                   &level.data[0]);  //actual pixel data
+  }
+
+  return textureId; //Returns the id of the texture
+}
@@ -0,0 +1,76 @@
+#include "servoparams.h"
+
+namespace {
+  double mix(double a, double b, double t)
+  {
+    return a + (b - a) * t;
+  }
+}
+
+
+ServoParameters::ServoParameters(double ramp)
+  : publishedVersion(0), rampSeconds(ramp), seenVersion(0), started(false),
+    progress(1.0)
+{
+  EffectParameters zero = {0.0, 0.0, 0.0, 0.0};
+
+  from = to = value = zero;
+}
+
+
+void ServoParameters::publish(const EffectParameters& target)
+{
+  Snapshot* snapshot = new Snapshot;
+
+  snapshot->target = target;
+  snapshot->version = ++publishedVersion;
+  handoff.publish(snapshot);
+}
+
+
+const EffectParameters& ServoParameters::update(double deltaT, bool& changed)
+{
+  changed = false;
+
+  // The version tells a new snapshot from the last one even if it was
+  // allocated at the same address.
+  const Snapshot* snapshot = handoff.acquire();
+
+  if(snapshot != NULL && snapshot->version != seenVersion)
+  {
+    seenVersion = snapshot->version;
+    from = value;
+    to = snapshot->target;
+    progress = started ? 0.0 : 1.0;
+
+    if(!started)
+      value = to;
+
+    started = true;
+    changed = true;
+  }
+
+  handoff.release();
+
+  if(progress < 1.0)
+  {
+    changed = true;
+    progress = rampSeconds > 0.0 ? progress + deltaT / rampSeconds : 1.0;
+
+    if(progress >= 1.0)
+    {
+      progress = 1.0;
+      value = to;
+    }
+    else
+    {
+      value.mass = mix(from.mass, to.mass, progress);
+      value.stiffness = mix(from.stiffness, to.stiffness, progress);
+      value.damping = mix(from.damping, to.damping, progress);
+      value.guidanceStiffness = mix(from.guidanceStiffness,
+                                    to.guidanceStiffness, progress);
+    }
+  }
+
+  return value;
+}
@@ -0,0 +1,252 @@
+#include <cmath>
+#include <limits>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "servoprofiler.h"
+
+using namespace std;
+
+namespace {
+  //Probes to include in dumpServoProfile()
+  const int MaxProbes = 16;
+  ServoProbe* probes[MaxProbes];
+  atomic<int> probeCount(0);
+
+  //A tick is late when it starts this many periods after the previous one
+  const double LateFactor = 1.5;
+
+  int highestBit(unsigned long long v)
+  {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return int(index);
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+  }
+
+  //Single-writer increment; cheaper than an atomic read-modify-write
+  void bump(atomic<unsigned long long>& counter)
+  {
+    counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  }
+}
+
+
+/*******************************************************************************
+ LatencyHistogram
+*******************************************************************************/
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+
+void LatencyHistogram::reset()
+{
+  for(int i = 0; i < BucketCount; i++)
+    buckets[i].store(0, memory_order_relaxed);
+
+  total.store(0, memory_order_relaxed);
+  lowest.store(numeric_limits<long long>::max(), memory_order_relaxed);
+  highest.store(0, memory_order_relaxed);
+}
+
+
+int LatencyHistogram::bucketIndex(unsigned long long value)
+{
+  if(value < SubBucketCount)
+    return int(value);
+
+  int level = highestBit(value) - SubBucketBits + 1;
+
+  if(level > LevelCount)
+    return BucketCount - 1;
+
+  return SubBucketCount + (level - 1) * HalfCount
+         + int(value >> level) - HalfCount;
+}
+
+
+long long LatencyHistogram::bucketValue(int index)
+{
+  if(index < SubBucketCount)
+    return index;
+
+  int level = (index - SubBucketCount) / HalfCount + 1;
+  long long sub = (index - SubBucketCount) % HalfCount + HalfCount;
+
+  // Report the top of the bucket, as HDR histograms do.
+  return ((sub + 1) << level) - 1;
+}
+
+
+void LatencyHistogram::record(long long nanos)
+{
+  if(nanos < 0)
+    nanos = 0;
+
+  bump(buckets[bucketIndex((unsigned long long)nanos)]);
+  bump(total);
+
+  if(nanos < lowest.load(memory_order_relaxed))
+    lowest.store(nanos, memory_order_relaxed);
+
+  if(nanos > highest.load(memory_order_relaxed))
+    highest.store(nanos, memory_order_relaxed);
+}
+
+
+unsigned long long LatencyHistogram::count() const
+{
+  return total.load(memory_order_relaxed);
+}
+
+
+long long LatencyHistogram::min() const
+{
+  return count() > 0 ? lowest.load(memory_order_relaxed) : 0;
+}
+
+
+long long LatencyHistogram::max() const
+{
+  return highest.load(memory_order_relaxed);
+}
+
+
+long long LatencyHistogram::percentile(double q) const
+{
+  unsigned long long n = count();
+
+  if(n == 0)
+    return 0;
+
+  unsigned long long target = (unsigned long long)ceil(q * double(n));
+  unsigned long long seen = 0;
+
+  if(target < 1)
+    target = 1;
+
+  for(int i = 0; i < BucketCount; i++)
+  {
+    seen += buckets[i].load(memory_order_relaxed);
+
+    if(seen >= target)
+    {
+      long long value = bucketValue(i);
+      return value < max() ? value : max();
+    }
+  }
+
+  return max();
+}
+
+
+/*******************************************************************************
+ ServoProbe
+*******************************************************************************/
+ServoProbe::ServoProbe(const char* name, double budgetFraction)
+  : probeName(name), budget(budgetFraction), periodNanos(1000000),
+    budgetNanos((long long)(budgetFraction * 1.0e6)), lastStart(0),
+    late(0), overrun(0)
+{
+  int slot = probeCount.fetch_add(1);
+
+  if(slot < MaxProbes)
+    probes[slot] = this;
+}
+
+
+void ServoProbe::setUpdateRate(double rate)
+{
+  long long period = (long long)(1.0e9 / rate);
+
+  periodNanos.store(period);
+  budgetNanos.store((long long)(budget * double(period)));
+}
+
+
+long long ServoProbe::begin()
+{
+  long long now = timestampNow();
+
+  if(lastStart != 0)
+  {
+    long long elapsed = now - lastStart;
+
+    interval.record(elapsed);
+
+    if(double(elapsed) > LateFactor * double(periodNanos.load(memory_order_relaxed)))
+      bump(late);
+  }
+
+  lastStart = now;
+  return now;
+}
+
+
+void ServoProbe::end(long long start)
+{
+  long long elapsed = timestampNow() - start;
+
+  duration.record(elapsed);
+
+  if(elapsed > budgetNanos.load(memory_order_relaxed))
+    bump(overrun);
+}
+
+
+void ServoProbe::reset()
+{
+  duration.reset();
+  interval.reset();
+  late.store(0);
+  overrun.store(0);
+  lastStart = 0;
+}
+
+
+void ServoProbe::print(FILE* out) const
+{
+  const LatencyHistogram* histograms[2] = {&duration, &interval};
+  const char* labels[2] = {"duration", "interval"};
+
+  fprintf(out, "%s: %llu calls, %llu late ticks, %llu over budget (%.0f us)\n",
+          probeName, duration.count(), late.load(), overrun.load(),
+          double(budgetNanos.load()) * 1.0e-3);
+
+  for(int h = 0; h < 2; h++)
+  {
+    const LatencyHistogram& hist = *histograms[h];
+
+    fprintf(out, "  %-8s min %8.1f  p50 %8.1f  p90 %8.1f  p99 %8.1f"
+                 "  p99.9 %8.1f  max %8.1f us\n", labels[h],
+            double(hist.min()) * 1.0e-3,
+            double(hist.percentile(0.50)) * 1.0e-3,
+            double(hist.percentile(0.90)) * 1.0e-3,
+            double(hist.percentile(0.99)) * 1.0e-3,
+            double(hist.percentile(0.999)) * 1.0e-3,
+            double(hist.max()) * 1.0e-3);
+  }
+}
+
+
+void dumpServoProfile(FILE* out)
+{
+  int count = probeCount.load();
+
+  if(count > MaxProbes)
+    count = MaxProbes;
+
+  fprintf(out, "---- servo timing ----\n");
+
+  for(int i = 0; i < count; i++)
+    probes[i]->print(out);
+
+  fflush(out);
+}
@@ -0,0 +1,275 @@
+#include <cmath>
+#include <chrono>
+
+#include "simdevice.h"
+
+using namespace std;
+
+namespace {
+  typedef chrono::steady_clock Clock;
+
+  //Sleep until this close to a deadline, then spin
+  const chrono::microseconds SpinMargin(500);
+
+  //Scripted path: a figure-of-eight this many mm across
+  const double ScriptWidth = 160.0;
+  const double ScriptHeight = 120.0;
+  const double ScriptPeriod = 8.0; // seconds per loop
+
+  const double kPI = 3.1415926535897932384626433832795;
+}
+
+
+SimulatedDevice::SimulatedDevice(const SimulatedDeviceConfig& deviceConfig)
+  : config(deviceConfig), running(false), ticks(0), overruns(0), nextId(1),
+    instantaneousRate(deviceConfig.updateRate), tickTime(0.0), replayCursor(0)
+{
+  if(config.updateRate < 1000.0)
+    config.updateRate = 1000.0;
+  else if(config.updateRate > 10000.0)
+    config.updateRate = 10000.0;
+
+  if(!(config.timeScale > 0.0))
+    config.timeScale = 1.0;
+
+  position[0] = position[1] = position[2] = 0.0;
+  force[0] = force[1] = force[2] = 0.0;
+}
+
+
+SimulatedDevice::~SimulatedDevice()
+{
+  shutdown();
+}
+
+
+bool SimulatedDevice::init()
+{
+  updatePosition(0.0);
+  return true;
+}
+
+
+void SimulatedDevice::shutdown()
+{
+  stopScheduler();
+
+  lock_guard<mutex> guard(scheduleLock);
+  callbacks.clear();
+}
+
+
+void SimulatedDevice::getPosition(double p[3])
+{
+  p[0] = position[0];
+  p[1] = position[1];
+  p[2] = position[2];
+}
+
+
+void SimulatedDevice::setForce(const double f[3])
+{
+  force[0] = f[0];
+  force[1] = f[1];
+  force[2] = f[2];
+}
+
+
+void SimulatedDevice::getLastForce(double f[3]) const
+{
+  f[0] = force[0];
+  f[1] = force[1];
+  f[2] = force[2];
+}
+
+
+double SimulatedDevice::getUpdateRate()
+{
+  return instantaneousRate;
+}
+
+
+double SimulatedDevice::getNominalUpdateRate()
+{
+  return config.updateRate;
+}
+
+
+double SimulatedDevice::getMaxStiffness()
+{
+  return config.maxStiffness;
+}
+
+
+ServoHandle SimulatedDevice::schedule(ServoCallback callback, void *userData,
+                                      unsigned short priority)
+{
+  lock_guard<mutex> guard(scheduleLock);
+  Scheduled entry = {nextId++, callback, userData, priority};
+
+  // Keep the list in priority order so a tick just walks it.
+  vector<Scheduled>::iterator it = callbacks.begin();
+
+  while(it != callbacks.end() && it->priority >= priority)
+    ++it;
+
+  callbacks.insert(it, entry);
+  return entry.id;
+}
+
+
+void SimulatedDevice::unschedule(ServoHandle handle)
+{
+  lock_guard<mutex> guard(scheduleLock);
+
+  for(size_t i = 0; i < callbacks.size(); i++)
+  {
+    if(callbacks[i].id == handle)
+    {
+      callbacks.erase(callbacks.begin() + i);
+      return;
+    }
+  }
+}
+
+
+void SimulatedDevice::startScheduler()
+{
+  if(running.exchange(true))
+    return;
+
+  servoThread = thread(&SimulatedDevice::servoLoop, this);
+}
+
+
+void SimulatedDevice::stopScheduler()
+{
+  if(!running.exchange(false))
+    return;
+
+  servoThread.join();
+}
+
+
+/*******************************************************************************
+ Servo thread body: one iteration per tick until stopScheduler().
+*******************************************************************************/
+void SimulatedDevice::servoLoop()
+{
+  // The loop runs on the wall clock, timeScale ticks for each simulated one.
+  const chrono::nanoseconds period((long long)(1.0e9 / (config.updateRate
+                                                         * config.timeScale)));
+  const double periodSeconds = 1.0 / config.updateRate;
+
+  // A tick is overrun when it starts a whole servo period of the real rate
+  // late, as a real loop would have to be to miss it. Accelerated periods
+  // are microseconds long, and any scheduler hiccup would count against them.
+  const chrono::nanoseconds overrunLateness((long long)(1.0e9 / config.updateRate));
+  unsigned int seed = 2463534242u;
+  unsigned long long tick = 0;
+
+  Clock::time_point deadline = Clock::now();
+  Clock::time_point lastTick = deadline;
+
+  while(running.load(memory_order_relaxed))
+  {
+    deadline += period;
+
+    chrono::nanoseconds lateness(0);
+
+    if(config.jitterMicros > 0.0)
+    {
+      seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+      lateness = chrono::nanoseconds((long long)(
+                   double(seed % 1000) * 1.0e-3 * config.jitterMicros * 1.0e3));
+    }
+
+    Clock::time_point wake = deadline + lateness;
+
+    if(wake - Clock::now() > SpinMargin)
+      this_thread::sleep_until(wake - SpinMargin);
+
+    while(Clock::now() < wake)
+      ;
+
+    Clock::time_point now = Clock::now();
+
+    if(now - deadline > overrunLateness)
+      overruns.fetch_add(1, memory_order_relaxed);
+
+    // Don't try to catch up on a backlog of ticks; the HD scheduler doesn't
+    // either.
+    if(now - deadline > period)
+      deadline = now;
+
+    double interval = chrono::duration<double>(now - lastTick).count();
+    instantaneousRate = interval > 0.0 ? config.timeScale / interval
+                                       : config.updateRate;
+    lastTick = now;
+
+    tickTime = double(tick) * periodSeconds;
+    updatePosition(tickTime);
+    tick++;
+
+    lock_guard<mutex> guard(scheduleLock);
+
+    for(size_t i = 0; i < callbacks.size(); )
+    {
+      if(callbacks[i].callback(callbacks[i].userData))
+        i++;
+      else
+        callbacks.erase(callbacks.begin() + i);
+    }
+
+    ticks.store(tick, memory_order_relaxed);
+  }
+}
+
+
+/*******************************************************************************
+ Moves the end effector to where the trajectory is at time (seconds).
+*******************************************************************************/
+void SimulatedDevice::updatePosition(double time)
+{
+  const vector<TrajectorySample>* replay = config.replay;
+
+  if(replay == NULL || replay->empty())
+  {
+    double phase = 2.0 * kPI * time / ScriptPeriod;
+
+    position[0] = 0.5 * ScriptWidth * sin(phase);
+    position[1] = 0.5 * ScriptHeight * sin(2.0 * phase);
+    position[2] = 0.0;
+    return;
+  }
+
+  const vector<TrajectorySample>& samples = *replay;
+  long long duration = samples.back().time - samples.front().time;
+  long long t = samples.front().time + (long long)(time * 1.0e9);
+
+  if(config.loopReplay && duration > 0)
+    t = samples.front().time + (t - samples.front().time) % duration;
+
+  if(replayCursor >= samples.size() || samples[replayCursor].time > t)
+    replayCursor = 0;
+
+  while(replayCursor + 1 < samples.size() && samples[replayCursor + 1].time <= t)
+    replayCursor++;
+
+  const TrajectorySample& a = samples[replayCursor];
+
+  if(replayCursor + 1 >= samples.size() ||
+     samples[replayCursor + 1].time == a.time)
+  {
+    position[0] = a.position[0];
+    position[1] = a.position[1];
+    position[2] = a.position[2];
+    return;
+  }
+
+  const TrajectorySample& b = samples[replayCursor + 1];
+  double u = double(t - a.time) / double(b.time - a.time);
+
+  for(int i = 0; i < 3; i++)
+    position[i] = a.position[i] + u * (b.position[i] - a.position[i]);
+}
@@ -0,0 +1,155 @@
+#if defined(WIN32)
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+
+#include "skillmonitor.h"
+#include "timestamp.h"
+
+using namespace std;
+
+namespace {
+  //How long the analysis thread sleeps when the ring is empty. A frame is
+  //10 ms at 100 Hz, so this bounds how late an estimate can start.
+  const int IdleMillis = 1;
+}
+
+
+SkillMonitor::SkillMonitor() : windowFrames(0), evaluatedFrames(0),
+                               stopRequested(false), clearRequested(false)
+{
+  estimate.count = 0;
+  estimate.sampleTime = estimate.publishTime = 0;
+}
+
+
+SkillMonitor::~SkillMonitor()
+{
+  stop();
+}
+
+
+bool SkillMonitor::loadModel(const char* filename, string& error)
+{
+  windowFrames = 0;
+
+  if(!model.load(filename, error))
+    return false;
+
+  if(model.inputSize() % KinematicChannelCount != 0)
+  {
+    error = "input count is not a whole number of feature frames";
+    return false;
+  }
+
+  if(model.outputSize() > SkillEstimate::MaxOutputs)
+  {
+    error = "too many outputs";
+    return false;
+  }
+
+  windowFrames = model.inputSize() / KinematicChannelCount;
+  input.resize(model.inputSize());
+  return true;
+}
+
+
+void SkillMonitor::start(size_t ringCapacity)
+{
+  if(worker.joinable())
+    return;
+
+  kinematics.init(ringCapacity, size_t(max(windowFrames, 1)));
+  stopRequested.store(false);
+
+#if defined(WIN32)
+  // Sleep(1) only sleeps a millisecond with the timer at its finest.
+  timeBeginPeriod(1);
+#endif
+
+  worker = thread(&SkillMonitor::run, this);
+}
+
+
+void SkillMonitor::stop()
+{
+  if(!worker.joinable())
+    return;
+
+  stopRequested.store(true);
+  worker.join();
+
+#if defined(WIN32)
+  timeEndPeriod(1);
+#endif
+}
+
+
+void SkillMonitor::clear()
+{
+  clearRequested.store(true);
+}
+
+
+SkillEstimate SkillMonitor::latest() const
+{
+  lock_guard<mutex> hold(estimateLock);
+  return estimate;
+}
+
+
+/*******************************************************************************
+ Analysis thread body.
+*******************************************************************************/
+void SkillMonitor::run()
+{
+  while(!stopRequested.load())
+  {
+    if(clearRequested.exchange(false))
+    {
+      kinematics.clear();
+      evaluatedFrames = 0;
+
+      lock_guard<mutex> hold(estimateLock);
+      estimate.count = 0;
+    }
+
+    if(kinematics.update() == 0)
+    {
+      this_thread::sleep_for(chrono::milliseconds(IdleMillis));
+      continue;
+    }
+
+    // Frames may have piled up; only the newest window matters.
+    if(kinematics.frameCount() > evaluatedFrames
+       && kinematics.features().size() >= size_t(windowFrames)
+       && model.isLoaded())
+      evaluate();
+
+    evaluatedFrames = kinematics.frameCount();
+  }
+}
+
+
+void SkillMonitor::evaluate()
+{
+  const KinematicFeatures& features = kinematics.features();
+  const size_t first = features.size() - windowFrames;
+
+  for(int c = 0; c < KinematicChannelCount; c++)
+    copy(features.channel[c].begin() + first, features.channel[c].end(),
+         input.begin() + size_t(c) * windowFrames);
+
+  SkillEstimate next;
+
+  next.count = model.outputSize();
+  model.evaluate(&input[0], next.value);
+  next.sampleTime = kinematics.latestSampleTime();
+  next.publishTime = timestampNow();
+
+  lock_guard<mutex> hold(estimateLock);
+  estimate = next;
+}
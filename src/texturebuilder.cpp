@@ -0,0 +1,439 @@
+#include <cstdio>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "texturebuilder.h"
+#include "byteorder.h"
+
+using namespace std;
+
+namespace {
+  //Size and modification time of a file, to tell when a cache is stale
+  bool sourceStamp(const string& path, unsigned long long& size,
+                   unsigned long long& modified)
+  {
+    struct stat info;
+
+    if(stat(path.c_str(), &info) != 0)
+      return false;
+
+    size = (unsigned long long)info.st_size;
+    modified = (unsigned long long)info.st_mtime;
+    return true;
+  }
+
+  //Halves a level with a 2x2 box filter; odd edges reuse the last texel
+  void downsample(const TextureLevel& source, TextureLevel& target)
+  {
+    target.width = source.width > 1 ? source.width / 2 : 1;
+    target.height = source.height > 1 ? source.height / 2 : 1;
+    target.data.resize((size_t)target.width * target.height * 3);
+
+    const unsigned char* in = &source.data[0];
+    unsigned char* out = &target.data[0];
+    size_t stride = (size_t)source.width * 3;
+
+    for(int y = 0; y < target.height; y++)
+    {
+      int y0 = 2 * y < source.height ? 2 * y : source.height - 1;
+      int y1 = y0 + 1 < source.height ? y0 + 1 : y0;
+
+      for(int x = 0; x < target.width; x++)
+      {
+        int x0 = 2 * x < source.width ? 2 * x : source.width - 1;
+        int x1 = x0 + 1 < source.width ? x0 + 1 : x0;
+
+        for(int c = 0; c < 3; c++)
+        {
+          int sum = in[y0 * stride + 3 * x0 + c] + in[y0 * stride + 3 * x1 + c]
+                  + in[y1 * stride + 3 * x0 + c] + in[y1 * stride + 3 * x1 + c];
+
+          *out++ = (unsigned char)((sum + 2) / 4);
+        }
+      }
+    }
+  }
+
+  unsigned short packRGB565(const int c[3])
+  {
+    return (unsigned short)((((c[0] * 31 + 127) / 255) << 11) |
+                            (((c[1] * 63 + 127) / 255) << 5) |
+                             ((c[2] * 31 + 127) / 255));
+  }
+
+  void unpackRGB565(unsigned short v, int c[3])
+  {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+  }
+
+  int clampByte(int v)
+  {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+  }
+
+  /*****************************************************************************
+   Encodes one 4x4 block of RGB texels as DXT1. The endpoints are the corners
+   of the block's bounding box, flipped along channels that run against the
+   dominant one and pulled in by 1/16 of the range, which is close to what a
+   least-squares fit gives for the mostly two-tone patterns at a fraction of
+   the cost.
+  *****************************************************************************/
+  void encodeBlock(const unsigned char texels[16][3], unsigned char out[8])
+  {
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    int mean[3] = {0, 0, 0};
+
+    for(int i = 0; i < 16; i++)
+      for(int c = 0; c < 3; c++)
+      {
+        if(texels[i][c] < lo[c]) lo[c] = texels[i][c];
+        if(texels[i][c] > hi[c]) hi[c] = texels[i][c];
+        mean[c] += texels[i][c];
+      }
+
+    int axis = 0;
+
+    for(int c = 1; c < 3; c++)
+      if(hi[c] - lo[c] > hi[axis] - lo[axis])
+        axis = c;
+
+    for(int c = 0; c < 3; c++)
+    {
+      if(c == axis)
+        continue;
+
+      int covariance = 0;
+
+      for(int i = 0; i < 16; i++)
+        covariance += (16 * texels[i][axis] - mean[axis])
+                      * (16 * texels[i][c] - mean[c]);
+
+      if(covariance < 0)
+      {
+        int t = lo[c];
+        lo[c] = hi[c];
+        hi[c] = t;
+      }
+    }
+
+    for(int c = 0; c < 3; c++)
+    {
+      int inset = (hi[c] - lo[c]) / 16;
+
+      hi[c] = clampByte(hi[c] - inset);
+      lo[c] = clampByte(lo[c] + inset);
+    }
+
+    unsigned short color0 = packRGB565(hi), color1 = packRGB565(lo);
+
+    // color0 > color1 selects the four-colour mode.
+    if(color0 < color1)
+    {
+      unsigned short t = color0;
+      color0 = color1;
+      color1 = t;
+    }
+
+    unsigned int indices = 0;
+
+    if(color0 != color1)
+    {
+      int palette[4][3];
+
+      unpackRGB565(color0, palette[0]);
+      unpackRGB565(color1, palette[1]);
+
+      for(int c = 0; c < 3; c++)
+      {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+      }
+
+      for(int i = 0; i < 16; i++)
+      {
+        int best = 0, bestError = 0x7fffffff;
+
+        for(int p = 0; p < 4; p++)
+        {
+          int error = 0;
+
+          for(int c = 0; c < 3; c++)
+          {
+            int d = texels[i][c] - palette[p][c];
+            error += d * d;
+          }
+
+          if(error < bestError)
+          {
+            bestError = error;
+            best = p;
+          }
+        }
+
+        indices |= (unsigned int)best << (2 * i);
+      }
+    }
+
+    putU16(out, color0);
+    putU16(out + 2, color1);
+    putU32(out + 4, indices);
+  }
+
+  void compressLevel(TextureLevel& level)
+  {
+    const int blocksWide = (level.width + 3) / 4;
+    const int blocksHigh = (level.height + 3) / 4;
+    vector<unsigned char> blocks((size_t)blocksWide * blocksHigh * 8);
+    unsigned char texels[16][3];
+    unsigned char* out = &blocks[0];
+
+    for(int by = 0; by < blocksHigh; by++)
+    {
+      for(int bx = 0; bx < blocksWide; bx++)
+      {
+        // Blocks hanging over the edge repeat the last row and column.
+        for(int i = 0; i < 16; i++)
+        {
+          int x = 4 * bx + (i & 3), y = 4 * by + (i >> 2);
+
+          if(x >= level.width) x = level.width - 1;
+          if(y >= level.height) y = level.height - 1;
+
+          memcpy(texels[i], &level.data[((size_t)y * level.width + x) * 3], 3);
+        }
+
+        encodeBlock(texels, out);
+        out += 8;
+      }
+    }
+
+    level.data.swap(blocks);
+  }
+}
+
+
+void buildMipChain(const Image& image, TextureImage& texture)
+{
+  texture.format = TextureRGB8;
+  texture.levels.clear();
+  texture.levels.push_back(TextureLevel());
+
+  TextureLevel& base = texture.levels.back();
+
+  base.width = image.width;
+  base.height = image.height;
+  base.data.assign((const unsigned char*)image.pixels,
+                   (const unsigned char*)image.pixels
+                   + (size_t)image.width * image.height * 3);
+
+  while(texture.levels.back().width > 1 || texture.levels.back().height > 1)
+  {
+    TextureLevel next;
+
+    downsample(texture.levels.back(), next);
+    texture.levels.push_back(TextureLevel());
+    texture.levels.back().width = next.width;
+    texture.levels.back().height = next.height;
+    texture.levels.back().data.swap(next.data);
+  }
+}
+
+
+void compressDxt1(TextureImage& texture)
+{
+  if(texture.format != TextureRGB8)
+    return;
+
+  for(size_t i = 0; i < texture.levels.size(); i++)
+    compressLevel(texture.levels[i]);
+
+  texture.format = TextureDXT1;
+}
+
+
+size_t textureLevelSize(TextureFormat format, int width, int height)
+{
+  if(format == TextureDXT1)
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+
+  return (size_t)width * height * 3;
+}
+
+
+string textureCachePath(const string& bitmapPath)
+{
+  size_t dot = bitmapPath.find_last_of('.');
+  size_t slash = bitmapPath.find_last_of("/\\");
+
+  if(dot == string::npos || (slash != string::npos && dot < slash))
+    return bitmapPath + ".ntx";
+
+  return bitmapPath.substr(0, dot) + ".ntx";
+}
+
+
+bool readTextureCache(const string& bitmapPath, TextureFormat format,
+                      TextureImage& texture)
+{
+  using namespace TextureCacheFormat;
+
+  unsigned long long sourceSize, sourceTime;
+
+  if(!sourceStamp(bitmapPath, sourceSize, sourceTime))
+    return false;
+
+  FILE* file = fopen(textureCachePath(bitmapPath).c_str(), "rb");
+
+  if(file == NULL)
+    return false;
+
+  unsigned char header[HeaderSize];
+  bool valid = fread(header, 1, HeaderSize, file) == HeaderSize
+               && memcmp(header + MagicOffset, Magic, 4) == 0
+               && getU16(header + VersionOffset) == Version
+               && getU16(header + HeaderSizeOffset) == HeaderSize
+               && getU32(header + FormatOffset) == (unsigned int)format
+               && getU64(header + SourceSizeOffset) == sourceSize
+               && getU64(header + SourceTimeOffset) == sourceTime;
+
+  int width = (int)getU32(header + WidthOffset);
+  int height = (int)getU32(header + HeightOffset);
+  unsigned int levelCount = getU32(header + LevelCountOffset);
+
+  if(!valid || width <= 0 || height <= 0 || levelCount == 0 || levelCount > 32)
+  {
+    fclose(file);
+    return false;
+  }
+
+  texture.format = format;
+  texture.levels.resize(levelCount);
+
+  for(unsigned int i = 0; i < levelCount && valid; i++)
+  {
+    TextureLevel& level = texture.levels[i];
+
+    level.width = width;
+    level.height = height;
+    level.data.resize(textureLevelSize(format, width, height));
+    valid = fread(&level.data[0], 1, level.data.size(), file) == level.data.size();
+
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+
+  fclose(file);
+
+  if(!valid)
+    texture.levels.clear();
+
+  return valid;
+}
+
+
+bool writeTextureCache(const string& bitmapPath, const TextureImage& texture)
+{
+  using namespace TextureCacheFormat;
+
+  unsigned long long sourceSize, sourceTime;
+
+  if(texture.levels.empty() || !sourceStamp(bitmapPath, sourceSize, sourceTime))
+    return false;
+
+  string path = textureCachePath(bitmapPath);
+  FILE* file = fopen(path.c_str(), "wb");
+
+  if(file == NULL)
+    return false;
+
+  unsigned char header[HeaderSize];
+
+  memset(header, 0, HeaderSize);
+  memcpy(header + MagicOffset, Magic, 4);
+  putU16(header + VersionOffset, Version);
+  putU16(header + HeaderSizeOffset, (unsigned short)HeaderSize);
+  putU32(header + FormatOffset, (unsigned int)texture.format);
+  putU32(header + WidthOffset, (unsigned int)texture.levels[0].width);
+  putU32(header + HeightOffset, (unsigned int)texture.levels[0].height);
+  putU32(header + LevelCountOffset, (unsigned int)texture.levels.size());
+  putU64(header + SourceSizeOffset, sourceSize);
+  putU64(header + SourceTimeOffset, sourceTime);
+
+  bool written = fwrite(header, 1, HeaderSize, file) == HeaderSize;
+
+  for(size_t i = 0; i < texture.levels.size() && written; i++)
+  {
+    const vector<unsigned char>& data = texture.levels[i].data;
+    written = fwrite(&data[0], 1, data.size(), file) == data.size();
+  }
+
+  written = fclose(file) == 0 && written;
+
+  // A partial cache would only be rejected later; don't leave it around.
+  if(!written)
+    remove(path.c_str());
+
+  return written;
+}
+
+
+bool buildTexture(const string& bitmapPath, TextureFormat format,
+                  TextureImage& texture)
+{
+  unsigned long long sourceSize, sourceTime;
+
+  // loadBMP asserts on a missing file, so check first.
+  if(!sourceStamp(bitmapPath, sourceSize, sourceTime))
+    return false;
+
+  if(readTextureCache(bitmapPath, format, texture))
+    return true;
+
+  Image* image = loadBMP(bitmapPath.c_str());
+
+  if(image == NULL)
+    return false;
+
+  buildMipChain(*image, texture);
+  delete image;
+
+  if(format == TextureDXT1)
+    compressDxt1(texture);
+
+  writeTextureCache(bitmapPath, texture);
+  return true;
+}
+
+
+bool buildTexture(const string& bitmapPath, TextureFormat format,
+                  TextureImage& texture, Image*& image)
+{
+  unsigned long long sourceSize, sourceTime;
+
+  image = NULL;
+
+  if(!sourceStamp(bitmapPath, sourceSize, sourceTime))
+    return false;
+
+  image = loadBMP(bitmapPath.c_str());
+
+  if(image == NULL)
+    return false;
+
+  if(readTextureCache(bitmapPath, format, texture))
+    return true;
+
+  buildMipChain(*image, texture);
+
+  if(format == TextureDXT1)
+    compressDxt1(texture);
+
+  writeTextureCache(bitmapPath, texture);
+  return true;
+}
@@ -0,0 +1,131 @@
+#include <chrono>
+#include <thread>
+
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "timestamp.h"
+#include "cpufeatures.h"
+
+using namespace std;
+
+TimestampScale timestampScale = {false, 0, 0, 0, 32};
+
+namespace {
+  //How long calibration watches the TSC against the OS clock
+  const int CalibrationMillis = 20;
+
+  //Readings per calibration point; the tightest bracket wins
+  const int CalibrationTries = 5;
+
+#if defined(WIN32)
+  LONGLONG qpcFrequency = 0;
+#endif
+
+#if defined(NIMBLE_HAVE_TSC)
+  //Reads the TSC and the OS clock as close together as possible
+  void readPair(unsigned long long& tsc, long long& nanos)
+  {
+    long long bestWindow = -1;
+
+    for(int i = 0; i < CalibrationTries; i++)
+    {
+      long long before = systemTimestamp();
+      unsigned long long ticks = __rdtsc();
+      long long after = systemTimestamp();
+
+      if(bestWindow < 0 || after - before < bestWindow)
+      {
+        bestWindow = after - before;
+        tsc = ticks;
+        nanos = before + (after - before) / 2;
+      }
+    }
+  }
+#endif
+}
+
+
+long long systemTimestamp()
+{
+#if defined(WIN32)
+  LARGE_INTEGER counter;
+
+  if(qpcFrequency == 0)
+  {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    qpcFrequency = frequency.QuadPart;
+  }
+
+  QueryPerformanceCounter(&counter);
+
+  // Split the division so long uptimes don't overflow.
+  return (counter.QuadPart / qpcFrequency) * 1000000000LL
+         + ((counter.QuadPart % qpcFrequency) * 1000000000LL) / qpcFrequency;
+#else
+  timespec ts;
+
+#if defined(CLOCK_MONOTONIC_RAW)
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+
+void calibrateTimestamps()
+{
+  timestampScale.useTsc = false;
+  systemTimestamp();
+
+#if defined(NIMBLE_HAVE_TSC)
+  if(!cpuHasInvariantTsc())
+    return;
+
+  unsigned long long tsc0 = 0, tsc1 = 0;
+  long long nanos0 = 0, nanos1 = 0;
+
+  readPair(tsc0, nanos0);
+  this_thread::sleep_for(chrono::milliseconds(CalibrationMillis));
+  readPair(tsc1, nanos1);
+
+  if(tsc1 <= tsc0 || nanos1 <= nanos0)
+    return;
+
+  double nanosPerTick = double(nanos1 - nanos0) / double(tsc1 - tsc0);
+
+  // Largest shift that still leaves mult in 32 bits.
+  int shift = 32;
+
+  while(shift > 0 && nanosPerTick * double(1ULL << shift) >= 4294967296.0)
+    shift--;
+
+  timestampScale.mult = (unsigned long long)(nanosPerTick * double(1ULL << shift) + 0.5);
+  timestampScale.shift = shift;
+  timestampScale.tscBase = tsc1;
+  timestampScale.nanosBase = nanos1;
+  timestampScale.useTsc = true;
+#endif
+}
+
+
+const char* timestampSource()
+{
+  if(timestampScale.useTsc)
+    return "TSC";
+
+#if defined(WIN32)
+  return "QueryPerformanceCounter";
+#elif defined(CLOCK_MONOTONIC_RAW)
+  return "CLOCK_MONOTONIC_RAW";
+#else
+  return "CLOCK_MONOTONIC";
+#endif
+}
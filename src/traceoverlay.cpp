@@ -0,0 +1,281 @@
+#include <algorithm>
+
+#include "traceoverlay.h"
+#include "affine.h"
+
+using namespace std;
+
+namespace {
+  //Samples moved out of the ring per drain
+  const size_t BatchSize = 1024;
+
+  //Smallest buffer worth allocating, in vertices
+  const size_t MinimumCapacity = 4 * TraceOverlay::ChunkSize;
+
+  //Tolerance the first coarsening starts from when sealing keeps every
+  //sample (mm)
+  const double MinimumTolerance = 0.01;
+
+  //Squared distance from p to the segment a-b
+  template<class P>
+  double segmentDistance2(const P& p, const P& a, const P& b)
+  {
+    double ab[3], ap[3];
+    double length2 = 0.0, along = 0.0;
+
+    for(int i = 0; i < 3; i++)
+    {
+      ab[i] = double(b.position[i]) - a.position[i];
+      ap[i] = double(p.position[i]) - a.position[i];
+      length2 += ab[i] * ab[i];
+      along += ab[i] * ap[i];
+    }
+
+    double u = length2 > 0.0 ? along / length2 : 0.0;
+
+    if(u < 0.0)
+      u = 0.0;
+    else if(u > 1.0)
+      u = 1.0;
+
+    double distance2 = 0.0;
+
+    for(int i = 0; i < 3; i++)
+    {
+      double d = ap[i] - u * ab[i];
+      distance2 += d * d;
+    }
+
+    return distance2;
+  }
+}
+
+
+TraceOverlay::TraceOverlay() : tailStart(0), samplesSeen(0), tolerance(0.0),
+                               currentTolerance(0.0), buffer(0),
+                               bufferCapacity(0), uploaded(0)
+{
+  const double identity[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+  setWorkspaceTransform(identity);
+}
+
+
+void TraceOverlay::init(size_t ringCapacity, double simplifyTolerance)
+{
+  ring.reset(ringCapacity);
+  batch.resize(BatchSize);
+  tolerance = currentTolerance = simplifyTolerance;
+}
+
+
+void TraceOverlay::update()
+{
+  size_t count;
+
+  while((count = ring.drain(&batch[0], batch.size())) > 0)
+  {
+    for(size_t i = 0; i < count; i++)
+    {
+      Point p;
+
+      p.position[0] = float(batch[i].position[0]);
+      p.position[1] = float(batch[i].position[1]);
+      p.position[2] = float(batch[i].position[2]);
+
+      vertices.push_back(p);
+      samplesSeen++;
+
+      if(vertices.size() - tailStart >= ChunkSize)
+        sealChunk();
+    }
+  }
+
+  upload(uploaded);
+}
+
+
+/*******************************************************************************
+ Simplifies the raw tail and makes it a sealed chunk, then coarsens the
+ sealed chunks if they have outgrown the vertex budget.
+*******************************************************************************/
+void TraceOverlay::sealChunk()
+{
+  simplify(tailStart, currentTolerance);
+
+  if(vertices.size() > VertexBudget)
+  {
+    do
+    {
+      currentTolerance = max(2.0 * currentTolerance, MinimumTolerance);
+      simplify(0, currentTolerance);
+    } while(vertices.size() > VertexBudget / 2);
+  }
+
+  tailStart = vertices.size();
+}
+
+
+/*******************************************************************************
+ Douglas-Peucker over the vertices from first to the end, rewritten in place.
+*******************************************************************************/
+void TraceOverlay::simplify(size_t first, double within)
+{
+  const size_t n = vertices.size() - first;
+  const Point* points = &vertices[first];
+  const double tolerance2 = within * within;
+
+  if(n < 3)
+    return;
+
+  keep.assign(n, 0);
+  keep[0] = keep[n - 1] = 1;
+
+  spans.clear();
+  spans.push_back(make_pair(size_t(0), n - 1));
+
+  while(!spans.empty())
+  {
+    pair<size_t, size_t> span = spans.back();
+    spans.pop_back();
+
+    double farthest2 = 0.0;
+    size_t farthest = span.first;
+
+    for(size_t i = span.first + 1; i < span.second; i++)
+    {
+      double d2 = segmentDistance2(points[i], points[span.first], points[span.second]);
+
+      if(d2 > farthest2)
+      {
+        farthest2 = d2;
+        farthest = i;
+      }
+    }
+
+    if(farthest2 > tolerance2)
+    {
+      keep[farthest] = 1;
+      spans.push_back(make_pair(span.first, farthest));
+      spans.push_back(make_pair(farthest, span.second));
+    }
+  }
+
+  simplified.clear();
+
+  for(size_t i = 0; i < n; i++)
+    if(keep[i])
+      simplified.push_back(points[i]);
+
+  vertices.resize(first);
+  vertices.insert(vertices.end(), simplified.begin(), simplified.end());
+
+  // The vertices shrank in place, so the buffer is stale from the first.
+  if(uploaded > first)
+    uploaded = first;
+}
+
+
+void TraceOverlay::upload(size_t first)
+{
+  if(!GLExt::vertexBufferObjects)
+  {
+    uploaded = vertices.size();
+    return;
+  }
+
+  if(vertices.size() > bufferCapacity)
+  {
+    size_t capacity = bufferCapacity > MinimumCapacity ? bufferCapacity : MinimumCapacity;
+
+    while(capacity < vertices.size())
+      capacity *= 2;
+
+    if(buffer == 0)
+      GLExt::genBuffers(1, &buffer);
+
+    GLExt::bindBuffer(GL_ARRAY_BUFFER, buffer);
+    GLExt::bufferData(GL_ARRAY_BUFFER, ptrdiff_t(capacity * sizeof(Point)),
+                      NULL, GL_DYNAMIC_DRAW);
+    bufferCapacity = capacity;
+    first = 0;
+  }
+  else
+    GLExt::bindBuffer(GL_ARRAY_BUFFER, buffer);
+
+  if(first < vertices.size())
+    GLExt::bufferSubData(GL_ARRAY_BUFFER, ptrdiff_t(first * sizeof(Point)),
+                         ptrdiff_t((vertices.size() - first) * sizeof(Point)),
+                         &vertices[first]);
+
+  GLExt::bindBuffer(GL_ARRAY_BUFFER, 0);
+  uploaded = vertices.size();
+}
+
+
+void TraceOverlay::clear()
+{
+  vertices.clear();
+  tailStart = 0;
+  samplesSeen = 0;
+  uploaded = 0;
+  currentTolerance = tolerance;
+}
+
+
+/*******************************************************************************
+ Inverts HL's world-to-workspace transform, then drops the z row so every
+ vertex lands on the pattern plane.
+*******************************************************************************/
+void TraceOverlay::setWorkspaceTransform(const double m[16])
+{
+  if(!invertAffine(m, deviceToWorld))
+    return;
+
+  // Flatten onto z=0.
+  deviceToWorld[2] = deviceToWorld[6] = deviceToWorld[10] = deviceToWorld[14] = 0.0;
+}
+
+
+void TraceOverlay::draw() const
+{
+  if(uploaded < 2)
+    return;
+
+  glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_LINE_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_TEXTURE_2D);
+  glLineWidth(2.0f);
+  glColor3f(0.9f, 0.2f, 0.2f);
+
+  glPushMatrix();
+  glMultMatrixd(deviceToWorld);
+
+  const float* base = NULL;
+
+  if(buffer != 0)
+    GLExt::bindBuffer(GL_ARRAY_BUFFER, buffer);
+  else
+    base = vertices[0].position;
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(Point), base);
+  glDrawArrays(GL_LINE_STRIP, 0, GLsizei(uploaded));
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  if(buffer != 0)
+    GLExt::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glPopMatrix();
+  glPopAttrib();
+}
+
+
+void TraceOverlay::release()
+{
+  if(buffer != 0)
+    GLExt::deleteBuffers(1, &buffer);
+
+  buffer = 0;
+  bufferCapacity = 0;
+  uploaded = 0;
+}
@@ -0,0 +1,491 @@
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#if defined(WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "trajectoryfile.h"
+#include "trajectorytext.h"
+#include "byteorder.h"
+
+using namespace std;
+
+namespace {
+  //Width reserved for the YAML total time, which is only known at the end
+  const int TotalTimeWidth = 16;
+
+  //Records encoded per fwrite
+  const size_t WriteChunk = 256;
+
+  void putDouble(unsigned char* p, double v)
+  {
+    unsigned long long bits;
+    memcpy(&bits, &v, sizeof(bits));
+    putU64(p, bits);
+  }
+
+  void putString(unsigned char* p, const string& s, size_t length)
+  {
+    memset(p, 0, length);
+    memcpy(p, s.c_str(), s.size() < length ? s.size() : length - 1);
+  }
+
+  double getDouble(const unsigned char* p)
+  {
+    unsigned long long bits = getU64(p);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+  }
+
+  string getString(const unsigned char* p, size_t length)
+  {
+    size_t n = 0;
+
+    while(n < length && p[n] != 0)
+      n++;
+
+    return string((const char*)p, n);
+  }
+
+  //Strips the line break and trailing blanks from a header value
+  string trimValue(const char* s)
+  {
+    size_t n = strlen(s);
+
+    while(n > 0 && (s[n-1] == '\n' || s[n-1] == '\r' || s[n-1] == ' '))
+      n--;
+
+    return string(s, n);
+  }
+
+  //The value of a 'key: value' header line
+  string headerValue(const char* line, size_t keyLength)
+  {
+    const char* p = line + keyLength;
+
+    while(*p == ' ')
+      p++;
+
+    return trimValue(p);
+  }
+
+  //Parses the asctime() form used in the YAML header
+  time_t parseDate(const char* s)
+  {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char weekday[4], month[4];
+    tm t;
+
+    memset(&t, 0, sizeof(t));
+
+    if(sscanf(s, "%3s %3s %d %d:%d:%d %d", weekday, month, &t.tm_mday,
+              &t.tm_hour, &t.tm_min, &t.tm_sec, &t.tm_year) != 7)
+      return 0;
+
+    const char* m = strstr(months, month);
+
+    if(m == NULL)
+      return 0;
+
+    t.tm_mon = int(m - months) / 3;
+    t.tm_year -= 1900;
+    t.tm_isdst = -1;
+
+    return mktime(&t);
+  }
+}
+
+
+void syncFile(FILE* file)
+{
+  fflush(file);
+#if defined(WIN32)
+  _commit(_fileno(file));
+#else
+  fsync(fileno(file));
+#endif
+}
+
+
+/*******************************************************************************
+ Binary writer.
+*******************************************************************************/
+TrajectoryWriter::TrajectoryWriter() : file(NULL), sampleCount(0), lastTime(0)
+{
+}
+
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+  close();
+}
+
+
+bool TrajectoryWriter::open(const char* filename, const SessionInfo& info)
+{
+  using namespace TrajectoryFormat;
+
+  close();
+
+  file = fopen(filename, "wb");
+
+  if(file == NULL)
+    return false;
+
+  unsigned char header[HeaderSize];
+
+  memset(header, 0, sizeof(header));
+  memcpy(header + MagicOffset, Magic, 4);
+  putU16(header + VersionOffset, Version);
+  putU16(header + HeaderSizeOffset, HeaderSize);
+  putU32(header + RecordSizeOffset, RecordSize);
+  putU64(header + DateOffset, (unsigned long long)info.date);
+  putU32(header + PatternLevelOffset, (unsigned int)info.patternLevel);
+  putString(header + PatientIdOffset, info.patientId, PatientIdLength);
+  putString(header + LocationOffset, info.location, LocationLength);
+  putString(header + PatternTypeOffset, info.patternType, PatternTypeLength);
+  putString(header + WorkspaceOffset, info.workspace, WorkspaceLength);
+  putString(header + CoordSpaceOffset, info.coordinateSpace, CoordSpaceLength);
+  putString(header + PatternFileOffset, info.patternFile, PatternFileLength);
+
+  if(info.hasPatternTransform)
+  {
+    putU32(header + FlagsOffset, HasPatternTransform);
+
+    for(int i = 0; i < 8; i++)
+      putDouble(header + PatternTransformOffset + 8 * i,
+                info.patternTransform[i / 4][i % 4]);
+  }
+
+  fwrite(header, 1, sizeof(header), file);
+
+  sampleCount = 0;
+  lastTime = 0;
+  return true;
+}
+
+
+void TrajectoryWriter::append(const TrajectorySample* samples, size_t count)
+{
+  using namespace TrajectoryFormat;
+
+  unsigned char buffer[WriteChunk * RecordSize];
+
+  while(count > 0)
+  {
+    size_t n = count < WriteChunk ? count : WriteChunk;
+
+    for(size_t i = 0; i < n; i++)
+    {
+      unsigned char* record = buffer + i * RecordSize;
+
+      putDouble(record, samples[i].position[0]);
+      putDouble(record + 8, samples[i].position[1]);
+      putDouble(record + 16, samples[i].position[2]);
+      putU64(record + 24, (unsigned long long)samples[i].time);
+    }
+
+    fwrite(buffer, RecordSize, n, file);
+
+    sampleCount += n;
+    lastTime = samples[n-1].time;
+    samples += n;
+    count -= n;
+  }
+}
+
+
+void TrajectoryWriter::close()
+{
+  using namespace TrajectoryFormat;
+
+  if(file == NULL)
+    return;
+
+  unsigned char field[8];
+
+  fseek(file, SampleCountOffset, SEEK_SET);
+  putU64(field, sampleCount);
+  fwrite(field, 1, 8, file);
+
+  fseek(file, DurationOffset, SEEK_SET);
+  putU64(field, (unsigned long long)lastTime);
+  fwrite(field, 1, 8, file);
+
+  syncFile(file);
+  fclose(file);
+  file = NULL;
+}
+
+
+/*******************************************************************************
+ Binary reader.
+*******************************************************************************/
+TrajectoryReader::TrajectoryReader() : records(NULL), recordSize(0),
+                                       sampleCount(0), durationNanos(0)
+{
+}
+
+
+bool TrajectoryReader::open(const char* filename)
+{
+  using namespace TrajectoryFormat;
+
+  close();
+
+  if(!mapping.open(filename))
+    return false;
+
+  const unsigned char* header = mapping.data();
+
+  if(mapping.size() < MinHeaderSize || memcmp(header, Magic, 4) != 0 ||
+     getU16(header + VersionOffset) > Version)
+  {
+    close();
+    return false;
+  }
+
+  size_t headerSize = getU16(header + HeaderSizeOffset);
+  recordSize = getU32(header + RecordSizeOffset);
+
+  if(headerSize < MinHeaderSize || recordSize < RecordSize ||
+     headerSize > mapping.size())
+  {
+    close();
+    return false;
+  }
+
+  records = header + headerSize;
+  sampleCount = (mapping.size() - headerSize) / recordSize;
+
+  // A writer that never reached close() leaves the count at zero; the
+  // records themselves are still good, so trust the file size instead.
+  unsigned long long storedCount = getU64(header + SampleCountOffset);
+
+  if(storedCount != 0 && storedCount < sampleCount)
+    sampleCount = size_t(storedCount);
+
+  durationNanos = (long long)getU64(header + DurationOffset);
+
+  if(durationNanos == 0 && sampleCount > 0)
+    durationNanos = sampleTime(sampleCount - 1);
+
+  sessionInfo.date = (time_t)getU64(header + DateOffset);
+  sessionInfo.patternLevel = (int)getU32(header + PatternLevelOffset);
+  sessionInfo.patientId = getString(header + PatientIdOffset, PatientIdLength);
+  sessionInfo.location = getString(header + LocationOffset, LocationLength);
+  sessionInfo.patternType = getString(header + PatternTypeOffset, PatternTypeLength);
+  sessionInfo.workspace = getString(header + WorkspaceOffset, WorkspaceLength);
+  sessionInfo.coordinateSpace = getString(header + CoordSpaceOffset, CoordSpaceLength);
+
+  if(headerSize >= PatternTransformOffset + 64)
+  {
+    sessionInfo.patternFile = getString(header + PatternFileOffset, PatternFileLength);
+    sessionInfo.hasPatternTransform =
+      (getU32(header + FlagsOffset) & HasPatternTransform) != 0;
+
+    for(int i = 0; i < 8 && sessionInfo.hasPatternTransform; i++)
+      sessionInfo.patternTransform[i / 4][i % 4] =
+        getDouble(header + PatternTransformOffset + 8 * i);
+  }
+
+  return true;
+}
+
+
+void TrajectoryReader::close()
+{
+  mapping.close();
+  sessionInfo = SessionInfo();
+  records = NULL;
+  recordSize = 0;
+  sampleCount = 0;
+  durationNanos = 0;
+}
+
+
+TrajectorySample TrajectoryReader::sample(size_t i) const
+{
+  const unsigned char* record = records + i * recordSize;
+  TrajectorySample s;
+
+  s.position[0] = getDouble(record);
+  s.position[1] = getDouble(record + 8);
+  s.position[2] = getDouble(record + 16);
+  s.time = (long long)getU64(record + 24);
+
+  return s;
+}
+
+
+long long TrajectoryReader::sampleTime(size_t i) const
+{
+  return (long long)getU64(records + i * recordSize + 24);
+}
+
+
+size_t TrajectoryReader::seek(long long time) const
+{
+  size_t first = 0, count = sampleCount;
+
+  while(count > 0)
+  {
+    size_t step = count / 2;
+
+    if(sampleTime(first + step) < time)
+    {
+      first += step + 1;
+      count -= step + 1;
+    }
+    else
+      count = step;
+  }
+
+  return first;
+}
+
+
+/*******************************************************************************
+ YAML layout, as produced by the recorder.
+*******************************************************************************/
+void writeYamlHeader(FILE* file, const SessionInfo& info, long* totalTimeOffset)
+{
+  fprintf(file, "%%YAML 1.2\n"
+                "---\n"
+                "patient-id: %s\n"
+                "date: %s\n" //TODO: format to canonical YAML timestamp
+                "location: %s\n",
+          info.patientId.c_str(), asctime(localtime(&info.date)),
+          info.location.c_str());
+
+  fprintf(file, "pattern: \n"
+                "  type: %s\n"
+                "  level: %d\n"
+                "  file: %s\n",
+          info.patternType.c_str(), info.patternLevel, info.patternFile.c_str());
+
+  if(info.hasPatternTransform)
+  {
+    const double (*t)[4] = info.patternTransform;
+
+    fprintf(file, "  transform: [%.17g, %.17g, %.17g, %.17g, "
+                  "%.17g, %.17g, %.17g, %.17g]\n",
+            t[0][0], t[0][1], t[0][2], t[0][3], t[1][0], t[1][1], t[1][2], t[1][3]);
+  }
+
+  fprintf(file, "workspace: %s\n"
+                "coordinate-space: %s\n",
+          info.workspace.c_str(), info.coordinateSpace.c_str());
+
+  fprintf(file, "total-time: ");
+  *totalTimeOffset = ftell(file);
+  fprintf(file, "%-*s\n", TotalTimeWidth, "0");
+
+  fprintf(file, "data: \n"
+                "- [x, y, z, time]\n");
+}
+
+
+void writeYamlTotalTime(FILE* file, long totalTimeOffset, double totalTime)
+{
+  long end = ftell(file);
+
+  fseek(file, totalTimeOffset, SEEK_SET);
+  fprintf(file, "%-*g", TotalTimeWidth, totalTime);
+  fseek(file, end, SEEK_SET);
+}
+
+
+void writeYamlSamples(FILE* file, const TrajectorySample* samples, size_t count)
+{
+  TrajectoryTextWriter writer;
+
+  writer.attach(file);
+  writer.writeSamples(samples, count);
+  writer.flush();
+}
+
+
+bool parseYamlHeaderLine(const char* line, SessionInfo& info)
+{
+  if(strncmp(line, "patient-id:", 11) == 0)
+    info.patientId = headerValue(line, 11);
+  else if(strncmp(line, "date:", 5) == 0)
+    info.date = parseDate(headerValue(line, 5).c_str());
+  else if(strncmp(line, "location:", 9) == 0)
+    info.location = headerValue(line, 9);
+  else if(strncmp(line, "  type:", 7) == 0)
+    info.patternType = headerValue(line, 7);
+  else if(strncmp(line, "  level:", 8) == 0)
+    info.patternLevel = atoi(headerValue(line, 8).c_str());
+  else if(strncmp(line, "  file:", 7) == 0)
+    info.patternFile = headerValue(line, 7);
+  else if(strncmp(line, "  transform:", 12) == 0)
+  {
+    double (*t)[4] = info.patternTransform;
+
+    info.hasPatternTransform =
+      sscanf(line + 12, " [%lf, %lf, %lf, %lf, %lf, %lf, %lf, %lf]",
+             &t[0][0], &t[0][1], &t[0][2], &t[0][3],
+             &t[1][0], &t[1][1], &t[1][2], &t[1][3]) == 8;
+  }
+  else if(strncmp(line, "workspace:", 10) == 0)
+    info.workspace = headerValue(line, 10);
+  else if(strncmp(line, "coordinate-space:", 17) == 0)
+    info.coordinateSpace = headerValue(line, 17);
+  else if(strncmp(line, "data:", 5) == 0)
+    return true;
+
+  return false;
+}
+
+
+bool readYamlTrajectory(const char* filename, SessionInfo& info,
+                        vector<TrajectorySample>& samples)
+{
+  TrajectoryTextReader reader;
+
+  if(!reader.open(filename))
+    return false;
+
+  info = reader.info();
+  samples.clear();
+
+  TrajectorySample batch[256];
+  size_t n;
+
+  while((n = reader.read(batch, 256)) > 0)
+    samples.insert(samples.end(), batch, batch + n);
+
+  return true;
+}
+
+
+bool writeYamlTrajectory(const char* filename, const SessionInfo& info,
+                         const vector<TrajectorySample>& samples)
+{
+  FILE* file = fopen(filename, "w");
+
+  if(file == NULL)
+    return false;
+
+  long totalTimeOffset;
+
+  writeYamlHeader(file, info, &totalTimeOffset);
+
+  if(!samples.empty())
+  {
+    writeYamlSamples(file, &samples[0], samples.size());
+    writeYamlTotalTime(file, totalTimeOffset,
+                       double(samples.back().time - samples.front().time) * 1.0e-6);
+  }
+
+  syncFile(file);
+  fclose(file);
+  return true;
+}
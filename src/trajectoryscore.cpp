@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cmath>
+
+#include "trajectoryscore.h"
+#include "distancefield.h"
+
+using namespace std;
+
+namespace {
+  //Fills p[0..7] clockwise from north with the 8-neighbours of pixel i,
+  //off the image counting as clear, and returns how many are set
+  int neighbours(const vector<char>& mask, int w, int h, int i, int p[8])
+  {
+    static const int dx[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+    static const int dy[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+    int x = i % w, y = i / w, set = 0;
+
+    for(int k = 0; k < 8; k++)
+    {
+      int nx = x + dx[k], ny = y + dy[k];
+
+      p[k] = nx >= 0 && nx < w && ny >= 0 && ny < h
+             && mask[size_t(ny) * w + nx];
+      set += p[k];
+    }
+
+    return set;
+  }
+
+  //How far (x, y) lies outside the grid, in pixels
+  double outsideBy(int width, int height, double x, double y)
+  {
+    double dx = max(max(-x, x - (width - 1)), 0.0);
+    double dy = max(max(-y, y - (height - 1)), 0.0);
+
+    return sqrt(dx * dx + dy * dy);
+  }
+}
+
+
+void printTrajectoryScore(FILE* out, const TrajectoryScore& score)
+{
+  fprintf(out, "samples:        %llu\n"
+               "duration:       %.1f ms\n"
+               "rms deviation:  %.3f mm\n"
+               "max deviation:  %.3f mm\n"
+               "time off path:  %.1f ms (%.1f%%)\n"
+               "completion:     %.1f%%\n",
+          (unsigned long long)score.samples, score.totalTime,
+          score.rmsDeviation, score.maxDeviation, score.timeOffPath,
+          score.totalTime > 0.0 ? 100.0 * score.timeOffPath / score.totalTime : 0.0,
+          100.0 * score.completion);
+}
+
+
+/*******************************************************************************
+ Zhang-Suen thinning: alternately peels boundary pixels from the south-east
+ and the north-west until a pass removes nothing. Only the pixels still set
+ are visited, so later passes get cheaper as the stroke thins. Zhang-Suen
+ leaves staircases two pixels thick on slopes, so a last pass removes the
+ inner corner of each step; the path stays 8-connected without them.
+*******************************************************************************/
+size_t skeletonize(const vector<char>& stroke, int w, int h,
+                   vector<char>& skeleton)
+{
+  const size_t n = size_t(w) * h;
+  vector<int> remaining, removed;
+
+  skeleton.assign(n, 0);
+
+  for(size_t i = 0; i < n; i++)
+  {
+    if(stroke[i])
+    {
+      skeleton[i] = 1;
+      remaining.push_back(int(i));
+    }
+  }
+
+  bool changed = true;
+
+  while(changed)
+  {
+    changed = false;
+
+    for(int pass = 0; pass < 2; pass++)
+    {
+      removed.clear();
+
+      for(size_t r = 0; r < remaining.size(); r++)
+      {
+        int i = remaining[r];
+        int p[8], set = neighbours(skeleton, w, h, i, p), rises = 0;
+
+        for(int k = 0; k < 8; k++)
+          rises += !p[k] && p[(k + 1) % 8];
+
+        if(set < 2 || set > 6 || rises != 1)
+          continue;
+
+        // North, east, south and west are p[0], p[2], p[4] and p[6].
+        bool peel = pass == 0 ? !(p[0] && p[2] && p[4]) && !(p[2] && p[4] && p[6])
+                              : !(p[0] && p[2] && p[6]) && !(p[0] && p[4] && p[6]);
+
+        if(peel)
+          removed.push_back(i);
+      }
+
+      for(size_t r = 0; r < removed.size(); r++)
+        skeleton[removed[r]] = 0;
+
+      if(!removed.empty())
+      {
+        changed = true;
+
+        size_t kept = 0;
+
+        for(size_t r = 0; r < remaining.size(); r++)
+          if(skeleton[remaining[r]])
+            remaining[kept++] = remaining[r];
+
+        remaining.resize(kept);
+      }
+    }
+  }
+
+  // A corner with both 4-neighbours set and the three pixels across from
+  // them clear is the inner step of a staircase. Removing them one at a
+  // time keeps the path connected.
+  size_t kept = 0;
+
+  for(size_t r = 0; r < remaining.size(); r++)
+  {
+    int i = remaining[r];
+    int p[8];
+    bool step = false;
+
+    neighbours(skeleton, w, h, i, p);
+
+    for(int a = 0; a < 8 && !step; a += 2)
+      step = p[a] && p[(a + 2) % 8] && !p[(a + 4) % 8] && !p[(a + 5) % 8]
+             && !p[(a + 6) % 8];
+
+    if(step)
+      skeleton[i] = 0;
+    else
+      remaining[kept++] = i;
+  }
+
+  remaining.resize(kept);
+  return remaining.size();
+}
+
+
+PatternScorer::PatternScorer() : width(0), height(0)
+{
+}
+
+
+bool PatternScorer::load(const Image& pattern, int threshold,
+                         unsigned int threads)
+{
+  vector<char> mask, skeleton;
+
+  centreline.clear();
+  width = pattern.width;
+  height = pattern.height;
+
+  size_t strokePixels = strokeMask(pattern, threshold, mask);
+
+  if(strokePixels == 0 || strokePixels == mask.size())
+    return false;
+
+  // A stroke too thin to thin (a lone 2x2 block) leaves no centreline.
+  if(skeletonize(mask, width, height, skeleton) == 0)
+    return false;
+
+  vector<float> edge, distance2;
+  vector<int> nearestPixel;
+
+  signedDistance(mask, width, height, threads, edge);
+  distanceTransform(skeleton, width, height, threads, distance2, &nearestPixel);
+
+  // Number the centreline pixels so completion needs one flag per pixel
+  // of it rather than per pixel of the pattern.
+  const size_t n = size_t(width) * height;
+  vector<int> ordinal(n, -1);
+
+  for(size_t i = 0; i < n; i++)
+  {
+    if(skeleton[i])
+    {
+      ordinal[i] = int(centreline.size());
+      centreline.push_back(int(i));
+    }
+  }
+
+  cells.resize(n);
+
+  for(size_t i = 0; i < n; i++)
+  {
+    cells[i].centreDistance = sqrt(distance2[i]);
+    cells[i].edgeDistance = edge[i];
+    cells[i].nearestCentre = ordinal[nearestPixel[i]];
+  }
+
+  return true;
+}
+
+
+TrajectoryScore PatternScorer::score(const TrajectorySample* samples,
+                                     size_t count, const double toPixel[2][4],
+                                     double reach) const
+{
+  TrajectoryScore result = {count, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+  if(!isLoaded() || count == 0)
+    return result;
+
+  const double spacing = pixelSpacing(toPixel);
+  vector<char> reached(centreline.size(), 0);
+  double sum2 = 0.0;
+  long long offPath = 0;
+
+  for(size_t i = 0; i < count; i++)
+  {
+    const double* position = samples[i].position;
+    double x = toPixel[0][0] * position[0] + toPixel[0][1] * position[1]
+               + toPixel[0][2] * position[2] + toPixel[0][3];
+    double y = toPixel[1][0] * position[0] + toPixel[1][1] * position[1]
+               + toPixel[1][2] * position[2] + toPixel[1][3];
+
+    // Bilinear in both distances; off the pattern, add the way back to
+    // its edge.
+    double outside = outsideBy(width, height, x, y);
+    double cx = min(max(x, 0.0), double(width - 1));
+    double cy = min(max(y, 0.0), double(height - 1));
+    int x0 = int(cx), y0 = int(cy);
+    int x1 = min(x0 + 1, width - 1), y1 = min(y0 + 1, height - 1);
+    double fx = cx - x0, fy = cy - y0;
+
+    const Cell& a = cells[size_t(y0) * width + x0];
+    const Cell& b = cells[size_t(y0) * width + x1];
+    const Cell& c = cells[size_t(y1) * width + x0];
+    const Cell& d = cells[size_t(y1) * width + x1];
+
+    double wa = (1 - fx) * (1 - fy), wb = fx * (1 - fy);
+    double wc = (1 - fx) * fy, wd = fx * fy;
+
+    double centre = wa * a.centreDistance + wb * b.centreDistance
+                    + wc * c.centreDistance + wd * d.centreDistance;
+    double edge = wa * a.edgeDistance + wb * b.edgeDistance
+                  + wc * c.edgeDistance + wd * d.edgeDistance;
+    double deviation = (centre + outside) * spacing;
+
+    sum2 += deviation * deviation;
+    result.maxDeviation = max(result.maxDeviation, deviation);
+
+    if(i > 0 && (edge > 0.0 || outside > 0.0))
+      offPath += samples[i].time - samples[i - 1].time;
+
+    // The nearest of the four pixels decides which centreline pixel.
+    if(deviation <= reach && outside == 0.0)
+    {
+      const Cell& nearest = fy < 0.5 ? (fx < 0.5 ? a : b) : (fx < 0.5 ? c : d);
+      reached[nearest.nearestCentre] = 1;
+    }
+  }
+
+  // A trace running half a pixel beside the centreline is never nearest
+  // to some of its pixels, so a pixel next to a reached one counts too.
+  // Centreline pixels are the cells at distance zero.
+  size_t completed = 0;
+
+  for(size_t k = 0; k < centreline.size(); k++)
+  {
+    int x = centreline[k] % width, y = centreline[k] / width;
+    bool done = reached[k] != 0;
+
+    for(int ny = max(y - 1, 0); ny <= min(y + 1, height - 1) && !done; ny++)
+    {
+      for(int nx = max(x - 1, 0); nx <= min(x + 1, width - 1) && !done; nx++)
+      {
+        const Cell& cell = cells[size_t(ny) * width + nx];
+        done = cell.centreDistance == 0.0f && reached[cell.nearestCentre];
+      }
+    }
+
+    completed += done;
+  }
+
+  result.rmsDeviation = sqrt(sum2 / double(count));
+  result.timeOffPath = double(offPath) * 1.0e-6;
+  result.totalTime = double(samples[count - 1].time - samples[0].time) * 1.0e-6;
+  result.completion = double(completed) / double(reached.size());
+
+  return result;
+}
@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "trajectorytext.h"
+
+// Visual C++ before 2015 only has the underscored name, which returns -1
+// instead of the length and leaves no terminator when the text doesn't fit.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+using namespace std;
+
+namespace {
+  //Every power of ten a double holds exactly
+  const double Pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                          1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                          1e18, 1e19, 1e20, 1e21, 1e22};
+  const int MaxExactPow10 = 22;
+
+  //Largest integer a double holds exactly
+  const unsigned long long MaxExactInteger = 1ULL << 53;
+
+  //Above this the scaled value may be off by more than TieMargin
+  const double MaxScaled = 1e9;
+
+  //Scaled values this close to a rounding tie go through snprintf, whose
+  //tie-breaking is what the old output used
+  const double TieMargin = 1e-6;
+
+  //Longest row: four numbers plus the brackets and separators
+  const size_t MaxRowLength = 4 * MaxFixedLength + 16;
+
+  //True for negative numbers and negative zero, which printf signs too
+  bool hasSignBit(double v)
+  {
+    unsigned long long bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return (bits >> 63) != 0;
+  }
+
+  //Writes the decimal digits of v, most significant first
+  char* writeDigits(char* out, unsigned long long v, int minDigits)
+  {
+    char digits[24];
+    int n = 0;
+
+    do
+    {
+      digits[n++] = char('0' + v % 10);
+      v /= 10;
+    } while(v != 0);
+
+    while(n < minDigits)
+      digits[n++] = '0';
+
+    while(n > 0)
+      *out++ = digits[--n];
+
+    return out;
+  }
+
+  const char* skipBlanks(const char* p, const char* end)
+  {
+    while(p < end && (*p == ' ' || *p == '\t'))
+      p++;
+
+    return p;
+  }
+
+  /*****************************************************************************
+   Parses a number at p, before end, and returns the character after it, or
+   NULL if there is none. A decimal whose digits fit a double exactly is one
+   correctly rounded division, so it matches strtod; anything else (exponents,
+   long mantissas, inf) is handed to strtod itself.
+  *****************************************************************************/
+  const char* parseNumber(const char* p, const char* end, double& value)
+  {
+    const char* start = p;
+    bool negative = false;
+
+    if(p < end && (*p == '-' || *p == '+'))
+      negative = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    int digits = 0, fractionDigits = 0;
+    bool fraction = false;
+
+    for(; p < end; p++)
+    {
+      if(*p >= '0' && *p <= '9')
+      {
+        if(mantissa < MaxExactInteger)
+          mantissa = mantissa * 10 + unsigned(*p - '0');
+
+        digits++;
+        fractionDigits += fraction;
+      }
+      else if(*p == '.' && !fraction)
+        fraction = true;
+      else
+        break;
+    }
+
+    bool exact = digits > 0 && mantissa < MaxExactInteger
+                 && fractionDigits <= MaxExactPow10
+                 && (p == end || (*p != 'e' && *p != 'E'));
+
+    if(exact)
+    {
+      value = double(mantissa) / Pow10[fractionDigits];
+
+      if(negative)
+        value = -value;
+
+      return p;
+    }
+
+    char text[64];
+    size_t n = min(size_t(end - start), sizeof(text) - 1);
+    char* stop;
+
+    memcpy(text, start, n);
+    text[n] = 0;
+    value = strtod(text, &stop);
+
+    return stop == text ? NULL : start + (stop - text);
+  }
+
+  //Parses a '- [x, y, z, time]' row in [p, end)
+  bool parseRow(const char* p, const char* end, TrajectorySample& sample)
+  {
+    p = skipBlanks(p, end);
+
+    if(p == end || *p++ != '-')
+      return false;
+
+    p = skipBlanks(p, end);
+
+    if(p == end || *p++ != '[')
+      return false;
+
+    double values[4];
+
+    for(int k = 0; k < 4; k++)
+    {
+      p = parseNumber(skipBlanks(p, end), end, values[k]);
+
+      if(p == NULL)
+        return false;
+
+      if(k < 3)
+      {
+        p = skipBlanks(p, end);
+
+        if(p == end || *p++ != ',')
+          return false;
+      }
+    }
+
+    for(int k = 0; k < 3; k++)
+      sample.position[k] = values[k];
+
+    sample.time = (long long)floor(values[3] * 1.0e6 + 0.5);
+    return true;
+  }
+}
+
+
+size_t formatFixed(char* out, double value, int precision)
+{
+  double magnitude = fabs(value);
+
+  precision = min(max(precision, 0), MaxFixedPrecision);
+
+  if(precision < 10 && magnitude * Pow10[precision] < MaxScaled)
+  {
+    double scaled = magnitude * Pow10[precision];
+    double whole = floor(scaled);
+    double fraction = scaled - whole;
+
+    if(fabs(fraction - 0.5) > TieMargin)
+    {
+      unsigned long long rounded = (unsigned long long)whole + (fraction > 0.5);
+      unsigned long long divisor = (unsigned long long)Pow10[precision];
+      char* p = out;
+
+      if(hasSignBit(value))
+        *p++ = '-';
+
+      p = writeDigits(p, rounded / divisor, 1);
+
+      if(precision > 0)
+      {
+        *p++ = '.';
+        p = writeDigits(p, rounded % divisor, precision);
+      }
+
+      return size_t(p - out);
+    }
+  }
+
+  // Ties, huge values, NaN and infinity are rare; let the C library do them.
+  // With the precision clamped the text always fits, terminator and all, so
+  // -1 only comes back from an encoding error.
+  char text[MaxFixedLength + 1];
+  int n = snprintf(text, sizeof(text), "%.*f", precision, value);
+
+  if(n < 0 || n > int(MaxFixedLength))
+    return 0;
+
+  memcpy(out, text, size_t(n));
+  return size_t(n);
+}
+
+
+size_t formatMillis(char* out, long long nanos)
+{
+  char* p = out;
+  unsigned long long magnitude;
+
+  // Like printf, keep the sign of values that round to zero.
+  if(nanos < 0)
+  {
+    *p++ = '-';
+    magnitude = 0ULL - (unsigned long long)nanos;
+  }
+  else
+    magnitude = (unsigned long long)nanos;
+
+  unsigned long long tenths = (magnitude + 50000) / 100000;
+
+  p = writeDigits(p, tenths / 10, 1);
+  *p++ = '.';
+  *p++ = char('0' + tenths % 10);
+
+  return size_t(p - out);
+}
+
+
+TrajectoryTextWriter::TrajectoryTextWriter(size_t bufferSize)
+  : file(NULL), buffer(bufferSize < 2 * MaxRowLength ? 2 * MaxRowLength : bufferSize),
+    used(0)
+{
+}
+
+
+TrajectoryTextWriter::~TrajectoryTextWriter()
+{
+  flush();
+}
+
+
+void TrajectoryTextWriter::attach(FILE* destination)
+{
+  flush();
+  file = destination;
+}
+
+
+void TrajectoryTextWriter::writeSamples(const TrajectorySample* samples,
+                                        size_t count)
+{
+  char* base = &buffer[0];
+
+  for(size_t i = 0; i < count; i++)
+  {
+    if(buffer.size() - used < MaxRowLength)
+      flush();
+
+    char* p = base + used;
+
+    *p++ = '-'; *p++ = ' '; *p++ = '[';
+    p += formatFixed(p, samples[i].position[0], 4);
+    *p++ = ','; *p++ = ' ';
+    p += formatFixed(p, samples[i].position[1], 4);
+    *p++ = ','; *p++ = ' ';
+    p += formatFixed(p, samples[i].position[2], 4);
+    *p++ = ','; *p++ = ' ';
+    p += formatMillis(p, samples[i].time);
+    *p++ = ']'; *p++ = '\n';
+
+    used = size_t(p - base);
+  }
+}
+
+
+void TrajectoryTextWriter::flush()
+{
+  if(used > 0 && file != NULL)
+    fwrite(&buffer[0], 1, used, file);
+
+  used = 0;
+}
+
+
+TrajectoryTextReader::TrajectoryTextReader() : cursor(NULL), end(NULL)
+{
+}
+
+
+bool TrajectoryTextReader::open(const char* filename)
+{
+  close();
+
+  if(!mapping.open(filename))
+  {
+    // Mapping fails on an empty file, which still counts as a session.
+    FILE* file = fopen(filename, "rb");
+
+    if(file == NULL)
+      return false;
+
+    fclose(file);
+    return true;
+  }
+
+  const char* p = (const char*)mapping.data();
+  end = p + mapping.size();
+
+  // Header lines are short; longer ones are cut, as fgets into the same
+  // buffer would.
+  char line[512];
+  bool data = false;
+
+  while(p < end && !data)
+  {
+    const char* lineEnd = (const char*)memchr(p, '\n', size_t(end - p));
+    const char* next = lineEnd != NULL ? lineEnd + 1 : end;
+    size_t n = min(size_t(next - p), sizeof(line) - 1);
+
+    memcpy(line, p, n);
+    line[n] = 0;
+    data = parseYamlHeaderLine(line, sessionInfo);
+    p = next;
+  }
+
+  cursor = p;
+  return true;
+}
+
+
+void TrajectoryTextReader::close()
+{
+  mapping.close();
+  sessionInfo = SessionInfo();
+  cursor = end = NULL;
+}
+
+
+size_t TrajectoryTextReader::read(TrajectorySample* out, size_t max)
+{
+  size_t count = 0;
+
+  while(count < max && cursor < end)
+  {
+    const char* lineEnd = (const char*)memchr(cursor, '\n', size_t(end - cursor));
+
+    if(lineEnd == NULL)
+      lineEnd = end;
+
+    if(parseRow(cursor, lineEnd, out[count]))
+      count++;
+
+    cursor = lineEnd < end ? lineEnd + 1 : end;
+  }
+
+  return count;
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "workpool.h"
+
+using namespace std;
+
+namespace {
+  //Indices [next, end) still to run, shared with thieves
+  struct WorkRange
+  {
+    mutex lock;
+    size_t next;
+    size_t end;
+  };
+
+  //Takes the next index of range, or returns false if it is empty
+  bool takeFront(WorkRange& range, size_t& index)
+  {
+    lock_guard<mutex> hold(range.lock);
+
+    if(range.next >= range.end)
+      return false;
+
+    index = range.next++;
+    return true;
+  }
+
+  size_t remaining(WorkRange& range)
+  {
+    lock_guard<mutex> hold(range.lock);
+    return range.end > range.next ? range.end - range.next : 0;
+  }
+
+  //Moves the back half of the fullest other range into own, which is empty.
+  //Returns false once there is nothing left to take.
+  bool steal(vector<WorkRange>& ranges, unsigned int own)
+  {
+    for(;;)
+    {
+      unsigned int victim = own;
+      size_t most = 0;
+
+      for(unsigned int i = 0; i < ranges.size(); i++)
+      {
+        size_t left = i != own ? remaining(ranges[i]) : 0;
+
+        if(left > most)
+        {
+          victim = i;
+          most = left;
+        }
+      }
+
+      if(victim == own)
+        return false;
+
+      // Both locks at once, so the stolen indices are always in some range
+      // and no other thief can see everything empty while they move.
+      unique_lock<mutex> a(ranges[own].lock, defer_lock);
+      unique_lock<mutex> b(ranges[victim].lock, defer_lock);
+      lock(a, b);
+
+      WorkRange& from = ranges[victim];
+
+      if(from.next >= from.end)
+        continue; // emptied meanwhile; look again
+
+      size_t split = from.next + (from.end - from.next) / 2;
+
+      ranges[own].next = split;
+      ranges[own].end = from.end;
+      from.end = split;
+      return true;
+    }
+  }
+
+  void work(vector<WorkRange>& ranges, unsigned int own,
+            const function<void(unsigned int, size_t)>& task)
+  {
+    size_t index;
+
+    for(;;)
+    {
+      while(takeFront(ranges[own], index))
+        task(own, index);
+
+      if(!steal(ranges, own))
+        return;
+    }
+  }
+}
+
+
+WorkPool::WorkPool(unsigned int threads) : threadCount(threads)
+{
+  if(threadCount == 0)
+    threadCount = max(thread::hardware_concurrency(), 1u);
+}
+
+
+void WorkPool::run(size_t count,
+                   const function<void(unsigned int, size_t)>& task) const
+{
+  unsigned int workers = threadCount;
+
+  if(size_t(workers) > count)
+    workers = unsigned(max(count, size_t(1)));
+
+  vector<WorkRange> ranges(workers);
+
+  for(unsigned int i = 0; i < workers; i++)
+  {
+    ranges[i].next = count * i / workers;
+    ranges[i].end = count * (i + 1) / workers;
+  }
+
+  vector<thread> threads;
+
+  for(unsigned int i = 1; i < workers; i++)
+    threads.push_back(thread(work, ref(ranges), i, cref(task)));
+
+  work(ranges, 0, task);
+
+  for(size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
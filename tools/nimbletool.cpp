@@ -0,0 +1,600 @@
+/*******************************************************************************
+* Offline utilities for Nimble session files.
+*
+*   nimbletool convert <input> <output>
+*       Converts between the YAML (.txt) and binary (.nbt) session formats.
+*       The direction is chosen from the output file extension.
+*
+*   nimbletool texture [--rgb] <bitmap>...
+*       Builds the mipmapped texture cache (.ntx) next to each pattern
+*       bitmap, DXT1-compressed unless --rgb is given, so the application
+*       doesn't have to on its first run.
+*
+*   nimbletool score [--patterns <dir>] [--reach <mm>] <session>...
+*       Scores sessions against the centreline of the pattern each was
+*       drawn over, found in <dir> (default patterns/). A centreline point
+*       counts as completed once the device came within <mm> (default 1.5)
+*       of it. Needs sessions recorded with a pattern transform.
+*
+*   nimbletool features <session> <output.csv>
+*       Resamples a session to 100 Hz and writes its kinematic features,
+*       one row per frame: position, velocity, acceleration and jerk,
+*       speed, curvature and tremor-band velocity.
+*
+*   nimbletool batch [--threads <n>] <directory>...
+*       Reads every session under the directories, on all cores, and prints
+*       the sessions, duration, path length and mean speed totalled per
+*       pattern type and level. A session recorded both as .txt and .nbt is
+*       read once, from the .nbt.
+*******************************************************************************/
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trajectoryfile.h"
+#include "trajectorytext.h"
+#include "texturebuilder.h"
+#include "trajectoryscore.h"
+#include "kinematics.h"
+#include "workpool.h"
+#include "constants.h"
+
+using namespace std;
+
+namespace {
+  bool hasExtension(const string& path, const char* extension)
+  {
+    size_t n = strlen(extension);
+
+    return path.size() >= n && path.compare(path.size() - n, n, extension) == 0;
+  }
+
+  //Loads either format into memory
+  bool loadTrajectory(const string& path, SessionInfo& info,
+                      vector<TrajectorySample>& samples)
+  {
+    if(!hasExtension(path, ".nbt"))
+      return readYamlTrajectory(path.c_str(), info, samples);
+
+    TrajectoryReader reader;
+
+    if(!reader.open(path.c_str()))
+      return false;
+
+    info = reader.info();
+    samples.resize(reader.size());
+
+    for(size_t i = 0; i < reader.size(); i++)
+      samples[i] = reader.sample(i);
+
+    return true;
+  }
+
+  int convert(const string& input, const string& output)
+  {
+    SessionInfo info;
+    vector<TrajectorySample> samples;
+
+    if(!loadTrajectory(input, info, samples))
+    {
+      cerr << "CAN'T READ SESSION FILE: " << input << endl;
+      return 1;
+    }
+
+    bool written;
+
+    if(hasExtension(output, ".nbt"))
+    {
+      TrajectoryWriter writer;
+
+      written = writer.open(output.c_str(), info);
+
+      if(written && !samples.empty())
+        writer.append(&samples[0], samples.size());
+    }
+    else
+      written = writeYamlTrajectory(output.c_str(), info, samples);
+
+    if(!written)
+    {
+      cerr << "CAN'T OPEN OUTPUT FILE: " << output << endl;
+      return 1;
+    }
+
+    cout << samples.size() << " samples written to " << output << endl;
+    return 0;
+  }
+
+  int buildTextures(int count, char* paths[])
+  {
+    TextureFormat format = TextureDXT1;
+    int failures = 0;
+
+    for(int i = 0; i < count; i++)
+    {
+      if(strcmp(paths[i], "--rgb") == 0)
+      {
+        format = TextureRGB8;
+        continue;
+      }
+
+      // Always rebuild; an existing cache may come from an older encoder.
+      FILE* bitmap = fopen(paths[i], "rb");
+      Image* image = NULL;
+
+      if(bitmap != NULL)
+      {
+        fclose(bitmap);
+        image = loadBMP(paths[i]);
+      }
+
+      if(image == NULL)
+      {
+        cerr << "CAN'T READ BITMAP: " << paths[i] << endl;
+        failures++;
+        continue;
+      }
+
+      TextureImage texture;
+
+      buildMipChain(*image, texture);
+      delete image;
+
+      if(format == TextureDXT1)
+        compressDxt1(texture);
+
+      if(!writeTextureCache(paths[i], texture))
+      {
+        cerr << "CAN'T WRITE TEXTURE CACHE: " << textureCachePath(paths[i]) << endl;
+        failures++;
+        continue;
+      }
+
+      cout << textureCachePath(paths[i]) << ": " << texture.levels[0].width
+           << "x" << texture.levels[0].height << ", "
+           << texture.levels.size() << " levels" << endl;
+    }
+
+    return failures > 0 ? 1 : 0;
+  }
+
+  int scoreSessions(int count, char* args[])
+  {
+    string patternDir = "patterns/";
+    double reach = Constant::ScoreReach;
+    int failures = 0;
+
+    // Sessions over the same pattern share its scorer.
+    map<string, PatternScorer> scorers;
+
+    for(int i = 0; i < count; i++)
+    {
+      if(strcmp(args[i], "--patterns") == 0 && i + 1 < count)
+      {
+        patternDir = args[++i];
+
+        if(!patternDir.empty() && !hasExtension(patternDir, "/")
+           && !hasExtension(patternDir, "\\"))
+          patternDir += "/";
+
+        continue;
+      }
+
+      if(strcmp(args[i], "--reach") == 0 && i + 1 < count)
+      {
+        reach = atof(args[++i]);
+        continue;
+      }
+
+      SessionInfo info;
+      vector<TrajectorySample> samples;
+
+      if(!loadTrajectory(args[i], info, samples))
+      {
+        cerr << "CAN'T READ SESSION FILE: " << args[i] << endl;
+        failures++;
+        continue;
+      }
+
+      if(info.patternFile.empty() || !info.hasPatternTransform)
+      {
+        cerr << "NO PATTERN TRANSFORM IN: " << args[i] << endl;
+        failures++;
+        continue;
+      }
+
+      string patternPath = patternDir + info.patternFile;
+      map<string, PatternScorer>::iterator scorer = scorers.find(patternPath);
+
+      if(scorer == scorers.end())
+      {
+        FILE* bitmap = fopen(patternPath.c_str(), "rb");
+        Image* image = NULL;
+
+        if(bitmap != NULL)
+        {
+          fclose(bitmap);
+          image = loadBMP(patternPath.c_str());
+        }
+
+        scorer = scorers.insert(make_pair(patternPath, PatternScorer())).first;
+
+        if(image != NULL)
+        {
+          scorer->second.load(*image, Constant::StrokeThreshold,
+                              thread::hardware_concurrency());
+          delete image;
+        }
+      }
+
+      if(!scorer->second.isLoaded())
+      {
+        cerr << "CAN'T READ PATTERN: " << patternPath << endl;
+        failures++;
+        continue;
+      }
+
+      TrajectoryScore score = scorer->second.score(
+        samples.empty() ? NULL : &samples[0], samples.size(),
+        info.patternTransform, reach);
+
+      cout << args[i] << " (" << info.patternFile << "):" << endl;
+      printTrajectoryScore(stdout, score);
+    }
+
+    return failures > 0 ? 1 : 0;
+  }
+
+  int writeFeatures(const string& input, const string& output)
+  {
+    SessionInfo info;
+    vector<TrajectorySample> samples;
+
+    if(!loadTrajectory(input, info, samples))
+    {
+      cerr << "CAN'T READ SESSION FILE: " << input << endl;
+      return 1;
+    }
+
+    KinematicFeatures features;
+
+    extractKinematics(samples.empty() ? NULL : &samples[0], samples.size(),
+                      features);
+
+    FILE* file = fopen(output.c_str(), "w");
+
+    if(file == NULL)
+    {
+      cerr << "CAN'T OPEN OUTPUT FILE: " << output << endl;
+      return 1;
+    }
+
+    fprintf(file, "time");
+
+    for(int c = 0; c < KinematicChannelCount; c++)
+      fprintf(file, ",%s", KinematicChannelNames[c]);
+
+    fprintf(file, "\n");
+
+    for(size_t i = 0; i < features.size(); i++)
+    {
+      fprintf(file, "%.2f", double(i) * 1.0e3 / features.rate);
+
+      for(int c = 0; c < KinematicChannelCount; c++)
+        fprintf(file, ",%.6g", features.channel[c][i]);
+
+      fprintf(file, "\n");
+    }
+
+    fclose(file);
+    cout << features.size() << " frames written to " << output << endl;
+    return 0;
+  }
+
+  //Summary of one session file
+  struct SessionSummary
+  {
+    bool read;
+    string patternType;
+    int patternLevel;
+    unsigned long long samples;
+    double duration;   // ms
+    double pathLength; // mm
+  };
+
+  //Sessions of one pattern type and level added up
+  struct SummaryTotals
+  {
+    SummaryTotals() : sessions(0), samples(0), duration(0.0), pathLength(0.0) {}
+
+    int sessions;
+    unsigned long long samples;
+    double duration;
+    double pathLength;
+  };
+
+  //Adds session files (.txt, .nbt) under dir to paths, subdirectories too
+  void findSessions(const string& dir, vector<string>& paths)
+  {
+    string prefix = dir;
+
+    if(!prefix.empty() && !hasExtension(prefix, "/") && !hasExtension(prefix, "\\"))
+      prefix += "/";
+
+#if defined(WIN32)
+    WIN32_FIND_DATAA entry;
+    HANDLE search = FindFirstFileA((prefix + "*").c_str(), &entry);
+
+    if(search == INVALID_HANDLE_VALUE)
+      return;
+
+    do
+    {
+      string name = entry.cFileName;
+
+      if(name == "." || name == "..")
+        continue;
+
+      if(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        findSessions(prefix + name, paths);
+      else if(hasExtension(name, ".txt") || hasExtension(name, ".nbt"))
+        paths.push_back(prefix + name);
+    } while(FindNextFileA(search, &entry));
+
+    FindClose(search);
+#else
+    DIR* search = opendir(dir.c_str());
+
+    if(search == NULL)
+      return;
+
+    while(dirent* entry = readdir(search))
+    {
+      string name = entry->d_name;
+      struct stat info;
+
+      if(name == "." || name == ".." || stat((prefix + name).c_str(), &info) != 0)
+        continue;
+
+      if(S_ISDIR(info.st_mode))
+        findSessions(prefix + name, paths);
+      else if(hasExtension(name, ".txt") || hasExtension(name, ".nbt"))
+        paths.push_back(prefix + name);
+    }
+
+    closedir(search);
+#endif
+  }
+
+  //Keeps one file per session in sorted paths. The recorder writes each
+  //session twice, as s.txt and s.nbt; the binary one is quicker to read.
+  void dropTextDuplicates(vector<string>& paths)
+  {
+    const vector<string> all(paths);
+    size_t kept = 0;
+
+    for(size_t i = 0; i < all.size(); i++)
+    {
+      const string& path = all[i];
+
+      if(hasExtension(path, ".txt")
+         && binary_search(all.begin(), all.end(),
+                          path.substr(0, path.size() - 4) + ".nbt"))
+        continue;
+
+      paths[kept++] = path;
+    }
+
+    paths.resize(kept);
+  }
+
+  //Adds the step from previous to sample to the path length
+  inline void addStep(const TrajectorySample& previous,
+                      const TrajectorySample& sample, double& pathLength)
+  {
+    double dx = sample.position[0] - previous.position[0];
+    double dy = sample.position[1] - previous.position[1];
+    double dz = sample.position[2] - previous.position[2];
+
+    pathLength += sqrt(dx * dx + dy * dy + dz * dz);
+  }
+
+  //Reads a session a batch at a time; nothing grows with its length
+  SessionSummary summarize(const string& path)
+  {
+    SessionSummary summary = {false, "", 0, 0, 0.0, 0.0};
+    TrajectorySample first = {{0.0, 0.0, 0.0}, 0}, last = first;
+
+    if(hasExtension(path, ".nbt"))
+    {
+      TrajectoryReader reader;
+
+      if(!reader.open(path.c_str()))
+        return summary;
+
+      for(size_t i = 0; i < reader.size(); i++)
+      {
+        TrajectorySample sample = reader.sample(i);
+
+        if(i == 0)
+          first = sample;
+        else
+          addStep(last, sample, summary.pathLength);
+
+        last = sample;
+      }
+
+      summary.samples = reader.size();
+      summary.patternType = reader.info().patternType;
+      summary.patternLevel = reader.info().patternLevel;
+    }
+    else
+    {
+      TrajectoryTextReader reader;
+
+      if(!reader.open(path.c_str()))
+        return summary;
+
+      TrajectorySample batch[512];
+      size_t n;
+
+      while((n = reader.read(batch, 512)) > 0)
+      {
+        for(size_t i = 0; i < n; i++)
+        {
+          if(summary.samples + i == 0)
+            first = batch[i];
+          else
+            addStep(last, batch[i], summary.pathLength);
+
+          last = batch[i];
+        }
+
+        summary.samples += n;
+      }
+
+      summary.patternType = reader.info().patternType;
+      summary.patternLevel = reader.info().patternLevel;
+    }
+
+    if(summary.samples > 0)
+      summary.duration = double(last.time - first.time) * 1.0e-6;
+
+    summary.read = true;
+    return summary;
+  }
+
+  void printTotals(const char* pattern, const char* level, const SummaryTotals& t)
+  {
+    double seconds = t.duration * 1.0e-3;
+
+    printf("%-16s %5s %8d %12llu %14.1f %14.1f %12.2f\n", pattern, level,
+           t.sessions, t.samples, seconds, t.pathLength,
+           seconds > 0.0 ? t.pathLength / seconds : 0.0);
+  }
+
+  int batchSummary(int count, char* args[])
+  {
+    unsigned int threads = 0;
+    vector<string> paths;
+
+    for(int i = 0; i < count; i++)
+    {
+      if(strcmp(args[i], "--threads") == 0 && i + 1 < count)
+        threads = unsigned(atoi(args[++i]));
+      else
+        findSessions(args[i], paths);
+    }
+
+    sort(paths.begin(), paths.end());
+    dropTextDuplicates(paths);
+
+    // Each file fills its own slot, so the workers share nothing.
+    WorkPool pool(threads);
+    vector<SessionSummary> summaries(paths.size());
+
+    pool.run(paths.size(), [&](unsigned int, size_t i)
+    {
+      summaries[i] = summarize(paths[i]);
+    });
+
+    map<pair<string, int>, SummaryTotals> totals;
+    SummaryTotals all;
+    int failures = 0;
+
+    for(size_t i = 0; i < summaries.size(); i++)
+    {
+      const SessionSummary& s = summaries[i];
+
+      if(!s.read)
+      {
+        cerr << "CAN'T READ SESSION FILE: " << paths[i] << endl;
+        failures++;
+        continue;
+      }
+
+      SummaryTotals* rows[2] = {&totals[make_pair(s.patternType, s.patternLevel)], &all};
+
+      for(int r = 0; r < 2; r++)
+      {
+        rows[r]->sessions++;
+        rows[r]->samples += s.samples;
+        rows[r]->duration += s.duration;
+        rows[r]->pathLength += s.pathLength;
+      }
+    }
+
+    printf("%-16s %5s %8s %12s %14s %14s %12s\n", "pattern", "level",
+           "sessions", "samples", "duration (s)", "path (mm)", "speed (mm/s)");
+
+    map<pair<string, int>, SummaryTotals>::const_iterator row;
+
+    for(row = totals.begin(); row != totals.end(); ++row)
+    {
+      char level[16];
+
+      sprintf(level, "%d", row->first.second);
+      printTotals(row->first.first.empty() ? "-" : row->first.first.c_str(),
+                  level, row->second);
+    }
+
+    printTotals("all", "", all);
+
+    printf("%d files read with %u threads\n", int(paths.size()) - failures,
+           pool.size());
+
+    return failures > 0 ? 1 : 0;
+  }
+
+  int usage()
+  {
+    cerr << "usage: nimbletool convert <input> <output>" << endl
+         << "       nimbletool texture [--rgb] <bitmap>..." << endl
+         << "       nimbletool score [--patterns <dir>] [--reach <mm>] <session>..."
+         << endl
+         << "       nimbletool features <session> <output.csv>" << endl
+         << "       nimbletool batch [--threads <n>] <directory>..." << endl;
+    return 2;
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    return usage();
+
+  string command = argv[1];
+
+  if(command == "convert" && argc == 4)
+    return convert(argv[2], argv[3]);
+
+  if(command == "texture" && argc >= 3)
+    return buildTextures(argc - 2, argv + 2);
+
+  if(command == "score" && argc >= 3)
+    return scoreSessions(argc - 2, argv + 2);
+
+  if(command == "features" && argc == 4)
+    return writeFeatures(argv[2], argv[3]);
+
+  if(command == "batch" && argc >= 3)
+    return batchSummary(argc - 2, argv + 2);
+
+  return usage();
+}